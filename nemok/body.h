@@ -0,0 +1,70 @@
+#pragma once
+#include "server.h"
+
+/*
+	mock.when("GET").reply(nemok::body::repeat("0123456789"), 10ull << 30);
+	mock.when(http::GET("/blob")).reply(http::response(200), nemok::body::random(42), 1 << 20);
+*/
+
+namespace nemok
+{
+
+// body generators, whatever they make depends on the offset alone, so the bytes
+// are the same however the body is cut into pieces
+namespace body
+{
+
+// the pattern over and over again
+inline body_generator repeat(std::string pattern)
+{
+	if (pattern.empty())
+	{
+		throw exception("empty pattern");
+	}
+
+	auto shared = std::make_shared<const std::string>(std::move(pattern));
+	return [shared](char* buffer, size_t size, uint64_t offset)
+	{
+		const std::string& p = *shared;
+		size_t pos = offset % p.size();
+		while (size > 0)
+		{
+			const size_t len = std::min(size, p.size() - pos);
+			memcpy(buffer, p.data() + pos, len);
+			buffer += len;
+			size -= len;
+			pos = 0;
+		}
+	};
+}
+
+inline uint64_t splitmix64(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+// pseudo-random bytes, the same seed makes the same body
+inline body_generator random(uint64_t seed)
+{
+	return [seed](char* buffer, size_t size, uint64_t offset)
+	{
+		uint64_t word_index = offset / 8;
+		size_t skip = offset % 8;
+		while (size > 0)
+		{
+			const uint64_t word = splitmix64(seed ^ splitmix64(word_index++));
+			const size_t len = std::min(size, sizeof(word) - skip);
+			memcpy(buffer, reinterpret_cast<const char*>(&word) + skip, len);
+			buffer += len;
+			size -= len;
+			skip = 0;
+		}
+	};
+}
+
+} // namespace body
+
+} // namespace nemok
@@ -4,6 +4,9 @@
 #include <unistd.h>
 #include <strings.h>
 #include <poll.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <climits>
 #include <cassert>
 
 #include <iostream>
@@ -41,6 +44,14 @@ void client::shutdown()
 	}
 }
 
+void client::shutdown_write()
+{
+	if (-1 != _sock)
+	{
+		::shutdown(_sock, SHUT_WR);
+	}
+}
+
 bool client::connected() const
 {
 	return -1 != _sock;
@@ -75,6 +86,16 @@ int wait_while_ready(pollfd& fd)
 }
 
 ssize_t client::read_some(void* buffer, size_t length)
+{
+	return receive(buffer, length, 0);
+}
+
+ssize_t client::peek_some(void* buffer, size_t length)
+{
+	return receive(buffer, length, MSG_PEEK);
+}
+
+ssize_t client::receive(void* buffer, size_t length, int flags)
 {
 	if (!connected())
 	{
@@ -90,7 +111,7 @@ ssize_t client::read_some(void* buffer, size_t length)
 	{
 		if (POLLIN == wait_while_ready(poll_data))
 		{
-			bytes = ::read(_sock, buffer, length);
+			bytes = ::recv(_sock, buffer, length, flags);
 			if (0 == bytes)
 			{
 				break;
@@ -121,7 +142,8 @@ ssize_t client::write_some(const void* buffer, size_t length)
 	ssize_t bytes = -1;
 	do
 	{
-		bytes = ::write(_sock, buffer, length);
+		// a peer gone away is reported as an error rather than by SIGPIPE
+		bytes = ::send(_sock, buffer, length, MSG_NOSIGNAL);
 	}
 	while (bytes == -1 && (errno == EINTR || errno == EAGAIN));
 
@@ -133,6 +155,88 @@ ssize_t client::write_some(const void* buffer, size_t length)
 	return bytes;
 }
 
+namespace
+{
+
+// sendfile has no MSG_NOSIGNAL, so SIGPIPE is held back while it runs
+// and taken off the pending ones if it has been raised
+class sigpipe_guard
+{
+public:
+	sigpipe_guard()
+	{
+		sigemptyset(&pipe_);
+		sigaddset(&pipe_, SIGPIPE);
+		sigpending(&pending_);
+		already_pending_ = sigismember(&pending_, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &pipe_, &old_);
+	}
+
+	~sigpipe_guard()
+	{
+		if (!already_pending_)
+		{
+			sigpending(&pending_);
+			if (sigismember(&pending_, SIGPIPE))
+			{
+				const timespec zero = {0, 0};
+				sigtimedwait(&pipe_, nullptr, &zero);
+			}
+		}
+
+		pthread_sigmask(SIG_SETMASK, &old_, nullptr);
+	}
+
+private:
+	sigset_t pipe_;
+	sigset_t pending_;
+	sigset_t old_;
+	bool already_pending_ = false;
+};
+
+} // namespace
+
+void client::send_file(int fd, uint64_t offset, uint64_t count)
+{
+	if (!connected())
+	{
+		throw not_connected();
+	}
+
+	sigpipe_guard guard;
+	off_t pos = offset;
+	while (count > 0)
+	{
+		const ssize_t bytes = ::sendfile(_sock, fd, &pos, std::min<uint64_t>(count, 1 << 30));
+		if (bytes == -1 && errno == EINTR)
+		{
+			continue;
+		}
+
+		// a non-blocking socket is to have room before it's tried again
+		if (bytes == -1 && errno == EAGAIN)
+		{
+			pollfd poll_data = {};
+			poll_data.fd = _sock;
+			poll_data.events = POLLOUT;
+			wait_while_ready(poll_data);
+			continue;
+		}
+
+		if (bytes == -1)
+		{
+			throw network_error("can't send a file to a socket");
+		}
+
+		if (bytes == 0)
+		{
+			throw file_too_short();
+		}
+
+		count -= bytes;
+	}
+}
+
 client::client(client&& rhs)
 {
 	*this = std::move(rhs);
@@ -152,6 +256,13 @@ void client::assign(int fd)
 	*this = std::move(rhs);
 }
 
+int client::release()
+{
+	const int ret = _sock;
+	_sock = -1;
+	return ret;
+}
+
 void client::write_all(const void* buffer, size_t len)
 {
 	const uint8_t* const buf = static_cast<const uint8_t*>(buffer);
@@ -163,6 +274,46 @@ void client::write_all(const void* buffer, size_t len)
 
 }
 
+void client::write_all(iovec* pieces, size_t count)
+{
+	if (!connected())
+	{
+		throw not_connected();
+	}
+
+	while (count > 0)
+	{
+		msghdr message = {};
+		message.msg_iov = pieces;
+		message.msg_iovlen = std::min<size_t>(count, IOV_MAX);
+
+		// a peer gone away is reported as an error rather than by SIGPIPE
+		ssize_t bytes = ::sendmsg(_sock, &message, MSG_NOSIGNAL);
+		if (bytes == -1 && (errno == EINTR || errno == EAGAIN))
+		{
+			continue;
+		}
+
+		if (bytes == -1)
+		{
+			throw network_error("can't write to a socket");
+		}
+
+		while (count > 0 && size_t(bytes) >= pieces->iov_len)
+		{
+			bytes -= pieces->iov_len;
+			++pieces;
+			--count;
+		}
+
+		if (count > 0)
+		{
+			pieces->iov_base = static_cast<char*>(pieces->iov_base) + bytes;
+			pieces->iov_len -= bytes;
+		}
+	}
+}
+
 void client::read_all(void* buffer, size_t len)
 {
 	uint8_t* const buf = static_cast< uint8_t*>(buffer);
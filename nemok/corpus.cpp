@@ -0,0 +1,206 @@
+#include <fstream>
+#include <unordered_set>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "corpus.h"
+
+namespace nemok
+{
+
+namespace
+{
+
+const char magic[] = "NEMOKCP1";
+const size_t magic_size = 8;
+const size_t header_size = magic_size + 2 * sizeof(uint64_t);
+
+uint64_t fnv1a(string_view s)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (char ch : s)
+	{
+		hash = (hash ^ uint8_t(ch)) * 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+uint64_t align(uint64_t offset)
+{
+	return (offset + corpus_alignment - 1) & ~uint64_t(corpus_alignment - 1);
+}
+
+} // namespace
+
+std::string corpus_key(string_view method, string_view uri)
+{
+	std::string key;
+	key.reserve(method.size() + 1 + uri.size());
+	key.append(method.data(), method.size());
+	key.append(1, ' ');
+	key.append(uri.data(), uri.size());
+	return key;
+}
+
+void corpus_builder::add(std::string key, std::string response)
+{
+	entries_.emplace_back(std::move(key), std::move(response));
+}
+
+size_t corpus_builder::size() const
+{
+	return entries_.size();
+}
+
+void corpus_builder::write(const std::string& path) const
+{
+	std::vector<const std::pair<std::string, std::string>*> entries;
+	std::unordered_set<string_view, std::hash<string_view>> seen;
+	for (auto& e : entries_)
+	{
+		if (seen.insert(e.first).second)
+		{
+			entries.push_back(&e);
+		}
+	}
+
+	// at most half full, the probes stay short
+	uint64_t slot_count = 1;
+	while (slot_count < 2 * entries.size())
+	{
+		slot_count <<= 1;
+	}
+
+	std::vector<corpus_slot> slots(slot_count, corpus_slot{0, 0, 0, 0, 0});
+	uint64_t key_offset = header_size + slot_count * sizeof(corpus_slot);
+	uint64_t keys_size = 0;
+	for (auto e : entries)
+	{
+		keys_size += e->first.size();
+	}
+
+	uint64_t body_offset = align(key_offset + keys_size);
+	for (auto e : entries)
+	{
+		const uint64_t hash = fnv1a(e->first);
+		uint64_t i = hash & (slot_count - 1);
+		while (slots[i].key_offset)
+		{
+			i = (i + 1) & (slot_count - 1);
+		}
+
+		slots[i] = corpus_slot{hash, key_offset, e->first.size(), body_offset, e->second.size()};
+		key_offset += e->first.size();
+		body_offset = align(body_offset + e->second.size());
+	}
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		throw corpus_error("can't create the corpus file");
+	}
+
+	const uint64_t counts[2] = {slot_count, entries.size()};
+	out.write(magic, magic_size);
+	out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+	out.write(reinterpret_cast<const char*>(slots.data()), slots.size() * sizeof(corpus_slot));
+
+	uint64_t offset = header_size + slot_count * sizeof(corpus_slot);
+	for (auto e : entries)
+	{
+		out.write(e->first.data(), e->first.size());
+		offset += e->first.size();
+	}
+
+	const char padding[corpus_alignment] = {};
+	for (auto e : entries)
+	{
+		out.write(padding, align(offset) - offset);
+		out.write(e->second.data(), e->second.size());
+		offset = align(offset) + e->second.size();
+	}
+
+	if (!out.flush())
+	{
+		throw corpus_error("can't write the corpus file");
+	}
+}
+
+corpus::corpus(const std::string& path)
+{
+	const int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+	{
+		throw corpus_error("can't open the corpus file");
+	}
+
+	struct stat st;
+	if (::fstat(fd, &st) == -1 || size_t(st.st_size) < header_size)
+	{
+		::close(fd);
+		throw corpus_error("not a corpus file");
+	}
+
+	size_ = st.st_size;
+	void* data = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		throw corpus_error("can't map the corpus file");
+	}
+
+	data_ = static_cast<const char*>(data);
+	std::memcpy(&slot_count_, data_ + magic_size, sizeof(uint64_t));
+	std::memcpy(&entry_count_, data_ + magic_size + sizeof(uint64_t), sizeof(uint64_t));
+	slots_ = reinterpret_cast<const corpus_slot*>(data_ + header_size);
+
+	const bool valid = std::memcmp(data_, magic, magic_size) == 0
+		&& slot_count_ && (slot_count_ & (slot_count_ - 1)) == 0
+		&& slot_count_ <= (size_ - header_size) / sizeof(corpus_slot);
+	if (!valid)
+	{
+		::munmap(data, size_);
+		throw corpus_error("not a corpus file");
+	}
+
+	// the lookups land anywhere in the index
+	::madvise(data, size_, MADV_RANDOM);
+}
+
+corpus::~corpus()
+{
+	::munmap(const_cast<char*>(data_), size_);
+}
+
+bool corpus::find(string_view key, string_view& response) const
+{
+	const uint64_t hash = fnv1a(key);
+	uint64_t i = hash & (slot_count_ - 1);
+	for (uint64_t probe = 0; probe < slot_count_ && slots_[i].key_offset; ++probe, i = (i + 1) & (slot_count_ - 1))
+	{
+		const corpus_slot& s = slots_[i];
+		if (s.hash != hash || s.key_size != key.size() || s.key_offset + s.key_size > size_
+			|| string_view(data_ + s.key_offset, s.key_size) != key)
+		{
+			continue;
+		}
+
+		if (s.body_offset > size_ || s.body_size > size_ - s.body_offset)
+		{
+			return false;
+		}
+
+		response = string_view(data_ + s.body_offset, s.body_size);
+		return true;
+	}
+
+	return false;
+}
+
+size_t corpus::size() const
+{
+	return entry_count_;
+}
+
+} // namespace nemok
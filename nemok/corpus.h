@@ -0,0 +1,82 @@
+#pragma once
+#include "server.h"
+
+/*
+	// built once, by the nemok_corpus tool or in code
+	nemok::corpus_builder b;
+	b.add("GET /users/1", "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}");
+	b.write("api.corpus");
+
+	// mapped by every mock that serves it, the responses are written to the
+	// connections right out of the mapping
+	auto mock = nemok::start<nemok::http>();
+	mock.when(nemok::http::request()).serve_corpus("api.corpus");
+*/
+
+namespace nemok
+{
+
+// the file is
+//   header: magic, slot count, entry count (uint64 each)
+//   index: slot count slots, a power of two, open addressing with linear probing
+//   keys: one after another
+//   bodies: the region and every body in it aligned to corpus_alignment
+// the integers are in the byte order of the host that has built the file
+struct corpus_slot
+{
+	uint64_t hash;
+
+	// zero for an empty slot, the keys come after the index
+	uint64_t key_offset;
+	uint64_t key_size;
+	uint64_t body_offset;
+	uint64_t body_size;
+};
+
+const size_t corpus_alignment = 64;
+
+class corpus_error : public exception
+{
+public:
+	explicit corpus_error(const char* message) : exception(message) {}
+};
+
+// the key an http request is looked up with, e.g. "GET /users/1?full=1"
+std::string corpus_key(string_view method, string_view uri);
+
+class corpus_builder
+{
+public:
+	// the first response added for a key is the one kept
+	void add(std::string key, std::string response);
+	size_t size() const;
+
+	void write(const std::string& path) const;
+
+private:
+	std::vector<std::pair<std::string, std::string>> entries_;
+};
+
+// a read only mapping of a corpus file, shared by whoever maps the same file
+class corpus
+{
+public:
+	explicit corpus(const std::string& path);
+	~corpus();
+
+	corpus(const corpus&) = delete;
+	corpus& operator =(const corpus&) = delete;
+
+	// false unless there's a response for the key
+	bool find(string_view key, string_view& response) const;
+	size_t size() const;
+
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+	const corpus_slot* slots_ = nullptr;
+	uint64_t slot_count_ = 0;
+	uint64_t entry_count_ = 0;
+};
+
+} // namespace nemok
@@ -0,0 +1,411 @@
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define NEMOK_DIGEST_X86
+#endif
+
+#include "digest.h"
+
+namespace nemok
+{
+
+namespace digest
+{
+
+namespace
+{
+
+// the byte by byte table of the reflected Castagnoli polynomial
+struct crc32c_table
+{
+	uint32_t entries[256];
+
+	crc32c_table()
+	{
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit)
+			{
+				crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+			}
+
+			entries[i] = crc;
+		}
+	}
+};
+
+uint32_t crc32c_scalar(uint32_t crc, const uint8_t* data, size_t size)
+{
+	static const crc32c_table table;
+	for (size_t i = 0; i < size; ++i)
+	{
+		crc = table.entries[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+
+	return crc;
+}
+
+#ifdef NEMOK_DIGEST_X86
+__attribute__((target("sse4.2")))
+uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, size_t size)
+{
+	uint64_t crc64 = crc;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, sizeof(word));
+		crc64 = _mm_crc32_u64(crc64, word);
+	}
+
+	uint32_t crc32 = static_cast<uint32_t>(crc64);
+	for (; i < size; ++i)
+	{
+		crc32 = _mm_crc32_u8(crc32, data[i]);
+	}
+
+	return crc32;
+}
+#endif
+
+using crc_kernel = uint32_t (*)(uint32_t crc, const uint8_t* data, size_t size);
+
+crc_kernel pick_crc_kernel()
+{
+#ifdef NEMOK_DIGEST_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+	{
+		return crc32c_sse42;
+	}
+#endif
+	return crc32c_scalar;
+}
+
+const uint64_t prime64_1 = 0x9e3779b185ebca87ull;
+const uint64_t prime64_2 = 0xc2b2ae3d27d4eb4full;
+const uint64_t prime64_3 = 0x165667b19e3779f9ull;
+const uint64_t prime64_4 = 0x85ebca77c2b2ae63ull;
+const uint64_t prime64_5 = 0x27d4eb2f165667c5ull;
+
+uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+uint32_t rotr32(uint32_t x, int r)
+{
+	return (x >> r) | (x << (32 - r));
+}
+
+uint64_t read64(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+uint32_t read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+uint64_t xxh_round(uint64_t acc, uint64_t input)
+{
+	acc += input * prime64_2;
+	acc = rotl64(acc, 31);
+	return acc * prime64_1;
+}
+
+uint64_t xxh_merge(uint64_t acc, uint64_t value)
+{
+	acc ^= xxh_round(0, value);
+	return acc * prime64_1 + prime64_4;
+}
+
+const uint32_t sha256_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+} // namespace
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t size)
+{
+	static const crc_kernel kernel = pick_crc_kernel();
+	return ~kernel(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+xxh64::xxh64(uint64_t seed) : seed_(seed)
+{
+	acc_[0] = seed + prime64_1 + prime64_2;
+	acc_[1] = seed + prime64_2;
+	acc_[2] = seed;
+	acc_[3] = seed - prime64_1;
+}
+
+void xxh64::update(const void* data, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	total_ += size;
+
+	if (buffered_)
+	{
+		const size_t n = std::min(size, sizeof(stripe_) - buffered_);
+		memcpy(stripe_ + buffered_, p, n);
+		buffered_ += n;
+		p += n;
+		size -= n;
+		if (buffered_ < sizeof(stripe_))
+		{
+			return;
+		}
+
+		for (int i = 0; i < 4; ++i)
+		{
+			acc_[i] = xxh_round(acc_[i], read64(stripe_ + 8 * i));
+		}
+
+		buffered_ = 0;
+	}
+
+	for (; size >= 32; p += 32, size -= 32)
+	{
+		acc_[0] = xxh_round(acc_[0], read64(p));
+		acc_[1] = xxh_round(acc_[1], read64(p + 8));
+		acc_[2] = xxh_round(acc_[2], read64(p + 16));
+		acc_[3] = xxh_round(acc_[3], read64(p + 24));
+	}
+
+	memcpy(stripe_, p, size);
+	buffered_ = size;
+}
+
+uint64_t xxh64::final() const
+{
+	uint64_t h;
+	if (total_ >= 32)
+	{
+		h = rotl64(acc_[0], 1) + rotl64(acc_[1], 7) + rotl64(acc_[2], 12) + rotl64(acc_[3], 18);
+		for (int i = 0; i < 4; ++i)
+		{
+			h = xxh_merge(h, acc_[i]);
+		}
+	}
+	else
+	{
+		h = seed_ + prime64_5;
+	}
+
+	h += total_;
+
+	const uint8_t* p = stripe_;
+	size_t left = buffered_;
+	for (; left >= 8; p += 8, left -= 8)
+	{
+		h ^= xxh_round(0, read64(p));
+		h = rotl64(h, 27) * prime64_1 + prime64_4;
+	}
+
+	if (left >= 4)
+	{
+		h ^= uint64_t(read32(p)) * prime64_1;
+		h = rotl64(h, 23) * prime64_2 + prime64_3;
+		p += 4;
+		left -= 4;
+	}
+
+	for (; left; ++p, --left)
+	{
+		h ^= *p * prime64_5;
+		h = rotl64(h, 11) * prime64_1;
+	}
+
+	h ^= h >> 33;
+	h *= prime64_2;
+	h ^= h >> 29;
+	h *= prime64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+sha256::sha256()
+{
+	static const uint32_t initial[8] =
+	{
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+
+	memcpy(state_, initial, sizeof(state_));
+}
+
+void sha256::compress(const uint8_t* block)
+{
+	uint32_t w[64];
+	for (int i = 0; i < 16; ++i)
+	{
+		w[i] = uint32_t(block[4 * i]) << 24 | uint32_t(block[4 * i + 1]) << 16 | uint32_t(block[4 * i + 2]) << 8 | block[4 * i + 3];
+	}
+
+	for (int i = 16; i < 64; ++i)
+	{
+		const uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		const uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+	uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+	for (int i = 0; i < 64; ++i)
+	{
+		const uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+		const uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + t2;
+	}
+
+	state_[0] += a;
+	state_[1] += b;
+	state_[2] += c;
+	state_[3] += d;
+	state_[4] += e;
+	state_[5] += f;
+	state_[6] += g;
+	state_[7] += h;
+}
+
+void sha256::update(const void* data, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	total_ += size;
+
+	if (buffered_)
+	{
+		const size_t n = std::min(size, sizeof(block_) - buffered_);
+		memcpy(block_ + buffered_, p, n);
+		buffered_ += n;
+		p += n;
+		size -= n;
+		if (buffered_ < sizeof(block_))
+		{
+			return;
+		}
+
+		compress(block_);
+		buffered_ = 0;
+	}
+
+	for (; size >= 64; p += 64, size -= 64)
+	{
+		compress(p);
+	}
+
+	memcpy(block_, p, size);
+	buffered_ = size;
+}
+
+std::array<uint8_t, 32> sha256::final() const
+{
+	// the padding goes to a copy, the digest of a longer content may still be asked for
+	sha256 last = *this;
+	const uint64_t bits = total_ * 8;
+	const uint8_t one = 0x80;
+	const uint8_t zeros[64] = {};
+	last.update(&one, 1);
+	last.update(zeros, (last.buffered_ <= 56 ? 56 : 120) - last.buffered_);
+
+	uint8_t length[8];
+	for (int i = 0; i < 8; ++i)
+	{
+		length[i] = uint8_t(bits >> (56 - 8 * i));
+	}
+
+	last.update(length, sizeof(length));
+
+	std::array<uint8_t, 32> ret;
+	for (int i = 0; i < 8; ++i)
+	{
+		ret[4 * i] = uint8_t(last.state_[i] >> 24);
+		ret[4 * i + 1] = uint8_t(last.state_[i] >> 16);
+		ret[4 * i + 2] = uint8_t(last.state_[i] >> 8);
+		ret[4 * i + 3] = uint8_t(last.state_[i]);
+	}
+
+	return ret;
+}
+
+} // namespace digest
+
+void content_digest::update(string_view piece)
+{
+	length_ += piece.size();
+	if (algorithms_ & DIGEST_CRC32C)
+	{
+		crc_ = digest::crc32c(crc_, piece.data(), piece.size());
+	}
+
+	if (algorithms_ & DIGEST_XXH64)
+	{
+		xxh_.update(piece.data(), piece.size());
+	}
+
+	if (algorithms_ & DIGEST_SHA256)
+	{
+		sha_.update(piece.data(), piece.size());
+	}
+}
+
+std::string content_digest::hex(digest_algorithm a) const
+{
+	static const char digits[] = "0123456789abcdef";
+	auto to_hex = [](uint64_t value, size_t size)
+	{
+		std::string ret(size, '0');
+		for (size_t i = size; i--; value >>= 4)
+		{
+			ret[i] = digits[value & 0xf];
+		}
+
+		return ret;
+	};
+
+	if (!(algorithms_ & a))
+	{
+		return std::string();
+	}
+
+	switch (a)
+	{
+	case DIGEST_CRC32C: return to_hex(crc_, 8);
+	case DIGEST_XXH64: return to_hex(xxh_.final(), 16);
+	case DIGEST_SHA256:
+	{
+		std::string ret;
+		for (uint8_t byte : sha_.final())
+		{
+			ret.append(to_hex(byte, 2));
+		}
+
+		return ret;
+	}
+	}
+
+	return std::string();
+}
+
+} // namespace nemok
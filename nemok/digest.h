@@ -0,0 +1,101 @@
+#pragma once
+#include <array>
+#include "server.h"
+
+/*
+	mock.when(nemok::http::PUT("/blobs/1")
+		.with_content_length(4ull << 30)
+		.with_content_digest(nemok::DIGEST_XXH64, "5f6b0e2c4a1d3b79"))
+		.reply(201);
+
+	once an expectation looks at the content by its digest, the content of the
+	requests over http_stream_threshold bytes, or chunked, isn't kept: it's
+	hashed as it arrives and dropped, the mock needs the same memory whatever
+	the size of the upload; the rest of the requests are hashed when matched
+*/
+
+namespace nemok
+{
+
+enum digest_algorithm
+{
+	DIGEST_CRC32C = 0x1,
+	DIGEST_XXH64 = 0x2,
+	DIGEST_SHA256 = 0x4
+};
+
+namespace digest
+{
+
+// continues the crc of the bytes before, 0 to start with; the crc32 instruction
+// of sse4.2 is used when the cpu has it
+uint32_t crc32c(uint32_t crc, const void* data, size_t size);
+
+class xxh64
+{
+public:
+	explicit xxh64(uint64_t seed = 0);
+
+	void update(const void* data, size_t size);
+	uint64_t final() const;
+
+private:
+	uint64_t acc_[4];
+	uint64_t seed_;
+	uint64_t total_ = 0;
+
+	// the bytes short of a whole stripe
+	uint8_t stripe_[32];
+	size_t buffered_ = 0;
+};
+
+class sha256
+{
+public:
+	sha256();
+
+	void update(const void* data, size_t size);
+	std::array<uint8_t, 32> final() const;
+
+private:
+	void compress(const uint8_t* block);
+
+	uint32_t state_[8];
+	uint64_t total_ = 0;
+	uint8_t block_[64];
+	size_t buffered_ = 0;
+};
+
+} // namespace digest
+
+// the length of a content and its digests, as the pieces of it go by
+class content_digest
+{
+public:
+	explicit content_digest(unsigned algorithms = 0) : algorithms_(algorithms) {}
+
+	void update(string_view piece);
+
+	uint64_t length() const
+	{
+		return length_;
+	}
+
+	unsigned algorithms() const
+	{
+		return algorithms_;
+	}
+
+	// lowercase hex, the way the tools print it: 8 digits of crc32c, 16 of xxh64
+	// and 64 of sha256; empty if the algorithm hasn't been asked for
+	std::string hex(digest_algorithm a) const;
+
+private:
+	unsigned algorithms_;
+	uint64_t length_ = 0;
+	uint32_t crc_ = 0;
+	digest::xxh64 xxh_;
+	digest::sha256 sha_;
+};
+
+} // namespace nemok
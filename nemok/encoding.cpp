@@ -0,0 +1,206 @@
+#include <zlib.h>
+
+#include "encoding.h"
+#include "headers.h"
+
+namespace nemok
+{
+
+namespace encoding
+{
+
+namespace
+{
+
+// the window bits zlib takes for the format
+int window_bits(content_coding c)
+{
+	return c == CODING_GZIP ? 15 + 16 : 15;
+}
+
+// the q of a coding, 1 if there's none; -1 if it can't be read
+double parse_q(string_view params)
+{
+	while (!params.empty())
+	{
+		const size_t semicolon = params.find(';');
+		const string_view param = trim(params.substr(0, semicolon));
+		if (param.size() > 2 && (param[0] == 'q' || param[0] == 'Q') && param[1] == '=')
+		{
+			double q = 0;
+			double scale = 1;
+			bool fraction = false;
+			for (char ch : param.substr(2))
+			{
+				if (ch == '.' && !fraction)
+				{
+					fraction = true;
+				}
+				else if (ch >= '0' && ch <= '9')
+				{
+					if (fraction)
+					{
+						scale /= 10;
+						q += (ch - '0') * scale;
+					}
+					else
+					{
+						q = q * 10 + (ch - '0');
+					}
+				}
+				else
+				{
+					return -1;
+				}
+			}
+
+			return q > 1 ? -1 : q;
+		}
+
+		params.remove_prefix(semicolon == string_view::npos ? params.size() : semicolon + 1);
+	}
+
+	return 1;
+}
+
+} // namespace
+
+const char* name(content_coding c)
+{
+	switch (c)
+	{
+	case CODING_GZIP: return "gzip";
+	case CODING_DEFLATE: return "deflate";
+	default: return "";
+	}
+}
+
+std::string compress(content_coding c, string_view data)
+{
+	if (c == CODING_IDENTITY)
+	{
+		return data.to_string();
+	}
+
+	z_stream z = {};
+	if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, window_bits(c), 9, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		throw encoding_error("can't start compressing");
+	}
+
+	std::string ret(deflateBound(&z, data.size()), '\0');
+	z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	z.avail_in = data.size();
+	z.next_out = reinterpret_cast<Bytef*>(&ret[0]);
+	z.avail_out = ret.size();
+
+	const int result = deflate(&z, Z_FINISH);
+	ret.resize(z.total_out);
+	deflateEnd(&z);
+	if (result != Z_STREAM_END)
+	{
+		throw encoding_error("can't compress");
+	}
+
+	return ret;
+}
+
+std::string decompress(content_coding c, string_view data)
+{
+	if (c == CODING_IDENTITY)
+	{
+		return data.to_string();
+	}
+
+	z_stream z = {};
+	if (inflateInit2(&z, window_bits(c)) != Z_OK)
+	{
+		throw encoding_error("can't start decompressing");
+	}
+
+	std::string ret;
+	char buffer[16384];
+	z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+	z.avail_in = data.size();
+
+	int result = Z_OK;
+	while (result == Z_OK)
+	{
+		z.next_out = reinterpret_cast<Bytef*>(buffer);
+		z.avail_out = sizeof(buffer);
+		result = inflate(&z, Z_NO_FLUSH);
+		ret.append(buffer, sizeof(buffer) - z.avail_out);
+	}
+
+	inflateEnd(&z);
+	if (result != Z_STREAM_END)
+	{
+		throw encoding_error("can't decompress");
+	}
+
+	return ret;
+}
+
+content_coding negotiate(string_view accept_encoding)
+{
+	// gzip, deflate and identity, the q given to them and to anything else
+	double q[3] = {-1, -1, -1};
+	double any = -1;
+	while (!accept_encoding.empty())
+	{
+		const size_t comma = accept_encoding.find(',');
+		const string_view item = accept_encoding.substr(0, comma);
+		accept_encoding.remove_prefix(comma == string_view::npos ? accept_encoding.size() : comma + 1);
+
+		const size_t semicolon = item.find(';');
+		const string_view coding = trim(item.substr(0, semicolon));
+		const double value = parse_q(semicolon == string_view::npos ? string_view() : item.substr(semicolon + 1));
+		if (value < 0)
+		{
+			continue;
+		}
+
+		if (iequals(coding, "gzip") || iequals(coding, "x-gzip"))
+		{
+			q[0] = value;
+		}
+		else if (iequals(coding, "deflate"))
+		{
+			q[1] = value;
+		}
+		else if (iequals(coding, "identity"))
+		{
+			q[2] = value;
+		}
+		else if (coding == "*")
+		{
+			any = value;
+		}
+	}
+
+	// what's not listed goes by the wildcard; identity is fine unless ruled out,
+	// but anything the client has asked for is preferred to it
+	for (int i = 0; i < 3; ++i)
+	{
+		if (q[i] < 0)
+		{
+			q[i] = any >= 0 ? any : i == 2 ? 0.0001 : 0;
+		}
+	}
+
+	const content_coding codings[3] = {CODING_GZIP, CODING_DEFLATE, CODING_IDENTITY};
+	int best = 2;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (q[i] > 0 && (q[i] > q[best] || (q[i] == q[best] && i < best)))
+		{
+			best = i;
+		}
+	}
+
+	return codings[best];
+}
+
+} // namespace encoding
+
+} // namespace nemok
@@ -0,0 +1,45 @@
+#pragma once
+#include "server.h"
+
+/*
+	mock.when(nemok::http::GET("/app.js")).reply(nemok::http::response(200).content(script).precompress());
+
+	the content is compressed with gzip and deflate once, when the expectation is
+	set up; every request gets the variant its Accept-Encoding prefers, along
+	with Content-Encoding and Vary
+*/
+
+namespace nemok
+{
+
+enum content_coding
+{
+	CODING_IDENTITY,
+	CODING_GZIP,
+	CODING_DEFLATE
+};
+
+class encoding_error : public exception
+{
+public:
+	explicit encoding_error(const char* message) : exception(message) {}
+};
+
+namespace encoding
+{
+
+// the name it goes by in Content-Encoding, empty for identity
+const char* name(content_coding c);
+
+// deflate is the zlib format, the way http means it
+std::string compress(content_coding c, string_view data);
+std::string decompress(content_coding c, string_view data);
+
+// the coding with the highest q of those listed, gzip preferred over deflate
+// and deflate over identity when they're equal; identity if nothing else is
+// acceptable, even when it's been ruled out
+content_coding negotiate(string_view accept_encoding);
+
+} // namespace encoding
+
+} // namespace nemok
@@ -0,0 +1,150 @@
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "fanout.h"
+
+namespace nemok
+{
+
+outbox::status outbox::flush(int fd)
+{
+	while (!pending_.empty())
+	{
+		iovec iov[64];
+		size_t count = 0;
+		for (auto it = pending_.begin(); it != pending_.end() && count < 64; ++it, ++count)
+		{
+			const size_t offset = count == 0 ? offset_ : 0;
+			iov[count].iov_base = const_cast<char*>((*it)->data() + offset);
+			iov[count].iov_len = (*it)->size() - offset;
+		}
+
+		msghdr message = {};
+		message.msg_iov = iov;
+		message.msg_iovlen = count;
+		const ssize_t bytes = ::sendmsg(fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (bytes == -1 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (bytes == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			return blocked;
+		}
+
+		if (bytes == -1)
+		{
+			return failed;
+		}
+
+		offset_ += bytes;
+		while (!pending_.empty() && offset_ >= pending_.front()->size())
+		{
+			offset_ -= pending_.front()->size();
+			pending_.pop_front();
+		}
+	}
+
+	return sent;
+}
+
+poller::~poller()
+{
+	stop();
+}
+
+bool poller::watch(int fd, uint32_t events)
+{
+	if (epoll_ == -1)
+	{
+		epoll_ = epoll_create1(EPOLL_CLOEXEC);
+		wake_ = eventfd(0, EFD_CLOEXEC);
+		epoll_event e = {};
+		e.events = EPOLLIN;
+		e.data.fd = wake_;
+		if (epoll_ == -1 || wake_ == -1 || epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_, &e) == -1)
+		{
+			stop();
+			return false;
+		}
+
+		thread_ = std::thread([this]{run();});
+	}
+
+	epoll_event e = {};
+	e.events = events;
+	e.data.fd = fd;
+	if (epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &e) == -1)
+	{
+		return errno == ENOENT && epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &e) != -1;
+	}
+
+	return true;
+}
+
+void poller::forget(int fd)
+{
+	if (epoll_ != -1)
+	{
+		epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+	}
+}
+
+void poller::stop()
+{
+	if (thread_.joinable())
+	{
+		const uint64_t one = 1;
+		while (::write(wake_, &one, sizeof(one)) == -1 && errno == EINTR)
+		{
+		}
+
+		thread_.join();
+	}
+
+	if (epoll_ != -1)
+	{
+		::close(epoll_);
+		epoll_ = -1;
+	}
+
+	if (wake_ != -1)
+	{
+		::close(wake_);
+		wake_ = -1;
+	}
+}
+
+void poller::run()
+{
+	epoll_event events[256];
+	while (true)
+	{
+		const int count = epoll_wait(epoll_, events, 256, -1);
+		if (count == -1 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (count == -1)
+		{
+			return;
+		}
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (events[i].data.fd == wake_)
+			{
+				return;
+			}
+		}
+
+		handler_(events, count);
+	}
+}
+
+} // namespace nemok
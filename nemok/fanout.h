@@ -0,0 +1,86 @@
+#pragma once
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <sys/epoll.h>
+
+/*
+	what the event and the websocket hubs have in common: the same buffer is
+	written to any number of sockets, none of which is waited for; what a socket
+	can't take yet stays in its outbox and the poller tells when it has room
+*/
+
+namespace nemok
+{
+
+// what's still to be written to a socket, as references to buffers which may
+// be shared with any number of other sockets
+class outbox
+{
+public:
+	enum status
+	{
+		sent,
+		blocked,
+		failed
+	};
+
+	void push(std::shared_ptr<const std::string> data)
+	{
+		pending_.push_back(std::move(data));
+	}
+
+	size_t size() const
+	{
+		return pending_.size();
+	}
+
+	void clear()
+	{
+		pending_.clear();
+		offset_ = 0;
+	}
+
+	// as much as the socket takes without blocking, in a single call if it can
+	status flush(int fd);
+
+private:
+	std::deque<std::shared_ptr<const std::string>> pending_;
+
+	// how much of the first one has been written
+	size_t offset_ = 0;
+};
+
+// sockets watched by a thread of its own, started along with the first of them;
+// the handler gets the events the way epoll reports them, on that thread
+class poller
+{
+public:
+	using handler_type = std::function<void(const epoll_event* events, int count)>;
+
+	explicit poller(handler_type handler) : handler_(std::move(handler)) {}
+	~poller();
+
+	poller(const poller&) = delete;
+	poller& operator =(const poller&) = delete;
+
+	// adds the socket or changes what it's watched for, false if it can't be;
+	// called by one thread at a time
+	bool watch(int fd, uint32_t events);
+	void forget(int fd);
+
+	// no handler is called once it's returned
+	void stop();
+
+private:
+	void run();
+
+	handler_type handler_;
+	int epoll_ = -1;
+	int wake_ = -1;
+	std::thread thread_;
+};
+
+} // namespace nemok
@@ -0,0 +1,327 @@
+#pragma once
+#include <array>
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include "server.h"
+#include "scan.h"
+
+namespace nemok
+{
+
+inline string_view trim(string_view s)
+{
+	while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+	{
+		s.remove_prefix(1);
+	}
+
+	while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+	{
+		s.remove_suffix(1);
+	}
+
+	return s;
+}
+
+inline bool iequals(string_view a, string_view b)
+{
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+	{
+		return ::tolower(static_cast<unsigned char>(x)) == ::tolower(static_cast<unsigned char>(y));
+	});
+}
+
+// whether the comma separated list, e.g. "keep-alive, Upgrade", has the token
+inline bool has_token(string_view list, string_view token)
+{
+	while (!list.empty())
+	{
+		const size_t comma = list.find(',');
+		if (iequals(trim(list.substr(0, comma)), token))
+		{
+			return true;
+		}
+
+		list.remove_prefix(comma == string_view::npos ? list.size() : comma + 1);
+	}
+
+	return false;
+}
+
+// decimal digits only, no sign, no blanks, no overflow
+inline bool parse_number(string_view s, size_t& value)
+{
+	if (s.empty())
+	{
+		return false;
+	}
+
+	size_t result = 0;
+	for (char ch : s)
+	{
+		if (ch < '0' || ch > '9')
+		{
+			return false;
+		}
+
+		const size_t digit = ch - '0';
+		if (result > (std::numeric_limits<size_t>::max() - digit) / 10)
+		{
+			return false;
+		}
+
+		result = result * 10 + digit;
+	}
+
+	value = result;
+	return true;
+}
+
+// the first N elements are kept in place, the heap is only used once there are more;
+// the elements are contiguous either way
+template <typename T, size_t N>
+class small_vector
+{
+public:
+	small_vector() = default;
+
+	small_vector(const small_vector& rhs)
+	{
+		*this = rhs;
+	}
+
+	small_vector& operator =(const small_vector& rhs)
+	{
+		if (this != &rhs)
+		{
+			clear();
+			for (auto& v : rhs)
+			{
+				push_back(v);
+			}
+		}
+
+		return *this;
+	}
+
+	void push_back(T value)
+	{
+		if (size_ == N && heap_.empty())
+		{
+			heap_.reserve(N * 2);
+			std::move(inline_.begin(), inline_.end(), std::back_inserter(heap_));
+		}
+
+		if (heap_.empty())
+		{
+			inline_[size_] = std::move(value);
+		}
+		else
+		{
+			heap_.push_back(std::move(value));
+		}
+
+		++size_;
+	}
+
+	// the heap capacity, if any, is kept for the next time
+	void clear()
+	{
+		heap_.clear();
+		size_ = 0;
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+	bool empty() const
+	{
+		return size_ == 0;
+	}
+
+	T* begin()
+	{
+		return heap_.empty() ? inline_.data() : heap_.data();
+	}
+
+	const T* begin() const
+	{
+		return heap_.empty() ? inline_.data() : heap_.data();
+	}
+
+	T* end()
+	{
+		return begin() + size_;
+	}
+
+	const T* end() const
+	{
+		return begin() + size_;
+	}
+
+	T& operator [](size_t i)
+	{
+		return begin()[i];
+	}
+
+	const T& operator [](size_t i) const
+	{
+		return begin()[i];
+	}
+
+private:
+	std::array<T, N> inline_;
+	std::vector<T> heap_;
+	size_t size_ = 0;
+};
+
+// ascii case-insensitive, the few non-letters folded together are told apart by iequals
+inline uint32_t header_hash(string_view name)
+{
+	uint32_t h = 2166136261u;
+	for (char ch : name)
+	{
+		h = (h ^ (uint8_t(ch) | 0x20)) * 16777619u;
+	}
+
+	return h;
+}
+
+// header fields in the order they've been added; the names are looked up ignoring
+// the case, the hash of every name is kept so that a lookup mostly compares integers;
+// Text is string_view for the parsed messages and std::string for the ones we build
+template <typename Text, size_t N>
+class basic_headers
+{
+public:
+	using value_type = std::pair<Text, Text>;
+
+	bool has(string_view name) const
+	{
+		return find(name) != npos;
+	}
+
+	// an empty view if there is no such header
+	string_view get(string_view name) const
+	{
+		const size_t i = find(name);
+		return i == npos ? string_view() : string_view(pairs_[i].second);
+	}
+
+	bool get(string_view name, string_view& value) const
+	{
+		const size_t i = find(name);
+		if (i == npos)
+		{
+			return false;
+		}
+
+		value = pairs_[i].second;
+		return true;
+	}
+
+	bool get_number(string_view name, size_t& value) const
+	{
+		const size_t i = find(name);
+		return i != npos && parse_number(pairs_[i].second, value);
+	}
+
+	void add(string_view name, string_view value)
+	{
+		pairs_.push_back(value_type(Text(name.data(), name.size()), Text(value.data(), value.size())));
+		hashes_.push_back(header_hash(name));
+	}
+
+	// the value of the first one with the name, added if there's none
+	void set(string_view name, string_view value)
+	{
+		const size_t i = find(name);
+		if (i == npos)
+		{
+			add(name, value);
+			return;
+		}
+
+		pairs_[i].second = Text(value.data(), value.size());
+	}
+
+	// header lines, each one terminated by CRLF
+	bool parse(string_view input)
+	{
+		clear();
+		while (!input.empty())
+		{
+			const size_t line_end = scan::find_line_end(input);
+			const string_view line = input.substr(0, line_end);
+			const size_t colon = scan::find_first_of(line, ":");
+			if (colon == string_view::npos)
+			{
+				return false;
+			}
+
+			add(trim(line.substr(0, colon)), trim(line.substr(colon + 1)));
+			input.remove_prefix(line_end == string_view::npos ? input.size() : line_end + 2);
+		}
+
+		return true;
+	}
+
+	void clear()
+	{
+		pairs_.clear();
+		hashes_.clear();
+	}
+
+	size_t count() const
+	{
+		return pairs_.size();
+	}
+
+	bool empty() const
+	{
+		return pairs_.empty();
+	}
+
+	const value_type& operator [](size_t i) const
+	{
+		return pairs_[i];
+	}
+
+	const value_type* begin() const
+	{
+		return pairs_.begin();
+	}
+
+	const value_type* end() const
+	{
+		return pairs_.end();
+	}
+
+private:
+	static const size_t npos = std::numeric_limits<size_t>::max();
+
+	size_t find(string_view name) const
+	{
+		const uint32_t hash = header_hash(name);
+		for (size_t i = 0; i < hashes_.size(); ++i)
+		{
+			if (hashes_[i] == hash && iequals(pairs_[i].first, name))
+			{
+				return i;
+			}
+		}
+
+		return npos;
+	}
+
+	small_vector<value_type, N> pairs_;
+	small_vector<uint32_t, N> hashes_;
+};
+
+} // namespace nemok
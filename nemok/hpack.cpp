@@ -0,0 +1,424 @@
+#include <algorithm>
+
+#include "hpack.h"
+
+namespace nemok
+{
+
+namespace hpack
+{
+
+namespace
+{
+
+const field static_table[] =
+{
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""}
+};
+
+const size_t static_table_size = sizeof(static_table) / sizeof(static_table[0]);
+
+// every table entry costs the length of its name and value and this much more
+const size_t entry_overhead = 32;
+
+struct huffman_code
+{
+	uint32_t code;
+	uint8_t bits;
+};
+
+// RFC 7541 appendix B, indexed by symbol, the last one is EOS
+const huffman_code huffman_codes[257] =
+{
+	{0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+	{0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28}, {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+	{0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+	{0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+	{0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+	{0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+	{0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+	{0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+	{0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+	{0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+	{0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+	{0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+	{0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+	{0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+	{0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+	{0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+	{0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+	{0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+	{0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+	{0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+	{0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+	{0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+	{0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+	{0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+	{0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+	{0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+	{0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+	{0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+	{0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+	{0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+	{0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+	{0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+	{0x3fffffff, 30}
+};
+
+const int huffman_max_bits = 30;
+
+// the code is canonical, so the codes of the same length are consecutive and
+// a code is told apart by where it falls within the range of its length
+struct huffman_tables
+{
+	uint16_t symbols[257];
+	uint32_t first_code[huffman_max_bits + 1];
+	uint16_t first_index[huffman_max_bits + 1];
+	uint16_t count[huffman_max_bits + 1];
+};
+
+huffman_tables make_huffman_tables()
+{
+	huffman_tables t = {};
+	for (uint16_t i = 0; i < 257; ++i)
+	{
+		t.symbols[i] = i;
+	}
+
+	std::sort(std::begin(t.symbols), std::end(t.symbols), [](uint16_t a, uint16_t b)
+	{
+		return huffman_codes[a].bits != huffman_codes[b].bits ? huffman_codes[a].bits < huffman_codes[b].bits : a < b;
+	});
+
+	for (uint16_t i = 0; i < 257; ++i)
+	{
+		const huffman_code& c = huffman_codes[t.symbols[i]];
+		if (t.count[c.bits]++ == 0)
+		{
+			t.first_code[c.bits] = c.code;
+			t.first_index[c.bits] = i;
+		}
+	}
+
+	return t;
+}
+
+const huffman_tables& huffman()
+{
+	static const huffman_tables tables = make_huffman_tables();
+	return tables;
+}
+
+bool decode_string(string_view& input, std::string& output)
+{
+	if (input.empty())
+	{
+		return false;
+	}
+
+	const bool huffman_coded = input[0] & 0x80;
+	size_t len = 0;
+	if (!decode_integer(input, 7, len) || len > input.size())
+	{
+		return false;
+	}
+
+	const string_view str = input.substr(0, len);
+	input.remove_prefix(len);
+
+	output.clear();
+	if (huffman_coded)
+	{
+		return huffman_decode(str, output);
+	}
+
+	output.assign(str.data(), str.size());
+	return true;
+}
+
+void encode_string(const std::string& str, std::string& output)
+{
+	encode_integer(str.size(), 7, 0, output);
+	output.append(str);
+}
+
+} // namespace
+
+bool decode_integer(string_view& input, int prefix_bits, size_t& value)
+{
+	if (input.empty())
+	{
+		return false;
+	}
+
+	const size_t mask = (1u << prefix_bits) - 1;
+	size_t result = static_cast<uint8_t>(input[0]) & mask;
+	input.remove_prefix(1);
+
+	if (result == mask)
+	{
+		int shift = 0;
+		uint8_t byte = 0;
+		do
+		{
+			if (input.empty() || shift > 56)
+			{
+				return false;
+			}
+
+			byte = input[0];
+			input.remove_prefix(1);
+			result += static_cast<size_t>(byte & 0x7f) << shift;
+			shift += 7;
+		}
+		while (byte & 0x80);
+	}
+
+	value = result;
+	return true;
+}
+
+void encode_integer(size_t value, int prefix_bits, uint8_t first_byte, std::string& output)
+{
+	const size_t mask = (1u << prefix_bits) - 1;
+	if (value < mask)
+	{
+		output.append(1, static_cast<char>(first_byte | value));
+		return;
+	}
+
+	output.append(1, static_cast<char>(first_byte | mask));
+	value -= mask;
+	while (value >= 0x80)
+	{
+		output.append(1, static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+
+	output.append(1, static_cast<char>(value));
+}
+
+bool huffman_decode(string_view input, std::string& output)
+{
+	const huffman_tables& t = huffman();
+	uint32_t code = 0;
+	int bits = 0;
+	for (char ch : input)
+	{
+		const uint8_t byte = ch;
+		for (int i = 7; i >= 0; --i)
+		{
+			code = (code << 1) | ((byte >> i) & 1);
+			if (++bits > huffman_max_bits)
+			{
+				return false;
+			}
+
+			const uint32_t offset = code - t.first_code[bits];
+			if (t.count[bits] && code >= t.first_code[bits] && offset < t.count[bits])
+			{
+				const uint16_t symbol = t.symbols[t.first_index[bits] + offset];
+				if (symbol == 256)
+				{
+					return false;
+				}
+
+				output.append(1, static_cast<char>(symbol));
+				code = 0;
+				bits = 0;
+			}
+		}
+	}
+
+	// the padding is the most significant bits of EOS, i.e. ones, and shorter than a byte
+	return bits < 8 && code == (1u << bits) - 1;
+}
+
+bool decoder::decode(string_view block, header_list& headers)
+{
+	bool fields_seen = false;
+	while (!block.empty())
+	{
+		const uint8_t first = block[0];
+		if (first & 0x80)
+		{
+			// indexed field
+			size_t index = 0;
+			field f;
+			if (!decode_integer(block, 7, index) || !lookup(index, f))
+			{
+				return false;
+			}
+
+			headers.push_back(std::move(f));
+		}
+		else if ((first & 0xe0) == 0x20)
+		{
+			// dynamic table size update, only allowed before the fields
+			size_t size = 0;
+			if (fields_seen || !decode_integer(block, 5, size) || size > max_size_)
+			{
+				return false;
+			}
+
+			limit_ = size;
+			evict(limit_);
+			continue;
+		}
+		else
+		{
+			// a literal one, either put into the table or not
+			const bool indexing = (first & 0xc0) == 0x40;
+			size_t index = 0;
+			field f;
+			if (!decode_integer(block, indexing ? 6 : 4, index))
+			{
+				return false;
+			}
+
+			if (index ? !lookup(index, f) : !decode_string(block, f.first))
+			{
+				return false;
+			}
+
+			if (!decode_string(block, f.second))
+			{
+				return false;
+			}
+
+			if (indexing)
+			{
+				insert(f);
+			}
+
+			headers.push_back(std::move(f));
+		}
+
+		fields_seen = true;
+	}
+
+	return true;
+}
+
+bool decoder::lookup(size_t index, field& f) const
+{
+	if (index == 0)
+	{
+		return false;
+	}
+
+	if (index <= static_table_size)
+	{
+		f = static_table[index - 1];
+		return true;
+	}
+
+	index -= static_table_size + 1;
+	if (index >= table_.size())
+	{
+		return false;
+	}
+
+	f = table_[index];
+	return true;
+}
+
+void decoder::insert(field f)
+{
+	const size_t size = f.first.size() + f.second.size() + entry_overhead;
+	if (size > limit_)
+	{
+		// too big to fit in, the table is emptied
+		evict(0);
+		return;
+	}
+
+	evict(limit_ - size);
+	size_ += size;
+	table_.push_front(std::move(f));
+}
+
+void decoder::evict(size_t limit)
+{
+	while (size_ > limit)
+	{
+		const field& oldest = table_.back();
+		size_ -= oldest.first.size() + oldest.second.size() + entry_overhead;
+		table_.pop_back();
+	}
+}
+
+void encode(const header_list& headers, std::string& block)
+{
+	for (auto& h : headers)
+	{
+		// literal without indexing, new name
+		block.append(1, '\0');
+		encode_string(h.first, block);
+		encode_string(h.second, block);
+	}
+}
+
+} // namespace hpack
+
+} // namespace nemok
@@ -0,0 +1,48 @@
+#pragma once
+#include <deque>
+#include "server.h"
+
+namespace nemok
+{
+
+// header compression for http/2, see RFC 7541
+namespace hpack
+{
+
+using field = std::pair<std::string, std::string>;
+using header_list = std::vector<field>;
+
+// keeps the dynamic table of a connection, header blocks are to be decoded
+// in the order they arrive
+class decoder
+{
+public:
+	explicit decoder(size_t max_table_size = 4096) : max_size_(max_table_size), limit_(max_table_size) {}
+
+	// appends the fields of a complete header block, false if it's malformed
+	bool decode(string_view block, header_list& headers);
+
+private:
+	bool lookup(size_t index, field& f) const;
+	void insert(field f);
+	void evict(size_t limit);
+
+	std::deque<field> table_;
+	size_t size_ = 0;
+
+	// the size the peer is allowed to go up to, the size it has chosen
+	size_t max_size_;
+	size_t limit_;
+};
+
+// the fields go as literals never put into the table and never huffman coded,
+// which any decoder accepts
+void encode(const header_list& headers, std::string& block);
+
+bool decode_integer(string_view& input, int prefix_bits, size_t& value);
+void encode_integer(size_t value, int prefix_bits, uint8_t first_byte, std::string& output);
+bool huffman_decode(string_view input, std::string& output);
+
+} // namespace hpack
+
+} // namespace nemok
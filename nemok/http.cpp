@@ -1,126 +1,482 @@
+#include <ctime>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+
 #include "http.h"
+#include "wire.h"
+#include "scan.h"
+#include "websocket.h"
+#include "corpus.h"
+#include "json.h"
+#include "encoding.h"
+#include "sse.h"
 
 namespace nemok
 {
-template <typename T, typename U>
-T lexical_cast(U u)
+// what the actions may need to know about a request, they run once
+// the request itself has been consumed
+struct request_summary
 {
-	std::stringstream ss;
-	ss << u;
+	http_method method = HTTP_BAD_METHOD;
+	std::string uri;
+	std::string range;
+	std::string if_none_match;
+	std::string if_modified_since;
+	std::string accept_encoding;
+	std::string websocket_key;
+	bool keep_alive = true;
+
+	void assign(const wire::request& r)
+	{
+		auto copy = [&](std::string& to, string_view from){to.assign(from.data(), from.size());};
+
+		method = r.method();
+		copy(uri, r.uri());
+		copy(range, r.headers().get("Range"));
+		copy(if_none_match, r.headers().get("If-None-Match"));
+		copy(if_modified_since, r.headers().get("If-Modified-Since"));
+		copy(accept_encoding, r.headers().get("Accept-Encoding"));
+		websocket_key.clear();
+		if (has_token(r.headers().get("Upgrade"), "websocket"))
+		{
+			copy(websocket_key, r.headers().get("Sec-WebSocket-Key"));
+		}
 
-	T t;
-	ss >> t;
-	return std::move(t);
-}
+		keep_alive = r.keep_alive();
+	}
+};
 
-class tokenizer
+// the request at the front of the input, fed to the parser as it arrives; between
+// the reads the input only grows, while the expectations are being walked it only
+// shrinks, so a shorter input means the request has been consumed; once
+// the connection is upgraded it carries websocket frames instead
+class parsed_request
 {
 public:
-	void tokenize(const char* str, size_t len)
+	const wire::request* get(const buffer_type& input)
+	{
+		if (input.size() < size_)
+		{
+			closing_ = closing_ || (parsed_ && !summary_.keep_alive);
+			request_.reset();
+			parsed_ = false;
+		}
+
+		// whatever follows the request asking to close the connection is ignored
+		if (closing_ || websocket_)
+		{
+			size_ = input.size();
+			return nullptr;
+		}
+
+		if (input.data() != data_ || input.size() != size_)
+		{
+			data_ = input.data();
+			size_ = input.size();
+			parsed_ = request_.feed(string_view(reinterpret_cast<const char*>(data_), size_));
+
+			// the request is gone by the time it's known to have been consumed
+			if (parsed_)
+			{
+				summary_.assign(request_);
+			}
+		}
+
+		return parsed_ ? &request_ : nullptr;
+	}
+
+	// once the expectations look at digests, the content of the long requests is
+	// hashed as it arrives and dropped from the input right away
+	void stream(buffer_type& input, unsigned algorithms)
+	{
+		if (!algorithms)
+		{
+			return;
+		}
+
+		request_.stream_content_over(http_stream_threshold, algorithms);
+		get(input);
+
+		size_t pos = 0;
+		if (const size_t count = request_.drop_streamed(pos))
+		{
+			input.erase(input.begin() + pos, input.begin() + pos + count);
+			size_ = input.size();
+		}
+	}
+
+	bool closing() const
 	{
-		str_ = str;
-		len_ = len;
-		cursor_ = str;
+		return closing_;
 	}
 
-	std::pair<const char*, size_t> next()
+	// the request parsed last, the one matched while the actions run
+	const request_summary& summary() const
 	{
-		skip_blanks();	
+		return summary_;
+	}
 
-		if (!finished())
+	// answers the handshake of the request just matched, a request which is
+	// not a websocket one gets 400
+	void accept_websocket(client& cl, std::shared_ptr<websocket_hub> hub)
+	{
+		if (summary_.websocket_key.empty() || websocket_)
 		{
-			const char* token = cursor_;
-			skip_token();
-			const char* token_end = finished() ? end() : cursor_;
-			return std::make_pair(token, token_end - token);
-			
+			prepared_response(http_response(400)).send(cl);
+			return;
 		}
 
-		return std::make_pair<const char*, size_t>(nullptr, 0);
+		// the session is in the hub by the time the client learns about it,
+		// and whatever's broadcast goes after the handshake
+		websocket_.reset(new websocket_session(cl, std::move(hub), http_response(101)
+			.header("Upgrade", "websocket")
+			.header("Connection", "Upgrade")
+			.header("Sec-WebSocket-Accept", websocket::accept_key(summary_.websocket_key))
+			.str()));
+	}
+
+	websocket_session* websocket() const
+	{
+		return websocket_.get();
 	}
 
-	bool finished()
+private:
+	wire::request request_;
+	const uint8_t* data_ = nullptr;
+	size_t size_ = 0;
+	bool parsed_ = false;
+	request_summary summary_;
+	bool closing_ = false;
+	std::unique_ptr<websocket_session> websocket_;
+};
+
+namespace
+{
+
+// every connection is served by a thread of its own, the predicates are called
+// on that very thread while http::match is walking the expectations
+thread_local parsed_request* current_request = nullptr;
+
+class request_scope
+{
+public:
+	explicit request_scope(parsed_request& r) : prev_(current_request)
 	{
-		return cursor_ >= str_ + len_;
+		current_request = &r;
 	}
 
-	void split_on(std::string blanks)
+	~request_scope()
 	{
-		blanks_ = std::move(blanks);
+		current_request = prev_;
+	}
+
+private:
+	parsed_request* prev_;
+};
+
+} // namespace
+
+class matches_request
+{
+public:
+	explicit matches_request(http::request request): request_(std::move(request)) {}
+
+	bool operator ()(buffer_type& input)
+	{
+		parsed_request local;
+		const wire::request* parsed = (current_request ? *current_request : local).get(input);
+		if (parsed && request_.match(*parsed))
+		{
+			input.erase(input.begin(), input.begin() + parsed->size());
+			return true;
+		}
+
+		return false;
 	}
 
 private:
+	http::request request_;
+};
+
+bool http_request::match(const wire::request& rhs) const
+{
+	if (method_ && *method_ != rhs.method())
+	{
+		return false;
+	}
+
+	if (ver_ && *ver_ != rhs.version())
+	{
+		return false;
+	}
+
+	if (uri_ && !(uri_pattern_ ? match_route(*uri_, rhs.uri()) : rhs.uri() == *uri_))
+	{
+		return false;
+	}
+
+	if (content_ && rhs.content() != *content_)
+	{
+		return false;
+	}
+
+	if (content_length_ || !digests_.empty())
+	{
+		// the content streamed by the mock is known by its digest only
+		if (const content_digest* streamed = rhs.streamed())
+		{
+			if (!match_digest(*streamed))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			content_digest d(content_digests());
+			for (auto piece : rhs.content())
+			{
+				d.update(piece);
+			}
+
+			if (!match_digest(d))
+			{
+				return false;
+			}
+		}
+	}
+
+	if (!json_.empty())
+	{
+		// a chunked body is the only one to come in pieces and be joined
+		const wire::pieces& body = rhs.content();
+		const std::string joined = body.count() > 1 ? body.str() : std::string();
+		const string_view content = body.count() > 1 ? string_view(joined) : body.count() ? body[0] : string_view();
+		if (!match_json_content(content))
+		{
+			return false;
+		}
+	}
 
-	void skip_blanks()
+	for (auto& h : headers_)
 	{
-		for (;!finished() && blank_under_cursor(); ++cursor_);
+		string_view value;
+		if (!rhs.headers().get(h.first, value) || value != h.second)
+		{
+			return false;
+		}
 	}
 
-	void skip_token()
+	return true;
+}
+
+bool http_request::match_json_content(string_view content) const
+{
+	for (auto& j : json_)
+	{
+		string_view value;
+		if (!json::select(content, j.first, value) || !json::equals(value, j.second))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool http_request::match_digest_content(string_view content) const
+{
+	if (!content_length_ && digests_.empty())
+	{
+		return true;
+	}
+
+	content_digest d(content_digests());
+	d.update(content);
+	return match_digest(d);
+}
+
+bool http_request::match_digest(const content_digest& d) const
+{
+	if (content_length_ && *content_length_ != d.length())
 	{
-		for (;!finished() && !blank_under_cursor(); ++cursor_);
+		return false;
 	}
 
-	bool blank_under_cursor()
+	for (auto& expected : digests_)
 	{
-		const char ch = *cursor_;
-		return std::string::npos != blanks_.find(ch);
+		if (d.hex(expected.first) != expected.second)
+		{
+			return false;
+		}
 	}
 
-	const char* end()
+	return true;
+}
+
+namespace
+{
+
+string_view method_name(http_method m)
+{
+	static const string_view names[] = {"", "GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT", "PATCH"};
+	return m < sizeof(names) / sizeof(names[0]) ? names[m] : names[0];
+}
+
+string_view version_name(http_version v)
+{
+	return v == HTTP_10 ? "HTTP/1.0" : "HTTP/1.1";
+}
+
+// only counts the bytes
+struct size_sink
+{
+	size_t size = 0;
+
+	void append(string_view s)
 	{
-		return str_ + len_;
+		size += s.size();
 	}
+};
+
+// the caller has made sure the bytes fit
+struct buffer_sink
+{
+	char* pos;
 
-	const char* cursor_ = nullptr;
-	const char* str_ = nullptr;
-	size_t len_ = 0;
-	std::string blanks_ = " \t\r\n";
+	void append(string_view s)
+	{
+		memcpy(pos, s.data(), s.size());
+		pos += s.size();
+	}
 };
 
-std::vector<std::string> tokenize(const char* str, size_t len)
+} // namespace
+
+template <typename Sink>
+void http_request::serialize_to(Sink& out) const
 {
-	std::vector<std::string> ret;
-	tokenizer tok;
-	tok.tokenize(str, len);
+	out.append(method_name(method_ ? *method_ : HTTP_GET));
+	out.append(" ");
+	out.append(uri_ ? string_view(*uri_) : string_view("/"));
+	out.append(" ");
+	out.append(version_name(ver_ ? *ver_ : HTTP_11));
+	out.append("\r\n");
+
+	for (auto& h : headers_)
+	{
+		out.append(h.first);
+		out.append(": ");
+		out.append(h.second);
+		out.append("\r\n");
+	}
 
-	do
+	const size_t content_size = content_ ? content_->size() : 0;
+	const http_method m = method_ ? *method_ : HTTP_GET;
+	const bool expects_content = m == HTTP_POST || m == HTTP_PUT || m == HTTP_PATCH;
+	if ((content_size || expects_content) && !headers_.has("Content-Length") && !headers_.has("Transfer-Encoding"))
 	{
-		auto token = tok.next();
-		if (token.first)
+		// the digits are made from the end of the buffer
+		char digits[20];
+		char* begin = digits + sizeof(digits);
+		size_t n = content_size;
+		do
 		{
-			ret.push_back(std::string(token.first, token.second));
+			*--begin = char('0' + n % 10);
+			n /= 10;
 		}
+		while (n);
+
+		out.append("Content-Length: ");
+		out.append(string_view(begin, digits + sizeof(digits) - begin));
+		out.append("\r\n");
 	}
-	while (!tok.finished());
 
-	return std::move(ret);
+	out.append("\r\n");
+	if (content_size)
+	{
+		out.append(*content_);
+	}
 }
 
-std::vector<std::string> tokenize(const std::string& str)
+size_t http_request::serialized_size() const
 {
-	return tokenize(str.c_str(), str.size());
+	size_sink counter;
+	serialize_to(counter);
+	return counter.size;
 }
 
-std::pair<std::string, std::string> split_pair(const std::string& input, char sep)
+void http_request::serialize(std::string& out) const
 {
-	auto pos = input.find(sep);
-	if (pos != std::string::npos)
+	out.resize(serialized_size());
+	buffer_sink sink{&out[0]};
+	serialize_to(sink);
+}
+
+size_t http_request::serialize(char* buffer, size_t size) const
+{
+	const size_t needed = serialized_size();
+	if (needed <= size)
 	{
-		return std::make_pair(input.substr(0, pos), input.substr(pos + 1));
+		buffer_sink sink{buffer};
+		serialize_to(sink);
 	}
 
-	return std::make_pair(std::move(input), std::string());
+	return needed;
+}
+
+namespace
+{
+
+// reads up to and including the terminator the scanner looks for; the data is
+// peeked at first, so nothing past the terminator is taken off the socket
+template <typename Find>
+void read_through(client& c, std::string& ret, Find find, size_t terminator_size)
+{
+	const size_t chunk_size = 4096;
+	const size_t start = ret.size();
+	while (true)
+	{
+		const size_t old_size = ret.size();
+		ret.resize(old_size + chunk_size);
+		const ssize_t bytes = c.peek_some(&ret[old_size], chunk_size);
+		if (bytes <= 0)
+		{
+			throw network_error();
+		}
+
+		ret.resize(old_size + bytes);
+
+		// the terminator may straddle the previous read and this one
+		const size_t from = std::max(start, old_size - std::min(old_size, terminator_size - 1));
+		const size_t found = find(string_view(ret).substr(from));
+		if (found != string_view::npos)
+		{
+			ret.resize(from + found + terminator_size);
+		}
+
+		c.read(&ret[old_size], ret.size() - old_size);
+		if (found != string_view::npos)
+		{
+			return;
+		}
+	}
 }
 
-void trim_left(std::string& s)
+// the hex number the chunk starts with, the extensions are ignored
+size_t chunk_size(string_view line)
 {
-	size_t trim_count = 0;
-	for (char ch : s)
+	size_t size = 0;
+	for (char ch : line)
 	{
-		if (ch == ' ')
+		const char lower = ::tolower(static_cast<unsigned char>(ch));
+		if (ch >= '0' && ch <= '9')
 		{
-			++trim_count;
+			size = size * 16 + (ch - '0');
+		}
+		else if (lower >= 'a' && lower <= 'f')
+		{
+			size = size * 16 + (lower - 'a' + 10);
 		}
 		else
 		{
@@ -128,287 +484,905 @@ void trim_left(std::string& s)
 		}
 	}
 
-	s.erase(0, trim_count);
+	return size;
 }
 
-void trim_right(std::string& s)
+} // namespace
+
+std::string http::receive(client& c)
 {
-	size_t trim_count = 0;
-	for (auto i = s.rbegin(); i != s.rend(); ++i)
+	std::string ret;
+	read_through(c, ret, scan::find_head_end, 4);
+	const size_t head_end = ret.size();
+
+	// the status or request line goes first, the headers follow
+	string_view head(ret);
+	head = head.substr(scan::find_line_end(head) + 2);
+	head.remove_suffix(2);
+
+	wire::headers headers;
+	size_t content_len = 0;
+	if (!headers.parse(head))
 	{
-		if (*i == ' ')
+		return ret;
+	}
+
+	if (has_token(headers.get("Transfer-Encoding"), "chunked"))
+	{
+		// the chunks are returned as they are, framing included
+		while (true)
 		{
-			++trim_count;
+			const size_t line_start = ret.size();
+			read_through(c, ret, scan::find_line_end, 2);
+
+			const size_t size = chunk_size(string_view(ret).substr(line_start));
+			if (size == 0)
+			{
+				break;
+			}
+
+			const size_t data_start = ret.size();
+			ret.resize(data_start + size + 2);
+			c.read(&ret[data_start], size + 2);
 		}
-		else
+
+		// the trailer fields, if any, end with an empty line
+		size_t line_start = 0;
+		do
 		{
-			break;
+			line_start = ret.size();
+			read_through(c, ret, scan::find_line_end, 2);
 		}
+		while (ret.size() - line_start != 2);
+	}
+	else if (headers.get_number("Content-Length", content_len))
+	{
+		ret.resize(head_end + content_len);
+		c.read(&ret[head_end], content_len);
 	}
 
-	s.erase(s.size() - trim_count);
+	return ret;
 }
 
-void trim(std::string& s)
+void http::send(client& c, std::string buf)
 {
-	trim_left(s);
-	trim_right(s);
+	c.write_all(buf.c_str(), buf.size());
 }
 
-namespace wire
+void http::send(client& c, const request& r)
 {
+	thread_local std::string buffer;
+	r.serialize(buffer);
+	c.write_all(buffer.data(), buffer.size());
+}
 
-class headers
+http::http() : websockets_(std::make_shared<websocket_hub>()), events_(std::make_shared<event_hub>())
 {
-public:
-	bool has(const std::string& name) const
+	route_by(wire::route_key);
+}
+
+http::session_type::session_type() : request_(new parsed_request()) {}
+http::session_type::~session_type() {}
+
+void http::match(buffer_type& input, matcher& m, client& cl, session_type& session)
+{
+	request_scope scope(*session.request_);
+	if (auto ws = session.request_->websocket())
+	{
+		ws->receive(input, m);
+		return;
+	}
+
+	session.request_->stream(input, stream_digests_);
+	m.match(input, cl);
+
+	// let the parser know if anything has been consumed; once the response to
+	// the last request has gone out the connection is half-closed, the client
+	// closes it when it's done reading
+	session.request_->get(input);
+	if (auto ws = session.request_->websocket())
+	{
+		// the frames may have followed the handshake right away
+		ws->receive(input, m);
+		return;
+	}
+
+	if (session.request_->closing() && !session.closed_)
+	{
+		cl.shutdown_write();
+		session.closed_ = true;
+	}
+}
+
+http& http::when(request r)
+{
+	stream_digests_ |= r.content_digests();
+
+	std::string key;
+	if (r.route(key))
+	{
+		return base_type::when(matches_request(std::move(r))).route(std::move(key));
+	}
+
+	return base_type::when(matches_request(std::move(r)));
+}
+
+std::string http_response::serialize(size_t& date_pos) const
+{
+	std::string ret;
+	ret.reserve(128 + content_.size());
+	ret.append(http_version_to_str(ver_)).append(1, ' ');
+	ret.append(std::to_string(code_)).append(1, ' ');
+	ret.append(http_reason(code_)).append("\r\n");
+
+	date_pos = std::string::npos;
+	if (date_)
+	{
+		ret.append("Date: ");
+		date_pos = ret.size();
+		ret.append(http_date_now(), http_date_size).append("\r\n");
+	}
+
+	for (auto& h : headers_)
+	{
+		ret.append(h.first).append(": ").append(h.second).append("\r\n");
+	}
+
+	if (chunked_)
+	{
+		ret.append("Transfer-Encoding: chunked\r\n");
+	}
+	else if (has_content() && !headers_.has("Content-Length"))
 	{
-		auto i = pairs_.find(name);
-		return i != pairs_.end();
+		ret.append("Content-Length: ").append(std::to_string(content_.size())).append("\r\n");
 	}
 
-	template <typename T>
-	T get(const std::string& name) const
+	ret.append("\r\n");
+	if (!chunked_)
 	{
-		auto i = pairs_.find(name);
-		return lexical_cast<T>(i->second);
+		ret.append(content_);
 	}
 
-	template <typename T>
-	T get_opt(const std::string& name, T default_val = T()) const
+	return ret;
+}
+
+prepared_response::prepared_response(const http_response& r)
+{
+	auto bytes = std::make_shared<std::string>(r.serialize(date_pos_));
+	bytes_ = std::move(bytes);
+}
+
+void prepared_response::send(client& c) const
+{
+	if (date_pos_ == std::string::npos)
+	{
+		c.write(bytes_->data(), bytes_->size());
+		return;
+	}
+
+	// what's around the date goes as it is, nothing is copied
+	const std::string& bytes = *bytes_;
+	const size_t suffix = date_pos_ + http_date_size;
+	iovec pieces[] = {
+		{const_cast<char*>(bytes.data()), date_pos_},
+		{const_cast<char*>(http_date_now()), http_date_size},
+		{const_cast<char*>(bytes.data() + suffix), bytes.size() - suffix}};
+	c.write_all(pieces, 3);
+}
+
+namespace
+{
+
+const char* const week_days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+void format_http_date(time_t time, char (&date)[http_date_size + 1])
+{
+	tm t;
+	::gmtime_r(&time, &t);
+
+	// the format has room for four digits of the year and no more
+	const int year = std::min(std::max(t.tm_year + 1900, 0), 9999);
+	const int size = snprintf(date, sizeof(date), "%s, %02d %s %04d %02d:%02d:%02d GMT",
+		week_days[t.tm_wday], t.tm_mday, months[t.tm_mon], year, t.tm_hour, t.tm_min, t.tm_sec);
+	assert(size == int(http_date_size));
+	(void)size;
+}
+
+} // namespace
+
+const char* http_date_now()
+{
+	thread_local time_t formatted = -1;
+	thread_local char date[http_date_size + 1];
+
+	const time_t now = ::time(nullptr);
+	if (now != formatted)
 	{
-		if (has(name))
+		format_http_date(now, date);
+		formatted = now;
+	}
+
+	return date;
+}
+
+std::string http_date(time_t t)
+{
+	char date[http_date_size + 1];
+	format_http_date(t, date);
+	return date;
+}
+
+bool parse_http_date(string_view s, time_t& time)
+{
+	const std::string date = trim(s).to_string();
+	char day[4] = {};
+	char month[4] = {};
+	tm t = {};
+	if (date.size() != http_date_size || sscanf(date.c_str(), "%3s, %2d %3s %4d %2d:%2d:%2d GMT",
+		day, &t.tm_mday, month, &t.tm_year, &t.tm_hour, &t.tm_min, &t.tm_sec) != 7)
+	{
+		return false;
+	}
+
+	auto m = std::find_if(std::begin(months), std::end(months), [&](const char* name){return strcmp(name, month) == 0;});
+	if (m == std::end(months))
+	{
+		return false;
+	}
+
+	t.tm_mon = m - std::begin(months);
+	t.tm_year -= 1900;
+	time = ::timegm(&t);
+	return true;
+}
+
+http& http::reply(response r)
+{
+	if (r.precompressed())
+	{
+		return reply_precompressed(std::move(r));
+	}
+
+	prepared_response prepared(r);
+	return base_type::exec([prepared](client& c){prepared.send(c);});
+}
+
+http& http::reply_precompressed(response r)
+{
+	// identity, gzip and deflate, in the order of content_coding
+	std::vector<prepared_response> variants;
+	for (content_coding coding : {CODING_IDENTITY, CODING_GZIP, CODING_DEFLATE})
+	{
+		response variant = r;
+		variant.header("Vary", "Accept-Encoding");
+		if (coding != CODING_IDENTITY)
 		{
-			return get<T>(name);
+			variant.header("Content-Encoding", encoding::name(coding)).content(encoding::compress(coding, r.content()));
 		}
 
-		return default_val;
+		variants.emplace_back(variant);
 	}
 
-	void add(const std::string& name, const std::string& value)
+	return base_type::exec([variants](client& c)
 	{
-		pairs_[name] = value;
-		ordered_.emplace_back(std::make_pair(name, value));
-	}
+		const content_coding coding = current_request ? encoding::negotiate(current_request->summary().accept_encoding) : CODING_IDENTITY;
+		variants[coding].send(c);
+	});
+}
 
-	void parse(const std::string& input)
+http& http::reply(response r, chunk_producer next_chunk)
+{
+	prepared_response head(r.chunked());
+	return base_type::exec([head, next_chunk](client& c)
 	{
-		tokenizer tok;
-		tok.split_on("\r\n");
-		tok.tokenize(input.c_str(), input.size());
-		
-		auto token = tok.next();
-		while (token.first != nullptr)
+		head.send(c);
+
+		auto producer = next_chunk;
+		std::string chunk;
+		while (!(chunk = producer()).empty())
 		{
-			auto pair = split_pair(std::string(token.first, token.second), ':');
-			trim(pair.first);
-			trim(pair.second);
-			add(pair.first, pair.second);
-			token = tok.next();
+			// the size line, the data and the CRLF after it go in a single write
+			char size[24];
+			const int size_len = snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+			iovec pieces[] = {
+				{size, size_t(size_len)},
+				{&chunk[0], chunk.size()},
+				{const_cast<char*>("\r\n"), 2}};
+			c.write_all(pieces, 3);
 		}
+
+		c.write("0\r\n\r\n", 5);
+	});
+}
+
+http& http::reply(response r, body_generator generate, uint64_t size)
+{
+	// the size given here is the one the body has, whatever the response said;
+	// a status which can't have a body goes without it
+	const bool content = r.has_content();
+	if (content)
+	{
+		r.replace_header("Content-Length", std::to_string(size));
 	}
 
-	size_t count() const
+	prepared_response head(r.content(""));
+	return base_type::exec([head, generate, size, content](client& c)
+	{
+		head.send(c);
+		if (content)
+		{
+			write_generated(c, generate, size);
+		}
+	});
+}
+
+http& http::reply(int status_code)
+{
+	return reply(response(status_code));
+}
+
+http& http::reply(std::function<response(const params&)> make_response)
+{
+	return base_type::exec([make_response](client& c, const params& p)
 	{
-		return pairs_.size();
+		auto str = make_response(p).str();
+		c.write(str.c_str(), str.size());
+	});
+}
+
+namespace
+{
+
+class file_descriptor
+{
+public:
+	explicit file_descriptor(int fd) : fd_(fd) {}
+	file_descriptor(const file_descriptor&) = delete;
+	file_descriptor& operator =(const file_descriptor&) = delete;
+
+	~file_descriptor()
+	{
+		if (fd_ != -1)
+		{
+			::close(fd_);
+		}
 	}
 
-	std::pair<std::string, std::string> operator [](int i) const
+	int get() const
 	{
-		return ordered_[i];
+		return fd_;
 	}
 
 private:
-	using map_type = std::map<std::string, std::string>;
-	using value_type = map_type::value_type;
-	map_type pairs_; 
-	std::vector<value_type> ordered_; 
+	int fd_;
 };
 
-class request
+const char* content_type(string_view path)
 {
-public:
-	bool parse(const std::string& input)
+	static const std::pair<const char*, const char*> types[] =
 	{
-		const std::string HEAD_END("\r\n\r\n");
-		const char* const head_ptr = &input[0];
-		const void* const found = memmem(head_ptr, input.size(), &HEAD_END[0], HEAD_END.size());
-		const char* const head_end = static_cast<const char*>(found);
-
-		if (!head_end)
+		{".html", "text/html"},
+		{".htm", "text/html"},
+		{".txt", "text/plain"},
+		{".css", "text/css"},
+		{".js", "application/javascript"},
+		{".json", "application/json"},
+		{".xml", "application/xml"},
+		{".png", "image/png"},
+		{".jpg", "image/jpeg"},
+		{".jpeg", "image/jpeg"},
+		{".gif", "image/gif"},
+		{".svg", "image/svg+xml"},
+		{".wasm", "application/wasm"}
+	};
+
+	const size_t dot = path.rfind('.');
+	if (dot != string_view::npos && path.find('/', dot) == string_view::npos)
+	{
+		for (auto& t : types)
 		{
-			return false;
+			if (iequals(path.substr(dot), t.first))
+			{
+				return t.second;
+			}
 		}
+	}
 
-		const size_t head_size = head_end - input.c_str();
-		headers_.parse(input.substr(0, head_size));
+	return "application/octet-stream";
+}
 
-		auto content_len = headers_.get_opt<size_t>("Content-Length");
-		auto content_ptr = head_end + HEAD_END.size();
+// whether the validator the client has is the current one, weak ones included
+bool etag_matches(string_view if_none_match, string_view etag)
+{
+	if (trim(if_none_match) == "*")
+	{
+		return true;
+	}
 
-		// check if out of bounds
-		auto packet_size = content_ptr + content_len - &input[0];
-		if (packet_size > input.size())
+	while (!if_none_match.empty())
+	{
+		const size_t comma = if_none_match.find(',');
+		string_view tag = trim(if_none_match.substr(0, comma));
+		if (tag.substr(0, 2) == "W/")
 		{
-			return false;
+			tag.remove_prefix(2);
 		}
 
-		content_ = input.substr(content_ptr - head_ptr, content_len);
-		
-		if (headers_.count() > 0)
+		if (tag == etag)
 		{
-			auto first_header = headers_[0];
+			return true;
+		}
 
-			auto tokens = tokenize(first_header.first);
-			if (tokens.size() >= 3)
-			{
-				method_ = http_method_from_str(tokens[0]);
-				uri_ = tokens[1];
-				version_ = http_version_from_str(tokens[2]);
-
-				if (method_ == HTTP_BAD_METHOD || version_ == HTTP_BAD_VERSION)
-				{
-					return false;
-				}
-			}
+		if_none_match.remove_prefix(comma == string_view::npos ? if_none_match.size() : comma + 1);
+	}
+
+	return false;
+}
+
+enum class range_type
+{
+	none,
+	satisfiable,
+	unsatisfiable
+};
+
+// a single byte range, anything else is ignored and the whole file is sent
+range_type parse_range(string_view header, uint64_t size, uint64_t& first, uint64_t& count)
+{
+	header = trim(header);
+	if (!iequals(header.substr(0, 6), "bytes=") || header.find(',') != string_view::npos)
+	{
+		return range_type::none;
+	}
+
+	header.remove_prefix(6);
+	const size_t dash = header.find('-');
+	if (dash == string_view::npos)
+	{
+		return range_type::none;
+	}
+
+	size_t from = 0;
+	size_t to = 0;
+	const string_view from_str = trim(header.substr(0, dash));
+	const string_view to_str = trim(header.substr(dash + 1));
+	if (from_str.empty())
+	{
+		// the last bytes
+		if (!parse_number(to_str, to))
+		{
+			return range_type::none;
 		}
 
-		size_ = packet_size;
-		return true;
+		if (to == 0 || size == 0)
+		{
+			return range_type::unsatisfiable;
+		}
+
+		count = std::min<uint64_t>(to, size);
+		first = size - count;
+		return range_type::satisfiable;
 	}
 
-	http_method method() const
+	if (!parse_number(from_str, from) || (!to_str.empty() && (!parse_number(to_str, to) || to < from)))
 	{
-		return method_;
+		return range_type::none;
 	}
 
-	http_version version() const
+	if (from >= size)
 	{
-		return version_;
+		return range_type::unsatisfiable;
 	}
 
-	const std::string& content() const
+	const uint64_t last = to_str.empty() ? size - 1 : std::min<uint64_t>(to, size - 1);
+	first = from;
+	count = last - from + 1;
+	return range_type::satisfiable;
+}
+
+// the file goes from the page cache to the socket, it's never read in here
+void serve_file(client& c, const request_summary& r, const std::string& path)
+{
+	file_descriptor fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+	struct stat st;
+	if (fd.get() == -1 || ::fstat(fd.get(), &st) || !S_ISREG(st.st_mode))
 	{
-		return content_;
+		prepared_response(http_response(404)).send(c);
+		return;
 	}
 
-	const std::string& uri() const
+	const uint64_t size = st.st_size;
+	char etag[64];
+	snprintf(etag, sizeof(etag), "\"%llx-%llx\"", (unsigned long long)size,
+		(unsigned long long)st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec);
+
+	if (!r.if_none_match.empty() && etag_matches(r.if_none_match, etag))
 	{
-		return uri_;
+		prepared_response(http_response(304).header("ETag", etag)).send(c);
+		return;
 	}
 
-	size_t size() const
+	uint64_t first = 0;
+	uint64_t count = size;
+	const range_type range = r.range.empty() ? range_type::none : parse_range(r.range, size, first, count);
+	if (range == range_type::unsatisfiable)
 	{
-		return size_;
+		prepared_response(http_response(416).header("Content-Range", "bytes */" + std::to_string(size))).send(c);
+		return;
 	}
 
-	std::pair<std::string, std::string> get_header(int i) const
+	http_response response(range == range_type::satisfiable ? 206 : 200);
+	response.header("Content-Type", content_type(path)).header("Accept-Ranges", "bytes").header("ETag", etag);
+	if (range == range_type::satisfiable)
 	{
-		return headers_[i];
+		response.header("Content-Range", "bytes " + std::to_string(first) + "-" +
+			std::to_string(first + count - 1) + "/" + std::to_string(size));
 	}
 
-	size_t count_headers() const
+	prepared_response(response.header("Content-Length", std::to_string(count))).send(c);
+	if (r.method != HTTP_HEAD && count)
 	{
-		return headers_.count();
+		c.send_file(fd.get(), first, count);
 	}
+}
+
+// no way out of the root, be it through .. or an absolute path
+bool safe_relative_path(string_view path)
+{
+	bool safe = !path.empty() && path.find('\0') == string_view::npos;
+	for_each_route_segment(path.to_string(), [&](size_t pos, size_t len, bool)
+	{
+		safe = safe && !(len == 2 && path.substr(pos, 2) == "..");
+	});
 
+	return safe;
+}
 
-private:
-	headers headers_;
-	int status_ = 0;
-	http_method method_ = HTTP_BAD_METHOD;
-	http_version version_ = HTTP_BAD_VERSION;
-	std::string uri_;
-	std::string content_;
-	size_t size_ = 0;
+// the ETag of a coded representation, "x" becoming "x-gzip"
+std::string coded_etag(const std::string& etag, content_coding coding)
+{
+	if (coding == CODING_IDENTITY)
+	{
+		return etag;
+	}
+
+	const std::string suffix = std::string("-") + encoding::name(coding);
+	if (!etag.empty() && etag.back() == '"')
+	{
+		return etag.substr(0, etag.size() - 1) + suffix + "\"";
+	}
+
+	return etag + suffix;
+}
+
+// what reply_cacheable sends for one coding of the content
+struct cacheable_variant
+{
+	std::string etag;
+	prepared_response full;
+	prepared_response revalidated;
 };
 
-} // namespace wire
+} // namespace
 
+http& http::reply_file(std::string path)
+{
+	return base_type::exec([path](client& c)
+	{
+		if (current_request)
+		{
+			serve_file(c, current_request->summary(), path);
+		}
+	});
+}
 
-class matches_request
+http& http::reply_cacheable(response r, cache_policy policy)
 {
-public:
-	explicit matches_request(http::request request): request_(std::move(request)) {}
+	if (policy.etag.empty())
+	{
+		content_digest d(DIGEST_XXH64);
+		d.update(r.content());
+		policy.etag = "\"" + d.hex(DIGEST_XXH64) + "\"";
+	}
 
-	bool operator ()(buffer_type& input)
+	// precompressed, every coding is a representation of its own with an ETag
+	// of its own, in the order of content_coding
+	const bool precompressed = r.precompressed();
+	std::vector<cacheable_variant> variants;
+	for (content_coding coding : {CODING_IDENTITY, CODING_GZIP, CODING_DEFLATE})
 	{
-		wire::request wire_request;
-		if (wire_request.parse(std::string(input.begin(), input.end())))
+		if (coding != CODING_IDENTITY && !precompressed)
+		{
+			break;
+		}
+
+		// the 304 carries the same validators and freshness as the full response
+		const std::string etag = coded_etag(policy.etag, coding);
+		http_response full = r;
+		http_response not_modified(304);
+		if (coding != CODING_IDENTITY)
+		{
+			full.header("Content-Encoding", encoding::name(coding)).content(encoding::compress(coding, r.content()));
+		}
+
+		for (auto* response : {&full, &not_modified})
 		{
-			http::request actual_request = http::request(wire_request.version())
-				.method(wire_request.method())
-				.uri(wire_request.uri())
-				.content(wire_request.content());
+			if (precompressed)
+			{
+				response->header("Vary", "Accept-Encoding");
+			}
 
-			for (size_t i = 1; i < wire_request.count_headers(); ++i)
+			response->header("ETag", etag).date();
+			if (policy.last_modified)
 			{
-				actual_request.header(wire_request.get_header(i));
+				response->header("Last-Modified", http_date(policy.last_modified));
 			}
 
-			if (request_.match(actual_request))
+			if (policy.max_age >= 0)
 			{
-				input.erase(input.begin(), input.begin() + wire_request.size());
-				return true;
+				response->header("Cache-Control", "max-age=" + std::to_string(policy.max_age));
 			}
 		}
-		return false;
+
+		variants.push_back({etag, prepared_response(full), prepared_response(not_modified)});
 	}
 
-private:
-	http::request request_;
-};
+	return base_type::exec([this, variants, precompressed, policy](client& c)
+	{
+		const cacheable_variant* variant = &variants[0];
+		bool fresh = false;
+		if (current_request)
+		{
+			const request_summary& req = current_request->summary();
+			if (precompressed)
+			{
+				variant = &variants[encoding::negotiate(req.accept_encoding)];
+			}
+
+			// If-None-Match wins over If-Modified-Since, the other methods aren't cached
+			const bool cacheable = req.method == HTTP_GET || req.method == HTTP_HEAD;
+			time_t since = 0;
+			if (cacheable && !req.if_none_match.empty())
+			{
+				fresh = etag_matches(req.if_none_match, variant->etag);
+			}
+			else if (cacheable && policy.last_modified && parse_http_date(req.if_modified_since, since))
+			{
+				fresh = policy.last_modified <= since;
+			}
+		}
+
+		// counted first, the client may look as soon as it has the response
+		if (fresh)
+		{
+			++revalidated_responses_;
+			variant->revalidated.send(c);
+		}
+		else
+		{
+			++full_responses_;
+			variant->full.send(c);
+		}
+	});
+}
 
-bool ends_with(const std::string& input, const std::string& test)
+http& http::serve_directory(std::string root)
 {
-	return input.size() >= test.size() &&
-		0 == input.compare(input.size() - test.size(), test.size(), test);
+	return base_type::exec([root](client& c, const params& p)
+	{
+		if (!current_request)
+		{
+			return;
+		}
+
+		// the part the wildcard has captured or else the whole path, the query dropped
+		const request_summary& r = current_request->summary();
+		auto wildcard = std::find_if(p.begin(), p.end(), [](auto& param){return param.first == "*";});
+		string_view path = wildcard != p.end() ? string_view(wildcard->second) : string_view(r.uri);
+		path = path.substr(0, path.find('?'));
+		while (!path.empty() && path.front() == '/')
+		{
+			path.remove_prefix(1);
+		}
+
+		if (!safe_relative_path(path))
+		{
+			prepared_response(http_response(404)).send(c);
+			return;
+		}
+
+		serve_file(c, r, root + "/" + path.to_string());
+	});
 }
 
+http& http::serve_corpus(const std::string& path)
+{
+	return serve_corpus(std::make_shared<const corpus>(path));
+}
 
-std::string http::receive(client& c)
+http& http::serve_corpus(std::shared_ptr<const corpus> responses)
 {
-	char ch;
-	std::string ret;
-	while (!ends_with(ret, "\r\n\r\n"))
+	return base_type::exec([responses](client& c)
 	{
-		c.read(&ch, 1);
-		ret.append(1, ch);
-	}
+		if (!current_request)
+		{
+			return;
+		}
 
-	wire::headers headers;
-	headers.parse(ret);
+		const request_summary& r = current_request->summary();
+		string_view response;
+		if (responses->find(corpus_key(http_method_to_str(r.method), r.uri), response))
+		{
+			c.write(response.data(), response.size());
+		}
+		else
+		{
+			prepared_response(http_response(404)).send(c);
+		}
+	});
+}
+
+namespace
+{
+
+// the connection of the message being matched or of the request just upgraded
+websocket_session* current_websocket()
+{
+	return current_request ? current_request->websocket() : nullptr;
+}
 
-	if (headers.has("Content-Length"))
+} // namespace
+
+http& http::accept_websocket()
+{
+	auto hub = websockets_;
+	return base_type::exec([hub](client& c)
 	{
-		auto content_len = headers.get<size_t>("Content-Length");
-		auto head_len = ret.size();
-		ret.resize(head_len + content_len);
-		c.read(&ret[head_len], content_len);
-	}
+		if (current_request)
+		{
+			current_request->accept_websocket(c, hub);
+		}
+	});
+}
 
-	return std::move(ret);
+http& http::send_text(std::string payload)
+{
+	auto frame = std::make_shared<const std::string>(websocket::frame(WS_TEXT, payload));
+	return base_type::exec([frame](client&)
+	{
+		if (auto ws = current_websocket())
+		{
+			ws->send(frame);
+		}
+	});
 }
 
-void http::send(client& c, std::string buf)
+http& http::send_binary(std::string payload)
 {
-	c.write_all(buf.c_str(), buf.size());
+	auto frame = std::make_shared<const std::string>(websocket::frame(WS_BINARY, payload));
+	return base_type::exec([frame](client&)
+	{
+		if (auto ws = current_websocket())
+		{
+			ws->send(frame);
+		}
+	});
 }
 
-http& http::when(request r)
+namespace
 {
-	return base_type::when(matches_request(r));
+
+std::string current_message_frame()
+{
+	const websocket::message* m = websocket::current_message();
+	const auto& payload = *m->payload;
+	return websocket::frame(m->opcode, string_view(reinterpret_cast<const char*>(payload.data()), payload.size()));
 }
 
-http& http::reply(response r)
+} // namespace
+
+http& http::echo()
 {
-	auto str = r.str();
-	return base_type::exec([str](auto& c){c.write(str.c_str(), str.size());});
+	return base_type::exec([](client&)
+	{
+		auto ws = current_websocket();
+		if (ws && websocket::current_message())
+		{
+			ws->send(current_message_frame());
+		}
+	});
 }
 
-http& http::reply(int status_code)
+http& http::broadcast()
 {
-	return reply(response(status_code));
+	auto hub = websockets_;
+	return base_type::exec([hub](client&)
+	{
+		if (websocket::current_message())
+		{
+			hub->broadcast(std::make_shared<const std::string>(current_message_frame()));
+		}
+	});
+}
+
+http& http::broadcast_text(std::string payload)
+{
+	auto hub = websockets_;
+	auto frame = std::make_shared<const std::string>(websocket::frame(WS_TEXT, payload));
+	return base_type::exec([hub, frame](client&)
+	{
+		hub->broadcast(frame);
+	});
+}
+
+namespace
+{
+
+// an event in a chunk of its own, the same bytes go to every subscriber
+std::shared_ptr<const std::string> event_chunk(string_view data, string_view type, string_view id)
+{
+	const std::string event = sse::event(data, type, id);
+	char size[24];
+	const int size_len = snprintf(size, sizeof(size), "%zx\r\n", event.size());
+
+	auto ret = std::make_shared<std::string>();
+	ret->reserve(size_len + event.size() + 2);
+	ret->append(size, size_len).append(event).append("\r\n");
+	return ret;
+}
+
+} // namespace
+
+http& http::subscribe_events()
+{
+	auto hub = events_;
+	auto head = std::make_shared<const std::string>(http_response(200)
+		.header("Content-Type", "text/event-stream")
+		.header("Cache-Control", "no-cache")
+		.chunked()
+		.str());
+
+	// the thread of the connection finds it gone and is done
+	return base_type::exec([hub, head](client& c)
+	{
+		hub->subscribe(c.release(), head);
+	});
+}
+
+http& http::publish_event(std::string data, std::string type, std::string id)
+{
+	auto hub = events_;
+	auto chunk = event_chunk(data, type, id);
+	return base_type::exec([hub, chunk](client&)
+	{
+		hub->broadcast(chunk);
+	});
+}
+
+void http::broadcast_event(string_view data, string_view type, string_view id)
+{
+	events_->broadcast(event_chunk(data, type, id));
+}
+
+size_t http::event_subscribers() const
+{
+	return events_->size();
+}
+
+size_t http::full_responses() const
+{
+	return full_responses_;
+}
+
+size_t http::revalidated_responses() const
+{
+	return revalidated_responses_;
+}
+
+size_t http::websocket_connections() const
+{
+	return websockets_->size();
 }
 
 } // namespace nemok
@@ -2,6 +2,8 @@
 #include <sstream>
 #include <experimental/optional>
 #include "server.h"
+#include "headers.h"
+#include "digest.h"
 
 // TODO:
 // * assign a default timeout to every connection, the test application should never hang 
@@ -10,7 +12,13 @@
 namespace nemok
 {
 
-const std::map<int, const char*> http_status_codes
+struct http_status
+{
+	int code;
+	const char* reason;
+};
+
+constexpr http_status http_status_codes[] =
 {
 	{100, "Continue"},
 	{101, "Switching Protocols"},
@@ -75,10 +83,23 @@ const std::map<int, const char*> http_status_codes
 	{511, "Network Authentication Required"}
 };
 
+// the reason phrase, an empty one for the codes nobody knows
+constexpr const char* http_reason(int code)
+{
+	for (const auto& status : http_status_codes)
+	{
+		if (status.code == code)
+		{
+			return status.reason;
+		}
+	}
+
+	return "";
+}
+
 inline std::string desc_http_code(int code)
 {
-	auto i = http_status_codes.find(code);
-	return i == std::end(http_status_codes) ? "" : i->second;
+	return http_reason(code);
 }
 
 enum http_version
@@ -121,19 +142,27 @@ inline std::string http_method_to_str(http_method method)
 	return "";
 }
 
-inline http_method http_method_from_str(const std::string str)
+inline http_method http_method_from_str(string_view str)
 {
-	if (str == "GET")
-	{
-		return HTTP_GET;
-	}
-	else if (str == "POST")
-	{
-		return HTTP_POST;
-	}
-	else if (str == "HEAD")
+	static const std::pair<const char*, http_method> methods[] =
+	{
+		{"GET", HTTP_GET},
+		{"POST", HTTP_POST},
+		{"HEAD", HTTP_HEAD},
+		{"PUT", HTTP_PUT},
+		{"DELETE", HTTP_DELETE},
+		{"TRACE", HTTP_TRACE},
+		{"OPTIONS", HTTP_OPTIONS},
+		{"CONNECT", HTTP_CONNECT},
+		{"PATCH", HTTP_PATCH}
+	};
+
+	for (auto& m : methods)
 	{
-		return HTTP_HEAD;
+		if (str == m.first)
+		{
+			return m.second;
+		}
 	}
 
 	return HTTP_BAD_METHOD;
@@ -156,12 +185,16 @@ inline std::string http_version_to_str(http_version ver)
 	return "";
 }
 
-inline http_version http_version_from_str(const std::string& str)
+inline http_version http_version_from_str(string_view str)
 {
 	if (str == "HTTP/1.1")
 	{
 		return HTTP_11;
 	}
+	else if (str == "HTTP/1.0")
+	{
+		return HTTP_10;
+	}
 
 	return HTTP_BAD_VERSION;
 }
@@ -171,28 +204,73 @@ inline std::ostream& operator <<(std::ostream& stream, http_version ver)
 	return stream << http_version_to_str(ver);
 }
 
+namespace wire
+{
+class request;
+}
+
 class http_request
 {
 public:
 	using self_type = http_request;
 
-	self_type& uri(std::string u) { uri_ = u; return *this; }
+	self_type& uri(std::string u)
+	{
+		uri_pattern_ = route_table<bool>::is_pattern(u);
+		uri_ = std::move(u);
+		return *this;
+	}
+
 	self_type& method(http_method m) { method_ = m; return *this; }
 	self_type& content(std::string c) { content_ = c; return *this; }
 
+	// the content is json and the path selects the value, see nemok/json.h
+	self_type& with_json(std::string path, std::string value)
+	{
+		json_.emplace_back(std::move(path), std::move(value));
+		return *this;
+	}
+
+	// the content is looked at by its length and digests, see nemok/digest.h
+	self_type& with_content_length(uint64_t length)
+	{
+		content_length_ = length;
+		return *this;
+	}
+
+	// the digest in hex, either case
+	self_type& with_content_digest(digest_algorithm a, std::string hex)
+	{
+		std::transform(hex.begin(), hex.end(), hex.begin(), [](char ch){return char(std::tolower(ch));});
+		digests_.emplace_back(a, std::move(hex));
+		return *this;
+	}
+
+	// the algorithms the digests to match are made with
+	unsigned content_digests() const
+	{
+		unsigned ret = 0;
+		for (auto& d : digests_)
+		{
+			ret |= d.first;
+		}
+
+		return ret;
+	}
+
 	self_type& header(std::string key, std::string val)
 	{
 		return header(std::make_pair(key, val));
 	}
 
+	// the first value given for a name is the one that counts
 	self_type& header(std::pair<std::string, std::string> key_val)
 	{
-		if (!headers_)
+		if (!headers_.has(key_val.first))
 		{
-			headers_ = headers_type();
+			headers_.add(key_val.first, key_val.second);
 		}
 
-		headers_->insert(key_val);
 		return *this;
 	}
 
@@ -203,54 +281,88 @@ public:
 
 	std::string str() const
 	{
-		std::stringstream ss;
+		std::string ret;
+		serialize(ret);
+		return ret;
+	}
 
-		ss << method() << " " << uri() << " " << version() << "\r\n";
-		ss << "Content-Length: " << content().size() << "\r\n";
-	
-		if (headers_)
+	// the request line, the headers and then Content-Length unless one of the
+	// headers frames the content already; it's there for any content and for
+	// the methods that are expected to carry one
+	size_t serialized_size() const;
+
+	// replaces what the string holds, the memory it already has is reused
+	void serialize(std::string& out) const;
+
+	// writes the request if it fits the buffer, the size of the whole of it is
+	// returned either way
+	size_t serialize(char* buffer, size_t size) const;
+
+	// requests with both the method and the uri known are routed by this key,
+	// the rest of the fields are matched against the incoming request later on
+	bool route(std::string& key) const
+	{
+		if (!method_ || !uri_)
 		{
-			for (auto& h : *headers_)
-			{
-				ss << h.first << ": " << h.second << "\r\n";
-			}
+			return false;
 		}
 
-		ss << "\r\n\r\n";
-		ss << content();
-
-		return ss.str();
+		key = http_method_to_str(*method_) + " " + *uri_;
+		return true;
 	}
 
 	bool match(const http_request& rhs) const
 	{
-		const bool match_uri = match_opt(uri_, rhs.uri_); 
+		const bool match_uri = match_uri_opt(rhs);
 		const bool match_ver = match_opt(ver_, rhs.ver_);
 		const bool match_method = match_opt(method_, rhs.method_);
 		const bool match_content = match_opt(content_, rhs.content_);
 		const bool match_header = match_headers_opt(rhs);
+		const bool match_json = !rhs.content_ || match_json_content(*rhs.content_);
+		const bool match_digest = !rhs.content_ || match_digest_content(*rhs.content_);
 
-		return match_uri && match_ver && match_method && match_content && match_header;
+		return match_uri && match_ver && match_method && match_content && match_header && match_json && match_digest;
 	}
 
+	// same as above for a request parsed off the wire, nothing gets copied
+	bool match(const wire::request& rhs) const;
+
 private:
+	template <typename Sink>
+	void serialize_to(Sink& out) const;
+
+	bool match_json_content(string_view content) const;
+	bool match_digest_content(string_view content) const;
+	bool match_digest(const content_digest& d) const;
+
 	template <typename T>
 	static bool match_opt(const T& lhs, const T& rhs)
 	{
 		return !lhs || !rhs || *lhs == *rhs;
 	}
 
+	// the uri may be a route pattern like /users/{id}/orders/*
+	bool match_uri_opt(const http_request& rhs) const
+	{
+		if (!uri_ || !rhs.uri_)
+		{
+			return true;
+		}
+
+		return uri_pattern_ ? match_route(*uri_, *rhs.uri_) : *uri_ == *rhs.uri_;
+	}
+
 	bool match_headers_opt(const http_request& rhs) const
 	{
-		if (!headers_ || !rhs.headers_)
+		if (headers_.empty() || rhs.headers_.empty())
 		{
 			return true;
 		}
 
-		for (auto& h : *headers_)
+		for (auto& h : headers_)
 		{
-			auto i = rhs.headers_->find(h.first);
-			if (i == rhs.headers_->end() || h.second != i->second)
+			string_view value;
+			if (!rhs.headers_.get(h.first, value) || value != h.second)
 			{
 				return false;
 			}
@@ -283,12 +395,16 @@ private:
 	using optional = std::experimental::optional<T>;
 
 	optional<std::string> uri_;
+	bool uri_pattern_ = false;
 	optional<http_method> method_;
 	optional<http_version> ver_;
 	optional<std::string> content_;	
+	std::vector<std::pair<std::string, std::string>> json_;
+	optional<uint64_t> content_length_;
+	std::vector<std::pair<digest_algorithm, std::string>> digests_;
 
-	using headers_type = std::map<std::string, std::string>;
-	optional<headers_type> headers_;
+	using headers_type = basic_headers<std::string, 8>;
+	headers_type headers_;
 };
 
 class http_response
@@ -305,18 +421,148 @@ public:
 		return *this;
 	}
 
+	http_response& header(std::string name, std::string value)
+	{
+		headers_.add(name, value);
+		return *this;
+	}
+
+	// the header in place of the one with the same name, added if there's none
+	http_response& replace_header(string_view name, string_view value)
+	{
+		headers_.set(name, value);
+		return *this;
+	}
+
+	// Content-Length is added unless given explicitly
+	http_response& content(std::string c)
+	{
+		content_ = std::move(c);
+		return *this;
+	}
+
+	// the content follows in chunks
+	http_response& chunked()
+	{
+		chunked_ = true;
+		return *this;
+	}
+
+	// the Date header, the time is taken when the response is sent
+	http_response& date()
+	{
+		date_ = true;
+		return *this;
+	}
+
+	// gzip and deflate variants of the content are made once, the one sent is
+	// picked by the Accept-Encoding of the request, see nemok/encoding.h
+	http_response& precompress()
+	{
+		precompress_ = true;
+		return *this;
+	}
+
+	bool precompressed() const
+	{
+		return precompress_;
+	}
+
 	std::string str() const
 	{
-		std::stringstream ss;
-		ss << ver_ << " " << code_ << " " << desc_http_code(code_) << "\r\n\r\n";
-		return ss.str();
+		size_t date_pos = 0;
+		return serialize(date_pos);
+	}
+
+	int code() const
+	{
+		return code_;
+	}
+
+	using headers_type = basic_headers<std::string, 8>;
+
+	const headers_type& headers() const
+	{
+		return headers_;
+	}
+
+	const std::string& content() const
+	{
+		return content_;
+	}
+
+	bool has_date() const
+	{
+		return date_;
+	}
+
+	// no content is allowed in 1xx, 204 and 304 responses
+	bool has_content() const
+	{
+		return code_ >= 200 && code_ != 204 && code_ != 304;
 	}
 
 private:
+	friend class prepared_response;
+
+	// date_pos is where the value of the Date header goes, npos if there's none
+	std::string serialize(size_t& date_pos) const;
+
 	int code_ = 200;
+	bool chunked_ = false;
+	bool date_ = false;
+	bool precompress_ = false;
 	http_version ver_ = HTTP_11;
+	headers_type headers_;
+	std::string content_;
+};
+
+// a response serialized once when the expectation is set up and shared by all of
+// the connections, replying to a request is then a single write; the Date value,
+// if any, is written in between from a clock formatted once a second
+class prepared_response
+{
+public:
+	explicit prepared_response(const http_response& r);
+
+	void send(client& c) const;
+
+private:
+	std::shared_ptr<const std::string> bytes_;
+	size_t date_pos_ = std::string::npos;
+};
+
+// the content of a request longer than this is hashed and dropped as it arrives,
+// provided that the expectations look at digests, see nemok/digest.h
+const size_t http_stream_threshold = 64 * 1024;
+
+// e.g. Sun, 06 Nov 1994 08:49:37 GMT
+const size_t http_date_size = 29;
+
+// the current time as an http date, formatted no more than once a second by every thread
+const char* http_date_now();
+
+// the time as an http date and back, only the preferred format is read
+std::string http_date(time_t t);
+bool parse_http_date(string_view s, time_t& t);
+
+// what an origin friendly to caches sends along with the response, see http::reply_cacheable
+struct cache_policy
+{
+	// quotes included, a strong one made from the content if empty
+	std::string etag;
+
+	// no Last-Modified unless set
+	time_t last_modified = 0;
+
+	// no Cache-Control unless set, in seconds
+	int max_age = -1;
 };
 
+class parsed_request;
+class websocket_hub;
+class event_hub;
+class corpus;
 
 class http final : public basic_mock<http>
 {
@@ -325,7 +571,7 @@ public:
 	using response = http_response;
 	using request = http_request;
 
-	http() {}
+	http();
 
 	using base_type::when;
 
@@ -336,12 +582,79 @@ public:
 		return when(unexpected());
 	}
 
+	using params = route_params;
+
 	http& reply(response r);
 	http& reply(int status_code);
 
+	// the content is sent chunk by chunk as the producer makes them, an empty
+	// chunk ends it; every request gets a fresh copy of the producer
+	using chunk_producer = std::function<std::string()>;
+	http& reply(response r, chunk_producer next_chunk);
+
+	// the content is size bytes made by the generator, see nemok/body.h
+	http& reply(response r, body_generator generate, uint64_t size);
+
+	// the response is made out of the parameters captured by the route pattern
+	http& reply(std::function<response(const params&)> make_response);
+
+	// the file, the Range and If-None-Match of the request taken into account;
+	// the bytes are copied by the kernel from the page cache, see client::send_file
+	http& reply_file(std::string path);
+
+	// the response with its validators; a GET or HEAD with an If-None-Match that
+	// matches the ETag, or with no If-None-Match and an If-Modified-Since not older
+	// than Last-Modified, gets 304 instead; both are counted. A precompressed
+	// response has a variant for every coding, each with an ETag of its own
+	http& reply_cacheable(response r, cache_policy policy = cache_policy());
+
+	// the file under the root the wildcard of the route captures, e.g.
+	// when(GET("/static/*")).serve_directory("fixtures"), the whole path if there's none
+	http& serve_directory(std::string root);
+
+	// the response the corpus has for the method and the uri of the request, 404 if
+	// there's none; it's written right out of the mapping, see nemok/corpus.h
+	http& serve_corpus(const std::string& path);
+	http& serve_corpus(std::shared_ptr<const corpus> c);
+
+	// answers the websocket handshake, the connection carries frames from then on
+	// and the messages are matched by the triggers of nemok/websocket.h
+	http& accept_websocket();
+
+	// a frame to the connection of the message or handshake being matched
+	http& send_text(std::string payload);
+	http& send_binary(std::string payload);
+
+	// the message being matched goes back as it is
+	http& echo();
+
+	// the message being matched goes to every websocket connection of the mock
+	http& broadcast();
+	http& broadcast_text(std::string payload);
+
+	size_t websocket_connections() const;
+
+	// the response is a chunked text/event-stream lasting as long as the connection,
+	// which is handed over to the event hub of the mock, see nemok/sse.h
+	http& subscribe_events();
+
+	// the event is formatted once and goes to every subscriber
+	http& publish_event(std::string data, std::string type = std::string(), std::string id = std::string());
+	void broadcast_event(string_view data, string_view type = string_view(), string_view id = string_view());
+
+	size_t event_subscribers() const;
+
+	// the responses of reply_cacheable sent in full and the 304 ones
+	size_t full_responses() const;
+	size_t revalidated_responses() const;
+
 	static std::string receive(client& c);
 	static void send(client& c, std::string buf);
 
+	// serialized into a buffer the thread keeps, nothing is allocated once
+	// it's grown to the size of the requests being sent
+	static void send(client& c, const request& r);
+
 	static inline request GET(std::string uri) 
 	{
 		return request(HTTP_GET).uri(uri);
@@ -401,6 +714,36 @@ public:
 	{
 		return request();	
 	}
+
+private:
+	friend base_type;
+
+	// the request being received, parsed as it arrives
+	class session_type
+	{
+	public:
+		session_type();
+		~session_type();
+
+	private:
+		friend class http;
+		std::unique_ptr<parsed_request> request_;
+		bool closed_ = false;
+	};
+
+	// the request is parsed once and shared by all of the expectations
+	void match(buffer_type& input, matcher& m, client& cl, session_type& session);
+
+	http& reply_precompressed(response r);
+
+	std::shared_ptr<websocket_hub> websockets_;
+	std::shared_ptr<event_hub> events_;
+
+	// the algorithms of the digests the expectations look for
+	std::atomic<unsigned> stream_digests_{0};
+
+	std::atomic<size_t> full_responses_{0};
+	std::atomic<size_t> revalidated_responses_{0};
 };
 
 } // namespace nemok
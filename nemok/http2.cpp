@@ -0,0 +1,980 @@
+#include <condition_variable>
+#include <mutex>
+
+#include "http2.h"
+#include "hpack.h"
+#include "wire.h"
+
+namespace nemok
+{
+
+namespace
+{
+
+using clock_type = std::chrono::steady_clock;
+
+const size_t default_window_size = 65535;
+const size_t default_max_frame_size = 16384;
+const size_t max_frame_size_limit = 16777215;
+const int64_t max_window_size = 0x7fffffff;
+const size_t max_header_block_size = 1 << 20;
+const uint32_t max_concurrent_streams = 1024;
+
+// how long what's queued is given to go out once the connection is closed
+const auto drain_timeout = std::chrono::seconds(1);
+
+void append_uint32(std::string& out, uint32_t value)
+{
+	out.append(1, char(value >> 24)).append(1, char(value >> 16)).append(1, char(value >> 8)).append(1, char(value));
+}
+
+uint32_t read_uint32(const char* p)
+{
+	const uint8_t* u = reinterpret_cast<const uint8_t*>(p);
+	return (uint32_t(u[0]) << 24) | (uint32_t(u[1]) << 16) | (uint32_t(u[2]) << 8) | u[3];
+}
+
+void append_setting(std::string& out, http2_settings id, uint32_t value)
+{
+	out.append(1, char(id >> 8)).append(1, char(id));
+	append_uint32(out, value);
+}
+
+void append_frame_header(std::string& out, size_t length, http2_frame_type type, uint8_t flags, uint32_t stream)
+{
+	out.append(1, char(length >> 16)).append(1, char(length >> 8)).append(1, char(length));
+	out.append(1, char(type)).append(1, char(flags));
+	append_uint32(out, stream & 0x7fffffff);
+}
+
+std::string lowercase(std::string s)
+{
+	std::transform(s.begin(), s.end(), s.begin(), [](char ch){return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;});
+	return s;
+}
+
+// the padding length goes first, the padding itself last
+bool strip_padding(uint8_t flags, string_view& payload)
+{
+	if (!(flags & HTTP2_PADDED))
+	{
+		return true;
+	}
+
+	if (payload.empty())
+	{
+		return false;
+	}
+
+	const size_t padding = uint8_t(payload[0]);
+	payload.remove_prefix(1);
+	if (padding > payload.size())
+	{
+		return false;
+	}
+
+	payload.remove_suffix(padding);
+	return true;
+}
+
+// a response made up once when the expectation is set, the header block is encoded
+// beforehand save for the Date which is appended when the response goes out
+struct http2_reply
+{
+	explicit http2_reply(const http_response& r) : content(r.has_content() ? r.content() : "")
+	{
+		size = content.size();
+		make_block(r);
+	}
+
+	http2_reply(const http_response& r, body_generator g, uint64_t s) : generate(std::move(g)), size(s)
+	{
+		make_block(r);
+	}
+
+	void make_block(const http_response& r)
+	{
+		hpack::header_list headers;
+		headers.emplace_back(":status", std::to_string(r.code()));
+
+		for (auto& h : r.headers())
+		{
+			// there is no such thing as a connection specific header in http/2
+			if (iequals(h.first, "Connection") || iequals(h.first, "Transfer-Encoding") || iequals(h.first, "Keep-Alive"))
+			{
+				continue;
+			}
+
+			headers.emplace_back(lowercase(h.first), h.second);
+		}
+
+		if (r.has_content() && !r.headers().has("Content-Length"))
+		{
+			headers.emplace_back("content-length", std::to_string(size));
+		}
+
+		hpack::encode(headers, block);
+		date = r.has_date();
+	}
+
+	std::string block;
+	bool date = false;
+	std::string content;
+	body_generator generate;
+	uint64_t size = 0;
+};
+
+// the stream whose request is being matched; the expectations are walked
+// on the thread reading the connection, the actions only note what's to be sent
+struct stream_context
+{
+	std::string head;
+	wire::request request;
+	std::shared_ptr<const http2_reply> reply;
+	std::chrono::milliseconds delay{0};
+};
+
+thread_local stream_context* current_stream = nullptr;
+
+class stream_scope
+{
+public:
+	explicit stream_scope(stream_context& s) : prev_(current_stream)
+	{
+		current_stream = &s;
+	}
+
+	~stream_scope()
+	{
+		current_stream = prev_;
+	}
+
+private:
+	stream_context* prev_;
+};
+
+class matches_stream
+{
+public:
+	explicit matches_stream(http_request request): request_(std::move(request)) {}
+
+	bool operator ()(buffer_type& input)
+	{
+		if (current_stream && request_.match(current_stream->request))
+		{
+			input.clear();
+			return true;
+		}
+
+		return false;
+	}
+
+private:
+	http_request request_;
+};
+
+} // namespace
+
+std::string http2_frame(http2_frame_type type, uint8_t flags, uint32_t stream, string_view payload)
+{
+	std::string ret;
+	ret.reserve(http2_frame_header_size + payload.size());
+	append_frame_header(ret, payload.size(), type, flags, stream);
+	ret.append(payload.data(), payload.size());
+	return ret;
+}
+
+// the frames are read and the requests matched on the thread serving the
+// connection, the responses are written by a thread of its own so that a delayed
+// or flow controlled stream doesn't hold the others back
+class http2_connection
+{
+public:
+	explicit http2_connection(client& cl) : client_(cl)
+	{
+		writer_ = std::thread([this]{write_frames();});
+	}
+
+	~http2_connection()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		stopping_ = true;
+		deadline_ = clock_type::now() + drain_timeout;
+		wake_.notify_all();
+
+		// the writer may be stuck writing to a peer which has stopped reading
+		if (!drained_.wait_until(lock, deadline_, [this]{return stopped_;}))
+		{
+			client_.shutdown_write();
+		}
+
+		lock.unlock();
+		writer_.join();
+	}
+
+	// consumes the complete frames the input starts with
+	void receive(buffer_type& input, matcher& m);
+
+private:
+	// a request being received
+	struct incoming
+	{
+		std::string block;
+		hpack::header_list headers;
+		std::string content;
+		bool has_headers = false;
+		bool end_stream = false;
+
+		// over the limit, the block is only decoded to keep the table in sync
+		bool refused = false;
+	};
+
+	// a response being sent
+	struct outgoing
+	{
+		int64_t window = 0;
+		std::shared_ptr<const http2_reply> reply;
+		clock_type::time_point due;
+		bool headers_sent = false;
+		uint64_t sent = 0;
+	};
+
+	bool on_frame(http2_frame_type type, uint8_t flags, uint32_t stream, string_view payload, matcher& m);
+	bool on_data(uint8_t flags, uint32_t stream, string_view payload, matcher& m);
+	bool on_headers(uint8_t flags, uint32_t stream, string_view payload, matcher& m);
+	bool on_header_block(uint32_t stream, matcher& m);
+	bool on_settings(uint8_t flags, string_view payload);
+	bool on_window_update(uint32_t stream, string_view payload);
+	void dispatch(uint32_t stream, incoming& in, matcher& m);
+	void reset_stream(uint32_t stream, http2_error error);
+	void fail(http2_error error);
+	void send_control(std::string frames);
+
+	void write_frames();
+	bool next_frame(outgoing& out, uint32_t stream, std::string& frames);
+
+	client& client_;
+
+	// the reading side only
+	bool preface_ = false;
+	bool failed_ = false;
+	hpack::decoder decoder_;
+	std::map<uint32_t, incoming> incoming_;
+	uint32_t last_stream_ = 0;
+	uint32_t continuation_ = 0;
+	bool continuation_end_stream_ = false;
+
+	// shared with the writer
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::string control_;
+	std::map<uint32_t, outgoing> outgoing_;
+	int64_t connection_window_ = default_window_size;
+	int64_t initial_window_ = default_window_size;
+	size_t max_frame_size_ = default_max_frame_size;
+
+	// once stopping, the writer goes on until there's nothing left or the deadline
+	bool stopping_ = false;
+	bool stopped_ = false;
+	clock_type::time_point deadline_;
+	std::condition_variable drained_;
+
+	std::thread writer_;
+};
+
+void http2_connection::receive(buffer_type& input, matcher& m)
+{
+	if (failed_)
+	{
+		input.clear();
+		return;
+	}
+
+	size_t pos = 0;
+	if (!preface_)
+	{
+		if (input.size() < http2_preface_size)
+		{
+			return;
+		}
+
+		if (memcmp(&input[0], http2_preface, http2_preface_size))
+		{
+			fail(HTTP2_PROTOCOL_ERROR);
+			input.clear();
+			return;
+		}
+
+		std::string settings;
+		append_setting(settings, HTTP2_MAX_CONCURRENT_STREAMS, max_concurrent_streams);
+		send_control(http2_frame(HTTP2_SETTINGS, 0, 0, settings));
+
+		preface_ = true;
+		pos = http2_preface_size;
+	}
+
+	while (input.size() - pos >= http2_frame_header_size)
+	{
+		const char* header = reinterpret_cast<const char*>(&input[pos]);
+		const size_t length = (read_uint32(header) >> 8);
+		if (length > default_max_frame_size)
+		{
+			fail(HTTP2_FRAME_SIZE_ERROR);
+			break;
+		}
+
+		if (input.size() - pos < http2_frame_header_size + length)
+		{
+			break;
+		}
+
+		const auto type = static_cast<http2_frame_type>(uint8_t(header[3]));
+		const uint8_t flags = header[4];
+		const uint32_t stream = read_uint32(header + 5) & 0x7fffffff;
+		const string_view payload(header + http2_frame_header_size, length);
+		pos += http2_frame_header_size + length;
+
+		if (!on_frame(type, flags, stream, payload, m))
+		{
+			fail(HTTP2_PROTOCOL_ERROR);
+		}
+
+		if (failed_)
+		{
+			break;
+		}
+	}
+
+	if (failed_)
+	{
+		input.clear();
+		return;
+	}
+
+	input.erase(input.begin(), input.begin() + pos);
+}
+
+bool http2_connection::on_frame(http2_frame_type type, uint8_t flags, uint32_t stream, string_view payload, matcher& m)
+{
+	// nothing may come between the frames of a header block
+	if (continuation_ && (type != HTTP2_CONTINUATION || stream != continuation_))
+	{
+		return false;
+	}
+
+	switch (type)
+	{
+		case HTTP2_DATA:
+			return on_data(flags, stream, payload, m);
+
+		case HTTP2_HEADERS:
+			return on_headers(flags, stream, payload, m);
+
+		case HTTP2_CONTINUATION:
+		{
+			if (!continuation_)
+			{
+				return false;
+			}
+
+			auto& in = incoming_[stream];
+			in.block.append(payload.data(), payload.size());
+			if (in.block.size() > max_header_block_size)
+			{
+				return false;
+			}
+
+			if (flags & HTTP2_END_HEADERS)
+			{
+				continuation_ = 0;
+				in.end_stream = continuation_end_stream_;
+				return on_header_block(stream, m);
+			}
+
+			return true;
+		}
+
+		case HTTP2_SETTINGS:
+			return stream == 0 && on_settings(flags, payload);
+
+		case HTTP2_PING:
+		{
+			if (stream != 0 || payload.size() != 8)
+			{
+				return false;
+			}
+
+			if (!(flags & HTTP2_ACK))
+			{
+				send_control(http2_frame(HTTP2_PING, HTTP2_ACK, 0, payload));
+			}
+
+			return true;
+		}
+
+		case HTTP2_WINDOW_UPDATE:
+			return on_window_update(stream, payload);
+
+		case HTTP2_RST_STREAM:
+		{
+			if (stream == 0 || payload.size() != 4)
+			{
+				return false;
+			}
+
+			incoming_.erase(stream);
+			std::lock_guard<std::mutex> lock(mutex_);
+			outgoing_.erase(stream);
+			return true;
+		}
+
+		case HTTP2_PUSH_PROMISE:
+			// clients never push
+			return false;
+
+		default:
+			// GOAWAY, PRIORITY and the frame types we don't know
+			return true;
+	}
+}
+
+bool http2_connection::on_data(uint8_t flags, uint32_t stream, string_view payload, matcher& m)
+{
+	if (stream == 0)
+	{
+		return false;
+	}
+
+	// whatever the peer sends counts against the windows, so it's all given back
+	std::string updates;
+	if (!payload.empty())
+	{
+		std::string increment;
+		append_uint32(increment, payload.size());
+		updates = http2_frame(HTTP2_WINDOW_UPDATE, 0, 0, increment);
+		if (!(flags & HTTP2_END_STREAM))
+		{
+			updates.append(http2_frame(HTTP2_WINDOW_UPDATE, 0, stream, increment));
+		}
+
+		send_control(std::move(updates));
+	}
+
+	if (!strip_padding(flags, payload))
+	{
+		return false;
+	}
+
+	auto i = incoming_.find(stream);
+	if (i == incoming_.end() || !i->second.has_headers)
+	{
+		reset_stream(stream, HTTP2_STREAM_CLOSED);
+		return true;
+	}
+
+	i->second.content.append(payload.data(), payload.size());
+	if (flags & HTTP2_END_STREAM)
+	{
+		dispatch(stream, i->second, m);
+		incoming_.erase(i);
+	}
+
+	return true;
+}
+
+bool http2_connection::on_headers(uint8_t flags, uint32_t stream, string_view payload, matcher& m)
+{
+	if (stream == 0 || !strip_padding(flags, payload))
+	{
+		return false;
+	}
+
+	if (flags & HTTP2_PRIORITY_FLAG)
+	{
+		if (payload.size() < 5)
+		{
+			return false;
+		}
+
+		payload.remove_prefix(5);
+	}
+
+	auto i = incoming_.find(stream);
+	if (i == incoming_.end())
+	{
+		// the streams opened by the client are odd and go up
+		if (!(stream & 1) || stream <= last_stream_)
+		{
+			return false;
+		}
+
+		last_stream_ = stream;
+		i = incoming_.emplace(stream, incoming()).first;
+
+		// the streams still being received or replied to are the open ones
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (outgoing_.size() >= max_concurrent_streams)
+		{
+			i->second.refused = true;
+		}
+		else
+		{
+			outgoing_[stream].window = initial_window_;
+		}
+	}
+	else if (!(flags & HTTP2_END_STREAM))
+	{
+		// the trailers are to end the stream
+		return false;
+	}
+
+	i->second.block.assign(payload.data(), payload.size());
+	if (!(flags & HTTP2_END_HEADERS))
+	{
+		continuation_ = stream;
+		continuation_end_stream_ = flags & HTTP2_END_STREAM;
+		return true;
+	}
+
+	i->second.end_stream = flags & HTTP2_END_STREAM;
+	return on_header_block(stream, m);
+}
+
+bool http2_connection::on_header_block(uint32_t stream, matcher& m)
+{
+	auto& in = incoming_[stream];
+
+	// the trailers are decoded to keep the table in sync and then dropped
+	hpack::header_list trailers;
+	if (!decoder_.decode(in.block, in.has_headers ? trailers : in.headers))
+	{
+		fail(HTTP2_COMPRESSION_ERROR);
+		return true;
+	}
+
+	in.block.clear();
+	in.has_headers = true;
+	if (in.refused)
+	{
+		incoming_.erase(stream);
+		reset_stream(stream, HTTP2_REFUSED_STREAM);
+		return true;
+	}
+
+	if (in.end_stream)
+	{
+		dispatch(stream, in, m);
+		incoming_.erase(stream);
+	}
+
+	return true;
+}
+
+bool http2_connection::on_settings(uint8_t flags, string_view payload)
+{
+	if (flags & HTTP2_ACK)
+	{
+		return payload.empty();
+	}
+
+	if (payload.size() % 6)
+	{
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	for (size_t pos = 0; pos < payload.size(); pos += 6)
+	{
+		const uint16_t id = (uint16_t(uint8_t(payload[pos])) << 8) | uint8_t(payload[pos + 1]);
+		const uint32_t value = read_uint32(payload.data() + pos + 2);
+		if (id == HTTP2_INITIAL_WINDOW_SIZE)
+		{
+			if (value > max_window_size)
+			{
+				return false;
+			}
+
+			// the change applies to the windows of the open streams as well
+			const int64_t delta = int64_t(value) - initial_window_;
+			for (auto& out : outgoing_)
+			{
+				out.second.window += delta;
+			}
+
+			initial_window_ = value;
+		}
+		else if (id == HTTP2_MAX_FRAME_SIZE)
+		{
+			if (value < default_max_frame_size || value > max_frame_size_limit)
+			{
+				return false;
+			}
+
+			max_frame_size_ = value;
+		}
+	}
+
+	lock.unlock();
+	send_control(http2_frame(HTTP2_SETTINGS, HTTP2_ACK, 0, string_view()));
+	return true;
+}
+
+bool http2_connection::on_window_update(uint32_t stream, string_view payload)
+{
+	if (payload.size() != 4)
+	{
+		return false;
+	}
+
+	const uint32_t increment = read_uint32(payload.data()) & 0x7fffffff;
+	if (increment == 0)
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (stream == 0)
+		{
+			connection_window_ += increment;
+		}
+		else
+		{
+			auto i = outgoing_.find(stream);
+			if (i != outgoing_.end())
+			{
+				i->second.window += increment;
+			}
+		}
+	}
+
+	wake_.notify_all();
+	return true;
+}
+
+// the head of the request is put the way an HTTP/1.1 one would look so that
+// the very same expectations and routes apply, the content stays where the
+// DATA frames have put it
+void http2_connection::dispatch(uint32_t stream, incoming& in, matcher& m)
+{
+	std::string method;
+	std::string path;
+	std::string authority;
+	for (auto& f : in.headers)
+	{
+		if (f.first == ":method")
+		{
+			method = f.second;
+		}
+		else if (f.first == ":path")
+		{
+			path = f.second;
+		}
+		else if (f.first == ":authority")
+		{
+			authority = f.second;
+		}
+	}
+
+	stream_context context;
+	std::string& head = context.head;
+	head.reserve(128);
+	head.append(method).append(1, ' ').append(path).append(" HTTP/1.1\r\n");
+	if (!authority.empty())
+	{
+		head.append("Host: ").append(authority).append("\r\n");
+	}
+
+	for (auto& f : in.headers)
+	{
+		if (f.first.empty() || f.first[0] == ':' || f.first == "content-length" || f.first == "transfer-encoding")
+		{
+			continue;
+		}
+
+		head.append(f.first).append(": ").append(f.second).append("\r\n");
+	}
+
+	head.append("\r\n");
+	if (method.empty() || path.empty() || !context.request.parse(head))
+	{
+		reset_stream(stream, HTTP2_PROTOCOL_ERROR);
+		return;
+	}
+
+	context.request.attach_content(in.content);
+
+	// the input is only there to be routed and consumed, the triggers look at the request
+	{
+		stream_scope scope(context);
+		buffer_type input(head.begin(), head.end());
+		m.match(input, client_);
+	}
+
+	// a request nothing replies to is left hanging, same as with http/1.1,
+	// there's nothing to be kept for it meanwhile
+	std::unique_lock<std::mutex> lock(mutex_);
+	auto i = outgoing_.find(stream);
+	if (i == outgoing_.end())
+	{
+		return;
+	}
+
+	if (!context.reply)
+	{
+		outgoing_.erase(i);
+		return;
+	}
+
+	i->second.reply = context.reply;
+	i->second.due = clock_type::now() + context.delay;
+	lock.unlock();
+
+	wake_.notify_all();
+}
+
+void http2_connection::reset_stream(uint32_t stream, http2_error error)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		outgoing_.erase(stream);
+	}
+
+	std::string code;
+	append_uint32(code, error);
+	send_control(http2_frame(HTTP2_RST_STREAM, 0, stream, code));
+}
+
+// the connection is done with, whatever comes next is ignored
+void http2_connection::fail(http2_error error)
+{
+	std::string payload;
+	append_uint32(payload, last_stream_);
+	append_uint32(payload, error);
+	send_control(http2_frame(HTTP2_GOAWAY, 0, 0, payload));
+	failed_ = true;
+}
+
+void http2_connection::send_control(std::string frames)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		control_.append(frames);
+	}
+
+	wake_.notify_all();
+}
+
+// the streams due take turns, a frame each
+void http2_connection::write_frames()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true)
+	{
+		const auto now = clock_type::now();
+		if (stopping_ && now >= deadline_)
+		{
+			break;
+		}
+
+		std::string frames;
+		frames.swap(control_);
+
+		auto next = clock_type::time_point::max();
+		bool replying = false;
+		for (auto i = outgoing_.begin(); i != outgoing_.end(); )
+		{
+			auto& out = i->second;
+			if (!out.reply)
+			{
+				++i;
+				continue;
+			}
+
+			replying = true;
+			if (out.due > now)
+			{
+				next = std::min(next, out.due);
+				++i;
+				continue;
+			}
+
+			if (next_frame(out, i->first, frames))
+			{
+				i = outgoing_.erase(i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		if (frames.empty())
+		{
+			if (stopping_ && !replying)
+			{
+				break;
+			}
+
+			if (stopping_)
+			{
+				next = std::min(next, deadline_);
+			}
+
+			if (next == clock_type::time_point::max())
+			{
+				wake_.wait(lock);
+			}
+			else
+			{
+				wake_.wait_until(lock, next);
+			}
+
+			continue;
+		}
+
+		lock.unlock();
+		try
+		{
+			client_.write(frames.data(), frames.size());
+		}
+		catch (const exception&)
+		{
+			lock.lock();
+			break;
+		}
+
+		lock.lock();
+	}
+
+	stopped_ = true;
+	drained_.notify_all();
+}
+
+// true once the whole of the response is there
+bool http2_connection::next_frame(outgoing& out, uint32_t stream, std::string& frames)
+{
+	const http2_reply& reply = *out.reply;
+	if (!out.headers_sent)
+	{
+		std::string block = reply.block;
+		if (reply.date)
+		{
+			hpack::encode({{"date", std::string(http_date_now(), http_date_size)}}, block);
+		}
+
+		// the block is cut into a HEADERS frame and as many CONTINUATION ones as needed
+		const uint8_t end_stream = reply.size ? 0 : HTTP2_END_STREAM;
+		size_t pos = 0;
+		do
+		{
+			const size_t len = std::min(block.size() - pos, max_frame_size_);
+			const bool last = pos + len == block.size();
+			const auto type = pos ? HTTP2_CONTINUATION : HTTP2_HEADERS;
+			const uint8_t flags = (pos ? 0 : end_stream) | (last ? HTTP2_END_HEADERS : 0);
+			append_frame_header(frames, len, type, flags, stream);
+			frames.append(block, pos, len);
+			pos += len;
+		}
+		while (pos < block.size());
+
+		out.headers_sent = true;
+		return !reply.size;
+	}
+
+	const int64_t window = std::min(connection_window_, out.window);
+	if (window <= 0)
+	{
+		return false;
+	}
+
+	const uint64_t len = std::min<uint64_t>({reply.size - out.sent, max_frame_size_, uint64_t(window)});
+	const bool last = out.sent + len == reply.size;
+	append_frame_header(frames, len, HTTP2_DATA, last ? HTTP2_END_STREAM : 0, stream);
+	const size_t pos = frames.size();
+	if (reply.generate)
+	{
+		frames.resize(pos + len);
+		reply.generate(&frames[pos], len, out.sent);
+	}
+	else
+	{
+		frames.append(reply.content, out.sent, len);
+	}
+
+	out.sent += len;
+	out.window -= len;
+	connection_window_ -= len;
+	return last;
+}
+
+http2::http2()
+{
+	route_by(wire::route_key);
+}
+
+http2::session_type::session_type() {}
+http2::session_type::~session_type() {}
+
+void http2::match(buffer_type& input, matcher& m, client& cl, session_type& session)
+{
+	if (!session.connection_)
+	{
+		session.connection_.reset(new http2_connection(cl));
+	}
+
+	session.connection_->receive(input, m);
+}
+
+http2& http2::when(request r)
+{
+	std::string key;
+	if (r.route(key))
+	{
+		return base_type::when(matches_stream(std::move(r))).route(std::move(key));
+	}
+
+	return base_type::when(matches_stream(std::move(r)));
+}
+
+http2& http2::reply(response r)
+{
+	auto prepared = std::make_shared<const http2_reply>(r);
+	return base_type::exec([prepared](client&)
+	{
+		if (current_stream)
+		{
+			current_stream->reply = prepared;
+		}
+	});
+}
+
+http2& http2::reply(response r, body_generator generate, uint64_t size)
+{
+	auto prepared = std::make_shared<const http2_reply>(r, std::move(generate), size);
+	return base_type::exec([prepared](client&)
+	{
+		if (current_stream)
+		{
+			current_stream->reply = prepared;
+		}
+	});
+}
+
+http2& http2::reply(int status_code)
+{
+	return reply(response(status_code));
+}
+
+http2& http2::delay(std::chrono::milliseconds d)
+{
+	return base_type::exec([d](client&)
+	{
+		if (current_stream)
+		{
+			current_stream->delay = d;
+		}
+	});
+}
+
+} // namespace nemok
@@ -0,0 +1,118 @@
+#pragma once
+#include <chrono>
+#include "http.h"
+
+/*
+	auto mock = nemok::start<nemok::http2>();
+	mock.when(nemok::http::GET("/slow")).delay(std::chrono::milliseconds(100)).reply(200);
+	mock.when(nemok::http::GET("/fast")).reply(nemok::http::response(200).content("hello"));
+
+	the client is to start with the connection preface right away (h2c with prior
+	knowledge), every stream is matched against the expectations on its own
+	once its request is complete and the responses go out as soon as they're due,
+	interleaved with one another
+*/
+
+namespace nemok
+{
+
+enum http2_frame_type
+{
+	HTTP2_DATA = 0x0,
+	HTTP2_HEADERS = 0x1,
+	HTTP2_PRIORITY = 0x2,
+	HTTP2_RST_STREAM = 0x3,
+	HTTP2_SETTINGS = 0x4,
+	HTTP2_PUSH_PROMISE = 0x5,
+	HTTP2_PING = 0x6,
+	HTTP2_GOAWAY = 0x7,
+	HTTP2_WINDOW_UPDATE = 0x8,
+	HTTP2_CONTINUATION = 0x9
+};
+
+enum http2_flags
+{
+	HTTP2_END_STREAM = 0x1,
+	HTTP2_ACK = 0x1,
+	HTTP2_END_HEADERS = 0x4,
+	HTTP2_PADDED = 0x8,
+	HTTP2_PRIORITY_FLAG = 0x20
+};
+
+enum http2_settings
+{
+	HTTP2_HEADER_TABLE_SIZE = 0x1,
+	HTTP2_ENABLE_PUSH = 0x2,
+	HTTP2_MAX_CONCURRENT_STREAMS = 0x3,
+	HTTP2_INITIAL_WINDOW_SIZE = 0x4,
+	HTTP2_MAX_FRAME_SIZE = 0x5,
+	HTTP2_MAX_HEADER_LIST_SIZE = 0x6
+};
+
+enum http2_error
+{
+	HTTP2_NO_ERROR = 0x0,
+	HTTP2_PROTOCOL_ERROR = 0x1,
+	HTTP2_INTERNAL_ERROR = 0x2,
+	HTTP2_FLOW_CONTROL_ERROR = 0x3,
+	HTTP2_STREAM_CLOSED = 0x5,
+	HTTP2_FRAME_SIZE_ERROR = 0x6,
+	HTTP2_REFUSED_STREAM = 0x7,
+	HTTP2_COMPRESSION_ERROR = 0x9
+};
+
+const char http2_preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t http2_preface_size = sizeof(http2_preface) - 1;
+const size_t http2_frame_header_size = 9;
+
+// the frame header followed by the payload
+std::string http2_frame(http2_frame_type type, uint8_t flags, uint32_t stream, string_view payload);
+
+class http2_connection;
+
+class http2 final : public basic_mock<http2>
+{
+public:
+	using base_type = basic_mock<http2>;
+	using response = http_response;
+	using request = http_request;
+	using params = route_params;
+
+	http2();
+
+	using base_type::when;
+
+	http2& when(request r);
+
+	http2& when_unexpected()
+	{
+		return when(request());
+	}
+
+	http2& reply(response r);
+	http2& reply(int status_code);
+
+	// size bytes made by the generator, see nemok/body.h
+	http2& reply(response r, body_generator generate, uint64_t size);
+
+	// the response is held back for this long, the other streams go on meanwhile
+	http2& delay(std::chrono::milliseconds d);
+
+private:
+	friend base_type;
+
+	class session_type
+	{
+	public:
+		session_type();
+		~session_type();
+
+	private:
+		friend class http2;
+		std::unique_ptr<http2_connection> connection_;
+	};
+
+	void match(buffer_type& input, matcher& m, client& cl, session_type& session);
+};
+
+} // namespace nemok
@@ -0,0 +1,387 @@
+#include "json.h"
+#include "scan.h"
+
+namespace nemok
+{
+
+namespace json
+{
+
+namespace
+{
+
+const size_t npos = string_view::npos;
+
+size_t skip_space(string_view doc, size_t pos)
+{
+	while (pos < doc.size() && (doc[pos] == ' ' || doc[pos] == '\t' || doc[pos] == '\r' || doc[pos] == '\n'))
+	{
+		++pos;
+	}
+
+	return pos;
+}
+
+// pos is at the opening quote, the position past the closing one is returned
+size_t skip_string(string_view doc, size_t pos)
+{
+	size_t i = pos + 1;
+	while (i < doc.size())
+	{
+		const size_t k = scan::find_first_of(doc.substr(i), "\"\\");
+		if (k == npos)
+		{
+			return npos;
+		}
+
+		if (doc[i + k] == '"')
+		{
+			return i + k + 1;
+		}
+
+		// whatever is escaped, the quote included, is stepped over
+		i += k + 2;
+	}
+
+	return npos;
+}
+
+// the brackets of the other kind have to be balanced as well, but they don't
+// change where this value ends, so only the strings and its own kind are looked for
+size_t skip_nested(string_view doc, size_t pos, char open, char close)
+{
+	const char delimiters[] = {'"', open, close};
+	size_t depth = 0;
+	size_t i = pos;
+	while (i < doc.size())
+	{
+		const size_t k = scan::find_first_of(doc.substr(i), string_view(delimiters, sizeof(delimiters)));
+		if (k == npos)
+		{
+			return npos;
+		}
+
+		i += k;
+		if (doc[i] == '"')
+		{
+			i = skip_string(doc, i);
+			if (i == npos)
+			{
+				return npos;
+			}
+		}
+		else if (doc[i++] == open)
+		{
+			++depth;
+		}
+		else if (--depth == 0)
+		{
+			return i;
+		}
+	}
+
+	return npos;
+}
+
+size_t skip_scalar(string_view doc, size_t pos)
+{
+	size_t i = pos;
+	while (i < doc.size() && !strchr(",}] \t\r\n", doc[i]))
+	{
+		++i;
+	}
+
+	return i == pos ? npos : i;
+}
+
+int hex_digit(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+	{
+		return ch - '0';
+	}
+
+	ch |= 0x20;
+	return ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : -1;
+}
+
+bool read_hex4(string_view s, size_t pos, uint32_t& code)
+{
+	if (pos + 4 > s.size())
+	{
+		return false;
+	}
+
+	code = 0;
+	for (size_t i = pos; i < pos + 4; ++i)
+	{
+		const int d = hex_digit(s[i]);
+		if (d < 0)
+		{
+			return false;
+		}
+
+		code = (code << 4) | d;
+	}
+
+	return true;
+}
+
+void append_utf8(std::string& out, uint32_t code)
+{
+	if (code < 0x80)
+	{
+		out.append(1, char(code));
+	}
+	else if (code < 0x800)
+	{
+		out.append(1, char(0xc0 | (code >> 6)));
+		out.append(1, char(0x80 | (code & 0x3f)));
+	}
+	else if (code < 0x10000)
+	{
+		out.append(1, char(0xe0 | (code >> 12)));
+		out.append(1, char(0x80 | ((code >> 6) & 0x3f)));
+		out.append(1, char(0x80 | (code & 0x3f)));
+	}
+	else
+	{
+		out.append(1, char(0xf0 | (code >> 18)));
+		out.append(1, char(0x80 | ((code >> 12) & 0x3f)));
+		out.append(1, char(0x80 | ((code >> 6) & 0x3f)));
+		out.append(1, char(0x80 | (code & 0x3f)));
+	}
+}
+
+// the content of a string without the quotes, false if an escape is broken
+bool unescape(string_view s, std::string& out)
+{
+	out.clear();
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		if (s[i] != '\\')
+		{
+			out.append(1, s[i]);
+			continue;
+		}
+
+		if (++i == s.size())
+		{
+			return false;
+		}
+
+		switch (s[i])
+		{
+		case 'b': out.append(1, '\b'); break;
+		case 'f': out.append(1, '\f'); break;
+		case 'n': out.append(1, '\n'); break;
+		case 'r': out.append(1, '\r'); break;
+		case 't': out.append(1, '\t'); break;
+		case 'u':
+		{
+			uint32_t code = 0;
+			if (!read_hex4(s, i + 1, code))
+			{
+				return false;
+			}
+
+			i += 4;
+
+			// a surrogate pair makes a single code point
+			uint32_t low = 0;
+			if (code >= 0xd800 && code < 0xdc00 && i + 2 < s.size() && s[i + 1] == '\\' && s[i + 2] == 'u'
+				&& read_hex4(s, i + 3, low) && low >= 0xdc00 && low < 0xe000)
+			{
+				code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+				i += 6;
+			}
+
+			append_utf8(out, code);
+			break;
+		}
+		default: out.append(1, s[i]);
+		}
+	}
+
+	return true;
+}
+
+// compares the quoted string at the position with the name, unescaping only
+// the strings that do have escapes in them
+bool string_equals(string_view quoted, string_view expected)
+{
+	const string_view content = quoted.substr(1, quoted.size() - 2);
+	if (content.find('\\') == npos)
+	{
+		return content == expected;
+	}
+
+	std::string unescaped;
+	return unescape(content, unescaped) && unescaped == expected;
+}
+
+// pos is at the value of an object, the position of the value of the member is returned
+size_t find_member(string_view doc, size_t pos, string_view name)
+{
+	if (pos >= doc.size() || doc[pos] != '{')
+	{
+		return npos;
+	}
+
+	pos = skip_space(doc, pos + 1);
+	if (pos < doc.size() && doc[pos] == '}')
+	{
+		return npos;
+	}
+
+	while (pos < doc.size() && doc[pos] == '"')
+	{
+		const size_t key_end = skip_string(doc, pos);
+		if (key_end == npos)
+		{
+			return npos;
+		}
+
+		const bool found = string_equals(doc.substr(pos, key_end - pos), name);
+		pos = skip_space(doc, key_end);
+		if (pos >= doc.size() || doc[pos] != ':')
+		{
+			return npos;
+		}
+
+		pos = skip_space(doc, pos + 1);
+		if (found)
+		{
+			return pos;
+		}
+
+		pos = skip_space(doc, skip_value(doc, pos));
+		if (pos >= doc.size() || doc[pos] != ',')
+		{
+			return npos;
+		}
+
+		pos = skip_space(doc, pos + 1);
+	}
+
+	return npos;
+}
+
+size_t find_element(string_view doc, size_t pos, size_t index)
+{
+	if (pos >= doc.size() || doc[pos] != '[')
+	{
+		return npos;
+	}
+
+	pos = skip_space(doc, pos + 1);
+	if (pos < doc.size() && doc[pos] == ']')
+	{
+		return npos;
+	}
+
+	for (; index; --index)
+	{
+		pos = skip_space(doc, skip_value(doc, pos));
+		if (pos >= doc.size() || doc[pos] != ',')
+		{
+			return npos;
+		}
+
+		pos = skip_space(doc, pos + 1);
+	}
+
+	return pos;
+}
+
+} // namespace
+
+size_t skip_value(string_view doc, size_t pos)
+{
+	if (pos >= doc.size())
+	{
+		return npos;
+	}
+
+	switch (doc[pos])
+	{
+	case '"': return skip_string(doc, pos);
+	case '{': return skip_nested(doc, pos, '{', '}');
+	case '[': return skip_nested(doc, pos, '[', ']');
+	default: return skip_scalar(doc, pos);
+	}
+}
+
+bool select(string_view doc, string_view path, string_view& value)
+{
+	if (!path.empty() && path[0] == '$')
+	{
+		path.remove_prefix(1);
+	}
+
+	size_t pos = skip_space(doc, 0);
+	while (!path.empty() && pos != npos)
+	{
+		if (path[0] == '.')
+		{
+			const size_t end = std::min(path.find('.', 1), path.find('[', 1));
+			pos = find_member(doc, pos, path.substr(1, end - 1));
+			path.remove_prefix(std::min(end, path.size()));
+		}
+		else if (path.size() > 2 && path[0] == '[' && (path[1] == '\'' || path[1] == '"'))
+		{
+			const size_t end = path.find(path[1], 2);
+			if (end == npos || end + 1 >= path.size() || path[end + 1] != ']')
+			{
+				return false;
+			}
+
+			pos = find_member(doc, pos, path.substr(2, end - 2));
+			path.remove_prefix(end + 2);
+		}
+		else if (path[0] == '[')
+		{
+			size_t index = 0;
+			size_t i = 1;
+			for (; i < path.size() && path[i] >= '0' && path[i] <= '9'; ++i)
+			{
+				index = index * 10 + (path[i] - '0');
+			}
+
+			if (i == 1 || i >= path.size() || path[i] != ']')
+			{
+				return false;
+			}
+
+			pos = find_element(doc, pos, index);
+			path.remove_prefix(i + 1);
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	const size_t end = skip_value(doc, pos);
+	if (end == npos)
+	{
+		return false;
+	}
+
+	value = doc.substr(pos, end - pos);
+	return true;
+}
+
+bool equals(string_view value, string_view expected)
+{
+	if (value.size() >= 2 && value[0] == '"')
+	{
+		return string_equals(value, expected);
+	}
+
+	return value == expected;
+}
+
+} // namespace json
+
+} // namespace nemok
@@ -0,0 +1,35 @@
+#pragma once
+#include "server.h"
+
+/*
+	mock.when(nemok::http::POST("/orders").with_json("$.user.id", "42")).reply(201);
+	mock.when(nemok::http::POST("/orders").with_json("$.items[0]['sku']", "A-1")).reply(201);
+
+	the body is never parsed into a tree, the scanner goes through it once and
+	steps over whatever the path doesn't lead into; the bytes of the strings and
+	of the nested values it skips are looked at 16 or 32 at a time, see nemok/scan.h
+*/
+
+namespace nemok
+{
+
+namespace json
+{
+
+// the text of the value the path selects, as it is in the document; false if
+// there's no such value or the document is broken on the way to it.
+// the path is $ followed by any number of .name, ['name'] and [index]
+bool select(string_view document, string_view path, string_view& value);
+
+// whether a selected value is the expected one: a string is compared once
+// unescaped and without the quotes, anything else as it's written, so the
+// number 42 is "42" and not "42.0"; the type isn't looked at, "42" is the
+// string "42" just as well as the number
+bool equals(string_view value, string_view expected);
+
+// where the value starting at pos ends, npos if it doesn't
+size_t skip_value(string_view document, size_t pos);
+
+} // namespace json
+
+} // namespace nemok
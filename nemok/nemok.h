@@ -1,3 +1,15 @@
 #pragma once
 #include "server.h"
 #include "http.h"
+#include "http2.h"
+#include "websocket.h"
+#include "trace.h"
+#include "corpus.h"
+#include "json.h"
+#include "digest.h"
+#include "encoding.h"
+#include "sse.h"
+#include "fanout.h"
+#include "body.h"
+#include "static_mock.h"
+#include "static_regex.h"
@@ -0,0 +1,184 @@
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NEMOK_SCAN_X86
+#endif
+
+#include <cassert>
+
+#include "scan.h"
+
+namespace nemok
+{
+
+namespace scan
+{
+
+namespace
+{
+
+// the first byte of data equal to any of the delimiters or size if there is none
+using kernel_type = size_t (*)(const char* data, size_t size, const char* delims, size_t count);
+
+size_t scalar_find(const char* data, size_t size, const char* delims, size_t count)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		for (size_t j = 0; j < count; ++j)
+		{
+			if (data[i] == delims[j])
+			{
+				return i;
+			}
+		}
+	}
+
+	return size;
+}
+
+#ifdef NEMOK_SCAN_X86
+__attribute__((target("sse2")))
+size_t sse2_find(const char* data, size_t size, const char* delims, size_t count)
+{
+	__m128i needles[4];
+	for (size_t j = 0; j < count; ++j)
+	{
+		needles[j] = _mm_set1_epi8(delims[j]);
+	}
+
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i found = _mm_cmpeq_epi8(chunk, needles[0]);
+		for (size_t j = 1; j < count; ++j)
+		{
+			found = _mm_or_si128(found, _mm_cmpeq_epi8(chunk, needles[j]));
+		}
+
+		const int mask = _mm_movemask_epi8(found);
+		if (mask)
+		{
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	return i + scalar_find(data + i, size - i, delims, count);
+}
+
+__attribute__((target("avx2")))
+size_t avx2_find(const char* data, size_t size, const char* delims, size_t count)
+{
+	__m256i needles[4];
+	for (size_t j = 0; j < count; ++j)
+	{
+		needles[j] = _mm256_set1_epi8(delims[j]);
+	}
+
+	size_t i = 0;
+	for (; i + 32 <= size; i += 32)
+	{
+		const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+		__m256i found = _mm256_cmpeq_epi8(chunk, needles[0]);
+		for (size_t j = 1; j < count; ++j)
+		{
+			found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, needles[j]));
+		}
+
+		const unsigned mask = _mm256_movemask_epi8(found);
+		if (mask)
+		{
+			return i + __builtin_ctz(mask);
+		}
+	}
+
+	// the tail is shorter than a register, let sse2 have a go at it
+	return i + sse2_find(data + i, size - i, delims, count);
+}
+#endif
+
+struct dispatch
+{
+	kernel_type kernel;
+	const char* name;
+};
+
+dispatch pick_kernel()
+{
+#ifdef NEMOK_SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		return {avx2_find, "avx2"};
+	}
+
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return {sse2_find, "sse2"};
+	}
+#endif
+	return {scalar_find, "scalar"};
+}
+
+const dispatch& selected()
+{
+	static const dispatch d = pick_kernel();
+	return d;
+}
+
+size_t find(string_view input, char delim)
+{
+	const size_t pos = selected().kernel(input.data(), input.size(), &delim, 1);
+	return pos == input.size() ? string_view::npos : pos;
+}
+
+// the position of the first CR followed by the rest of the pattern
+size_t find_crlf(string_view input, string_view pattern)
+{
+	size_t offset = 0;
+	while (offset < input.size())
+	{
+		const size_t cr = find(input.substr(offset), '\r');
+		if (cr == string_view::npos)
+		{
+			break;
+		}
+
+		const size_t pos = offset + cr;
+		if (input.substr(pos, pattern.size()) == pattern)
+		{
+			return pos;
+		}
+
+		offset = pos + 1;
+	}
+
+	return string_view::npos;
+}
+
+} // namespace
+
+size_t find_first_of(string_view input, string_view delimiters)
+{
+	assert(!delimiters.empty() && delimiters.size() <= 4);
+	const size_t pos = selected().kernel(input.data(), input.size(), delimiters.data(), delimiters.size());
+	return pos == input.size() ? string_view::npos : pos;
+}
+
+size_t find_line_end(string_view input)
+{
+	return find_crlf(input, "\r\n");
+}
+
+size_t find_head_end(string_view input)
+{
+	return find_crlf(input, "\r\n\r\n");
+}
+
+const char* implementation()
+{
+	return selected().name;
+}
+
+} // namespace scan
+
+} // namespace nemok
@@ -0,0 +1,27 @@
+#pragma once
+#include "server.h"
+
+namespace nemok
+{
+
+// byte scanners for the http framing, 16 or 32 bytes are looked at a time
+// when the cpu supports it, the best implementation is picked at run time
+namespace scan
+{
+
+// the position of the first byte equal to any of the delimiters, npos if there is none;
+// no more than four delimiters are supported
+size_t find_first_of(string_view input, string_view delimiters);
+
+// the position of the first CRLF
+size_t find_line_end(string_view input);
+
+// the position of the first CRLFCRLF, i.e. where the message head ends
+size_t find_head_end(string_view input);
+
+// avx2, sse2 or scalar
+const char* implementation();
+
+} // namespace scan
+
+} // namespace nemok
@@ -227,6 +227,21 @@ void write_client(client& c, std::string buf)
 	c.write(buf.c_str(), buf.size());
 }
 
+void write_generated(client& c, const body_generator& generate, uint64_t size)
+{
+	const size_t piece_size = 64 * 1024;
+	thread_local std::vector<char> buffer(piece_size);
+
+	uint64_t offset = 0;
+	while (offset < size)
+	{
+		const size_t len = static_cast<size_t>(std::min<uint64_t>(piece_size, size - offset));
+		generate(&buffer[0], len, offset);
+		c.write(&buffer[0], len);
+		offset += len;
+	}
+}
+
 std::string read_some(client& cl, size_t len)
 {
 	std::string ret;
@@ -290,6 +305,12 @@ matcher& matcher::exec(action_type&& act)
 	return *this;
 }
 
+matcher& matcher::exec(action::param_func_type&& act)
+{
+	current().act.add(std::move(act));
+	return *this;
+}
+
 matcher& matcher::freeze(useconds_t usec)
 {
 	add_action([=](auto&){::usleep(usec);});
@@ -326,62 +347,185 @@ telnet& telnet::when(std::string input)
 
 telnet& telnet::reply(std::string output)
 {
-	exec([=](auto& c){c.write_all(output.c_str(), output.size());});
+	// shared by every connection rather than copied into each one of them
+	auto shared = std::make_shared<const std::string>(std::move(output));
+	exec([shared](auto& c){c.write_all(shared->data(), shared->size());});
 
 	return *this;
 }
 
+telnet& telnet::reply(body_generator generate, uint64_t size)
+{
+	return exec([generate, size](client& c){write_generated(c, generate, size);});
+}
+
+matcher& matcher::route(std::string key)
+{
+	current().route = std::move(key);
+	return *this;
+}
+
+matcher& matcher::route_by(expect_list::router_type router)
+{
+	_expect.route_by(std::move(router));
+	return *this;
+}
+
 expectation& matcher::current()
 {
 	return _current;
 }
 
 void action::add(func_type func)
+{
+	_list.emplace_back([f = std::move(func)](client& cl, const route_params&){f(cl);});
+}
+
+void action::add(param_func_type func)
 {
 	_list.emplace_back(std::move(func));
 }
 
-void action::fire(client& cl)
+void action::fire(client& cl, const route_params& params)
 {
 	for (auto& f: _list)
 	{
-		f(cl);
+		f(cl, params);
 	}
 }
 
 void expect_list::walk_stream(buffer_type& input, client& cl)
 {
-	if (!input.empty())
+	size_t i = 0;
+	while (i < _groups.size() && !input.empty())
+	{
+		walk_group(_groups[i], input, cl);
+
+		// drop the fired out expectations once they take up half of the group
+		if (_groups[i].inactive * 2 > _groups[i].size() && compact(i))
+		{
+			continue;
+		}
+
+		++i;
+	}
+}
+
+void expect_list::walk_group(group& g, buffer_type& input, client& cl)
+{
+	// keep on firing until none of the group expectations matches the input,
+	// the input is routed anew after every match as it's been consumed
+	bool fired = true;
+	while (fired && !input.empty() && g.inactive < g.size())
+	{
+		fired = false;
+
+		std::string key;
+		if (!g.routes.empty() && _router && _router(input, key))
+		{
+			route_params params;
+			fired = g.routes.visit(key, params, [&](slots& s, const route_params& p)
+			{
+				return walk_slots(g, s, input, cl, p);
+			});
+		}
+
+		if (!fired)
+		{
+			fired = walk_slots(g, g.any_route, input, cl, route_params());
+		}
+	}
+}
+
+bool expect_list::walk_slots(group& g, slots& s, buffer_type& input, client& cl, const route_params& params)
+{
+	const size_t count = s.offsets.size();
+	size_t pos = s.cursor;
+	for (size_t i = 0; i < count; ++i)
+	{
+		expectation& e = _data[g.first + s.offsets[pos]];
+		pos = pos + 1 == count ? 0 : pos + 1;
+
+		if (e.active() && e.trigger(input))
+		{
+			e.fire(cl, params);
+			s.cursor = pos;
+
+			if (!e.active())
+			{
+				g.inactive += 1;
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool expect_list::compact(size_t group_index)
+{
+	group& g = _groups[group_index];
+	const size_t gone = std::numeric_limits<size_t>::max();
+
+	// map the old offsets to the new ones
+	std::vector<size_t> offsets(g.size(), gone);
+	for (size_t i = 0, next = 0; i < g.size(); ++i)
 	{
-		auto l = _data.begin();
-		while (l != _data.end())
+		if (_data[g.first + i].active())
 		{
-			auto e = l->second.begin();
-			while (e != l->second.end())
+			offsets[i] = next++;
+		}
+	}
+
+	// the cursor keeps pointing at the same expectation, or the first one
+	// in case the one it pointed at is now gone
+	auto remap = [&](slots& s)
+	{
+		size_t cursor = 0;
+		size_t kept = 0;
+		for (size_t i = 0; i < s.offsets.size(); ++i)
+		{
+			if (i == s.cursor)
+			{
+				cursor = kept;
+			}
+
+			if (offsets[s.offsets[i]] != gone)
 			{
-				if (e->trigger(input))
-				{
-					e->fire(cl);
-
-					if (!e->active())
-					{
-						l->second.erase(e);
-					}
-					else
-					{
-						expectation temp = std::move(*e);
-						l->second.erase(e);
-						l->second.emplace_back(std::move(temp));	
-					}
-
-					e = l->second.begin();
-					continue;
-				}
-				++e;
+				s.offsets[kept++] = offsets[s.offsets[i]];
 			}
-			++l;
 		}
+
+		s.offsets.resize(kept);
+		s.cursor = cursor == kept ? 0 : cursor;
+	};
+
+	remap(g.any_route);
+	g.routes.for_each(remap);
+
+	const auto first = _data.begin() + g.first;
+	const auto last = _data.begin() + g.last;
+	const auto kept_end = std::remove_if(first, last, [](auto& e){return !e.active();});
+	const size_t removed = last - kept_end;
+	_data.erase(kept_end, last);
+
+	g.last -= removed;
+	g.inactive = 0;
+
+	for (size_t i = group_index + 1; i < _groups.size(); ++i)
+	{
+		_groups[i].first -= removed;
+		_groups[i].last -= removed;
+	}
+
+	if (g.first == g.last)
+	{
+		_groups.erase(_groups.begin() + group_index);
+		return true;
 	}
+
+	return false;
 }
 
 bool expect_list::empty() const
@@ -391,9 +535,46 @@ bool expect_list::empty() const
 
 expectation& expect_list::create(expectation&& e)
 {
-	const int ord = e.order;
-	_data[ord].emplace_back(std::move(e));
-	return _data[ord].back();
+	auto g = std::lower_bound(_groups.begin(), _groups.end(), e.order,
+		[](const group& lhs, int order){return lhs.order < order;});
+
+	if (g == _groups.end() || g->order != e.order)
+	{
+		const size_t pos = g == _groups.end() ? _data.size() : g->first;
+		g = _groups.insert(g, group(e.order, pos));
+	}
+
+	// append to the end of the group, shifting all the following ones
+	const size_t pos = g->last;
+	_data.insert(_data.begin() + pos, std::move(e));
+	g->last += 1;
+	index(*g, pos - g->first);
+
+	// times(0) or less, it never fires but it's dropped along with the fired out ones
+	if (!_data[pos].active())
+	{
+		g->inactive += 1;
+	}
+
+	for (auto i = g + 1; i != _groups.end(); ++i)
+	{
+		i->first += 1;
+		i->last += 1;
+	}
+
+	return _data[pos];
+}
+
+void expect_list::index(group& g, size_t offset)
+{
+	const std::string& route = _data[g.first + offset].route;
+	slots& s = route.empty() ? g.any_route : g.routes[route];
+	s.offsets.push_back(offset);
+}
+
+void expect_list::route_by(router_type router)
+{
+	_router = std::move(router);
 }
 
 bool starts_with::operator ()(buffer_type& input)
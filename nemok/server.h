@@ -4,16 +4,20 @@
 #include <atomic>
 #include <stdexcept>
 #include <future>
+#include <functional>
 #include <list>
 #include <vector>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <experimental/string_view>
 #include <unistd.h>
 #include <algorithm>
 #include <regex.h>
 #include <cstring>
 #include <cassert>
 #include <fcntl.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -64,6 +68,10 @@ namespace nemok
 {
 
 using buffer_type = std::vector<uint8_t>;
+using string_view = std::experimental::string_view;
+
+// makes the next piece of a generated body: size bytes starting at the given offset
+using body_generator = std::function<void(char* buffer, size_t size, uint64_t offset)>;
 
 class exception : public std::exception
 {
@@ -117,6 +125,12 @@ public:
 	not_connected() : exception("client is not connected") {}
 };
 
+class file_too_short : public exception
+{
+public:
+	file_too_short() : exception("file ends before the range to be sent") {}
+};
+
 class socket
 {
 public:
@@ -420,20 +434,43 @@ public:
 	void connect(port_t port);
 	void disconnect();
 	void shutdown();
+
+	// no more writes, the peer is let know by FIN once the data sent is delivered
+	void shutdown_write();
 	void assign(int df);
 
+	// the socket is the caller's to close from then on, the client is left disconnected
+	int release();
+
 	ssize_t read_some(void* buffer, size_t length);
 	ssize_t write_some(const void* buffer, size_t length);
 
+	// same as read_some but the data is left in the socket to be read later
+	ssize_t peek_some(void* buffer, size_t length);
+
+	// count bytes of the file starting at offset, copied by the kernel
+	// straight from the page cache; throws file_too_short if the file has
+	// fewer of them, e.g. it's been truncated since
+	void send_file(int fd, uint64_t offset, uint64_t count);
+
 	bool connected() const;
 
+	// -1 unless connected
+	int fd() const { return _sock; }
+
 	void write_all(const void* buffer, size_t length);
+
+	// the pieces go out in as few writes as the socket allows, one if it has room;
+	// they're advanced past what's been written
+	void write_all(iovec* pieces, size_t count);
 	void read_all(void* buffer, size_t length);
 
 	void write(const void* buffer, size_t len) { write_all(buffer, len); }
 	void read(void* buffer, size_t len) { read_all(buffer, len);}
 
 private:
+	ssize_t receive(void* buffer, size_t length, int flags);
+
 	int _sock = -1;
 };
 
@@ -481,6 +518,10 @@ std::string read_all(client& cl, size_t len);
 std::string read_some(client& cl, size_t len);
 void write_client(client& cl, std::string buf);
 
+// writes a body of the given size piece by piece through a small buffer reused
+// for every piece, a write blocks until the socket has room for it
+void write_generated(client& cl, const body_generator& generate, uint64_t size);
+
 
 // echo server
 class echo : public server
@@ -489,14 +530,277 @@ private:
 	virtual void serve_client(client& c);
 };
 
+// parameters captured by a route pattern, the wildcard one is named *
+using route_params = std::vector<std::pair<std::string, std::string>>;
+
+template <typename F>
+void for_each_route_segment(const std::string& key, F f)
+{
+	size_t pos = 0;
+	while (true)
+	{
+		const size_t end = key.find('/', pos);
+		const bool last = end == std::string::npos;
+		f(pos, (last ? key.size() : end) - pos, last);
+
+		if (last)
+		{
+			break;
+		}
+
+		pos = end + 1;
+	}
+}
+
+inline bool is_route_param(const std::string& key, size_t pos, size_t len)
+{
+	return len >= 2 && key[pos] == '{' && key[pos + len - 1] == '}';
+}
+
+inline bool is_route_wildcard(const std::string& key, size_t pos, size_t len)
+{
+	return len == 1 && key[pos] == '*';
+}
+
+// matches a single route pattern against the key
+inline bool match_route(const std::string& pattern, string_view key)
+{
+	size_t pos = 0;
+	bool matched = true;
+	bool done = false;
+	for_each_route_segment(pattern, [&](size_t ppos, size_t plen, bool plast)
+	{
+		if (done || !matched)
+		{
+			return;
+		}
+
+		if (pos == std::string::npos)
+		{
+			matched = false;
+			return;
+		}
+
+		if (plast && is_route_wildcard(pattern, ppos, plen))
+		{
+			done = true;
+			return;
+		}
+
+		const size_t end = key.find('/', pos);
+		const size_t len = (end == std::string::npos ? key.size() : end) - pos;
+		matched = is_route_param(pattern, ppos, plen) || 0 == key.compare(pos, len, pattern, ppos, plen);
+		pos = end == std::string::npos ? end : end + 1;
+
+		// the pattern is over, so should be the key
+		matched = matched && (!plast || pos == std::string::npos);
+	});
+
+	return matched;
+}
+
+// maps route keys onto values; a key is a '/' separated path and a pattern
+// may have {name} segments matching any single segment and end with
+// a * segment matching the rest of the path
+template <typename T>
+class route_table
+{
+public:
+	static bool is_pattern(const std::string& key)
+	{
+		bool pattern = false;
+		for_each_route_segment(key, [&](size_t pos, size_t len, bool last)
+		{
+			pattern = pattern || is_route_param(key, pos, len) || (last && is_route_wildcard(key, pos, len));
+		});
+		return pattern;
+	}
+
+	// looks the pattern up, inserts a default constructed value if not found
+	T& operator [](const std::string& pattern)
+	{
+		if (!is_pattern(pattern))
+		{
+			return _exact[pattern];
+		}
+
+		size_t n = 0;
+		for_each_route_segment(pattern, [&](size_t pos, size_t len, bool last)
+		{
+			if (last && is_route_wildcard(pattern, pos, len))
+			{
+				n = wildcard_child(n);
+			}
+			else if (is_route_param(pattern, pos, len))
+			{
+				n = param_child(n, pattern.substr(pos + 1, len - 2));
+			}
+			else
+			{
+				n = literal_child(n, pattern.substr(pos, len));
+			}
+		});
+
+		if (_nodes[n].value == npos)
+		{
+			_nodes[n].value = _values.size();
+			_values.emplace_back();
+		}
+
+		return _values[_nodes[n].value];
+	}
+
+	// calls f(value, params) for the routes matching the key until it returns true,
+	// an exact route goes first, then literal segments are preferred to parameters
+	// and parameters are preferred to the wildcard
+	template <typename F>
+	bool visit(const std::string& key, route_params& params, F f)
+	{
+		auto i = _exact.find(key);
+		if (i != _exact.end() && f(i->second, params))
+		{
+			return true;
+		}
+
+		return !_nodes.empty() && visit_node(0, key, 0, params, f);
+	}
+
+	template <typename F>
+	void for_each(F f)
+	{
+		for (auto& i : _exact)
+		{
+			f(i.second);
+		}
+
+		for (auto& v : _values)
+		{
+			f(v);
+		}
+	}
+
+	bool empty() const
+	{
+		return _exact.empty() && _values.empty();
+	}
+
+private:
+	static const size_t npos = std::numeric_limits<size_t>::max();
+
+	struct node
+	{
+		// ordered so that a segment can be looked up without copying it
+		std::map<std::string, size_t, std::less<>> literals;
+		std::vector<std::pair<std::string, size_t>> params;
+		size_t wildcard = npos;
+		size_t value = npos;
+	};
+
+	std::vector<node>& nodes()
+	{
+		if (_nodes.empty())
+		{
+			_nodes.emplace_back();
+		}
+
+		return _nodes;
+	}
+
+	size_t wildcard_child(size_t n)
+	{
+		if (nodes()[n].wildcard == npos)
+		{
+			_nodes.emplace_back();
+			_nodes[n].wildcard = _nodes.size() - 1;
+		}
+
+		return _nodes[n].wildcard;
+	}
+
+	size_t literal_child(size_t n, const std::string& segment)
+	{
+		auto i = nodes()[n].literals.find(segment);
+		if (i != _nodes[n].literals.end())
+		{
+			return i->second;
+		}
+
+		_nodes.emplace_back();
+		return _nodes[n].literals[segment] = _nodes.size() - 1;
+	}
+
+	size_t param_child(size_t n, const std::string& name)
+	{
+		for (auto& p : nodes()[n].params)
+		{
+			if (p.first == name)
+			{
+				return p.second;
+			}
+		}
+
+		_nodes.emplace_back();
+		_nodes[n].params.emplace_back(name, _nodes.size() - 1);
+		return _nodes.size() - 1;
+	}
+
+	template <typename F>
+	bool visit_node(size_t n, string_view key, size_t pos, route_params& params, F& f)
+	{
+		if (pos == npos)
+		{
+			return _nodes[n].value != npos && f(_values[_nodes[n].value], params);
+		}
+
+		const size_t end = key.find('/', pos);
+		const size_t next = end == string_view::npos ? npos : end + 1;
+		const string_view segment = key.substr(pos, end == string_view::npos ? end : end - pos);
+
+		auto i = _nodes[n].literals.find(segment);
+		if (i != _nodes[n].literals.end() && visit_node(i->second, key, next, params, f))
+		{
+			return true;
+		}
+
+		for (auto& p : _nodes[n].params)
+		{
+			params.emplace_back(p.first, segment.to_string());
+			if (visit_node(p.second, key, next, params, f))
+			{
+				return true;
+			}
+			params.pop_back();
+		}
+
+		const size_t wildcard = _nodes[n].wildcard;
+		if (wildcard != npos && _nodes[wildcard].value != npos)
+		{
+			params.emplace_back("*", key.substr(pos).to_string());
+			if (f(_values[_nodes[wildcard].value], params))
+			{
+				return true;
+			}
+			params.pop_back();
+		}
+
+		return false;
+	}
+
+	std::unordered_map<std::string, T> _exact;
+	std::vector<node> _nodes;
+	std::vector<T> _values;
+};
+
 class action
 {
 public:
 	using func_type = std::function<void(client&)>;
+	using param_func_type = std::function<void(client&, const route_params&)>;
 	void add(func_type func);
-	void fire(client& cl);
+	void add(param_func_type func);
+	void fire(client& cl, const route_params& params);
 private:
-	std::list<func_type> _list;
+	std::list<param_func_type> _list;
 };
 
 
@@ -511,9 +815,13 @@ struct expectation
 	int max_calls = std::numeric_limits<int>::max();
 	int order = 100;
 
-	void fire(client& cl)
+	// an expectation bound to a route is only tried against the input the router
+	// maps to a key matching it, an empty one is tried against any input
+	std::string route;
+
+	void fire(client& cl, const route_params& params)
 	{
-		act.fire(cl);
+		act.fire(cl, params);
 		times_fired += 1;
 	}
 
@@ -528,18 +836,50 @@ struct expectation
 	}
 };
 
+// expectations are kept in a single vector sorted by order, every order
+// forms a contiguous group which is walked round-robin starting from its cursor;
+// within a group the routed expectations are indexed by their route key or pattern
+// and always tried before the ones which are not bound to any route
 class expect_list
 {
 public:
+	using router_type = std::function<bool(const buffer_type&, std::string&)>;
 
 	void walk_stream(buffer_type& buf, client& cl);
 	bool empty() const;
 	expectation& create(expectation&& e);
+	void route_by(router_type router);
 
 private:
-	using list = std::list<expectation>;
-	using priority_list = std::map<int, list>;
-	priority_list _data;
+	// a ring of expectations, offsets are relative to the start of the group
+	struct slots
+	{
+		std::vector<size_t> offsets;
+		size_t cursor = 0;
+	};
+
+	struct group
+	{
+		group(int order, size_t pos) : order(order), first(pos), last(pos) {}
+
+		int order = 0;
+		size_t first = 0;
+		size_t last = 0;
+		size_t inactive = 0;
+		slots any_route;
+		route_table<slots> routes;
+
+		size_t size() const { return last - first; }
+	};
+
+	void walk_group(group& g, buffer_type& input, client& cl);
+	bool walk_slots(group& g, slots& s, buffer_type& input, client& cl, const route_params& params);
+	bool compact(size_t group_index);
+	void index(group& g, size_t offset);
+
+	std::vector<expectation> _data;
+	std::vector<group> _groups;
+	router_type _router;
 };
 
 class line
@@ -613,15 +953,6 @@ private:
 	std::string _re_str;
 };
 
-namespace lit
-{
-inline regex operator "" _re(const char* expr, size_t sz)
-{
-	assert(sz == strlen(expr));
-	return regex(expr);
-}
-}
-
 class matcher
 {
 public:
@@ -632,11 +963,14 @@ public:
 
 	matcher& when(trigger_type&& trigger);
 	matcher& exec(action_type&& act);
+	matcher& exec(action::param_func_type&& act);
 	matcher& freeze(useconds_t usec);
 	matcher& once();
 	matcher& times(int n);
 	matcher& order(int n);
 	matcher& close_connection();
+	matcher& route(std::string key);
+	matcher& route_by(expect_list::router_type router);
 
 	void match(buffer_type& input, client& cl);
 
@@ -654,6 +988,7 @@ class basic_mock : public server
 public:
 	using trigger_type = expectation::trigger_type;
 	using action_type = expectation::action_type;
+	using param_action_type = action::param_func_type;
 
 	basic_mock() {}
 	T& when(trigger_type&& trigger)
@@ -668,6 +1003,12 @@ public:
 		return static_cast<T&>(*this);
 	}
 
+	T& exec(param_action_type&& act)
+	{
+		_matcher.exec(std::move(act));
+		return static_cast<T&>(*this);
+	}
+
 	T& shutdown_server()
 	{
 		return exec([=](auto&){this->stop();});
@@ -704,12 +1045,37 @@ public:
 		return static_cast<T&>(*this);
 	}
 
+protected:
+	using router_type = expect_list::router_type;
+
+	T& route(std::string key)
+	{
+		_matcher.route(std::move(key));
+		return static_cast<T&>(*this);
+	}
+
+	void route_by(router_type router)
+	{
+		_matcher.route_by(std::move(router));
+	}
+
+	// whatever a derived mock needs to keep for as long as the connection lasts
+	struct session_type {};
+
+	// called whenever new input arrives, a derived mock may hide it
+	// in order to try its own expectations before the runtime ones
+	void match(buffer_type& input, matcher& m, client& cl, session_type&)
+	{
+		m.match(input, cl);
+	}
+
 private:
 	virtual void serve_client(client& cl)
 	{
 		buffer_type input;
 		buffer_type buffer(1024);
 		matcher matcher_copy = _matcher;
+		typename T::session_type session;
 		ssize_t bytes = 0;
 		do
 		{
@@ -717,7 +1083,7 @@ private:
 			if (bytes > 0)
 			{
 				input.insert(input.end(), &buffer[0], &buffer[0] + bytes); 
-				matcher_copy.match(input, cl);
+				static_cast<T&>(*this).match(input, matcher_copy, cl, session);
 			}
 		}
 		while (bytes > 0); // zero value mark end of stream
@@ -737,6 +1103,9 @@ public:
 	telnet& reply(std::string output);
 	telnet& reply_once(std::string output);
 
+	// size bytes made by the generator, see nemok/body.h
+	telnet& reply(body_generator generate, uint64_t size);
+
 	using base_type::when;
 };
 
@@ -0,0 +1,180 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "sse.h"
+
+namespace nemok
+{
+
+namespace sse
+{
+
+std::string event(string_view data, string_view type, string_view id)
+{
+	std::string ret;
+	ret.reserve(data.size() + type.size() + id.size() + 32);
+	if (!type.empty())
+	{
+		ret.append("event: ").append(type.data(), type.size()).append(1, '\n');
+	}
+
+	if (!id.empty())
+	{
+		ret.append("id: ").append(id.data(), id.size()).append(1, '\n');
+	}
+
+	// a line may end with CRLF, LF or CR alone
+	while (true)
+	{
+		const size_t end = data.find_first_of("\r\n");
+		ret.append("data: ").append(data.data(), std::min(end, data.size())).append(1, '\n');
+		if (end == string_view::npos)
+		{
+			break;
+		}
+
+		const bool crlf = data[end] == '\r' && end + 1 < data.size() && data[end + 1] == '\n';
+		data.remove_prefix(end + (crlf ? 2 : 1));
+	}
+
+	return ret.append(1, '\n');
+}
+
+} // namespace sse
+
+event_hub::~event_hub()
+{
+	poller_.stop();
+	for (auto& s : subscribers_)
+	{
+		::close(s.first);
+	}
+}
+
+void event_hub::subscribe(int fd, std::shared_ptr<const std::string> head)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	// whatever the subscriber sends is read and thrown away, that's how it's
+	// known to have gone
+	if (!poller_.watch(fd, EPOLLIN | EPOLLRDHUP))
+	{
+		::close(fd);
+		throw system_error("can't watch a subscriber");
+	}
+
+	subscriber& s = subscribers_[fd];
+	s.pending.push(std::move(head));
+	flush(fd, s);
+}
+
+// the event goes to the end of every queue; those which were empty, which is
+// all of them unless a subscriber is slow, are written to right away
+void event_hub::broadcast(std::shared_ptr<const std::string> event)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& entry : subscribers_)
+	{
+		subscriber& s = entry.second;
+		if (s.broken)
+		{
+			continue;
+		}
+
+		s.pending.push(event);
+		if (s.pending.size() > max_pending)
+		{
+			s.broken = true;
+			::shutdown(entry.first, SHUT_RDWR);
+		}
+		else if (!s.waiting)
+		{
+			flush(entry.first, s);
+		}
+	}
+}
+
+size_t event_hub::size()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return subscribers_.size();
+}
+
+bool event_hub::flush(int fd, subscriber& s)
+{
+	switch (s.pending.flush(fd))
+	{
+		case outbox::blocked:
+			wait_for_room(fd, s, true);
+			return true;
+
+		case outbox::failed:
+			s.broken = true;
+			return false;
+
+		default:
+			wait_for_room(fd, s, false);
+			return true;
+	}
+}
+
+void event_hub::wait_for_room(int fd, subscriber& s, bool wait)
+{
+	if (s.waiting == wait)
+	{
+		return;
+	}
+
+	poller_.watch(fd, EPOLLIN | EPOLLRDHUP | (wait ? uint32_t(EPOLLOUT) : 0));
+	s.waiting = wait;
+}
+
+void event_hub::drop(int fd)
+{
+	poller_.forget(fd);
+	::close(fd);
+	subscribers_.erase(fd);
+}
+
+// the only place the sockets are closed, so a descriptor the events are
+// reported for can't have been reused by a subscriber that came later
+void event_hub::handle(const epoll_event* events, int count)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (int i = 0; i < count; ++i)
+	{
+		const int fd = events[i].data.fd;
+		auto it = subscribers_.find(fd);
+		if (it == subscribers_.end())
+		{
+			continue;
+		}
+
+		subscriber& s = it->second;
+		if (s.broken || (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)))
+		{
+			drop(fd);
+			continue;
+		}
+
+		if (events[i].events & EPOLLIN)
+		{
+			char buffer[1024];
+			const ssize_t bytes = ::read(fd, buffer, sizeof(buffer));
+			if (bytes == 0 || (bytes == -1 && errno != EAGAIN && errno != EINTR))
+			{
+				drop(fd);
+				continue;
+			}
+		}
+
+		if ((events[i].events & EPOLLOUT) && !flush(fd, s))
+		{
+			drop(fd);
+		}
+	}
+}
+
+} // namespace nemok
@@ -0,0 +1,76 @@
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include "server.h"
+#include "fanout.h"
+
+/*
+	auto mock = nemok::start<nemok::http>();
+	auto& feed = mock.when(nemok::http::GET("/events")).subscribe_events();
+	mock.when(nemok::http::POST("/notify")).publish_event("refresh", "reload").reply(204);
+	...
+	feed.broadcast_event("{\"id\":1}", "created");
+
+	a subscription answers the request with a text/event-stream response which lasts
+	as long as the connection does; the connection is handed over to the event hub
+	of the mock and its thread is done with, one thread of the hub serves every
+	subscriber however many there are; an event is formatted once and the same
+	buffer is written to each of them
+*/
+
+namespace nemok
+{
+
+namespace sse
+{
+
+// the event the way it goes on the wire, a data line for every line of the data
+std::string event(string_view data, string_view type = string_view(), string_view id = string_view());
+
+} // namespace sse
+
+// the subscribers of a mock; the writes are non-blocking, what a subscriber
+// can't take yet is kept as references to the shared buffers until it can
+class event_hub
+{
+public:
+	// a subscriber with as many events waiting is too slow, it's disconnected
+	static const size_t max_pending = 4096;
+
+	event_hub() {}
+	~event_hub();
+
+	event_hub(const event_hub&) = delete;
+	event_hub& operator =(const event_hub&) = delete;
+
+	// the socket is the hub's from then on, the head goes before any event
+	void subscribe(int fd, std::shared_ptr<const std::string> head);
+
+	void broadcast(std::shared_ptr<const std::string> event);
+
+	size_t size();
+
+private:
+	struct subscriber
+	{
+		outbox pending;
+
+		// waiting for the socket to have room
+		bool waiting = false;
+
+		// gone or too slow, it's dropped by the thread of the hub
+		bool broken = false;
+	};
+
+	// false if the subscriber is broken
+	bool flush(int fd, subscriber& s);
+	void wait_for_room(int fd, subscriber& s, bool wait);
+	void drop(int fd);
+	void handle(const epoll_event* events, int count);
+
+	std::mutex mutex_;
+	std::unordered_map<int, subscriber> subscribers_;
+	poller poller_{[this](const epoll_event* events, int count){handle(events, count);}};
+};
+
+} // namespace nemok
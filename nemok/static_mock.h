@@ -0,0 +1,207 @@
+#pragma once
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include "server.h"
+
+/*
+	using namespace nemok::lit;
+	using namespace nemok::fixed;
+
+	using ping = nemok::static_mock<
+		starts_with<decltype("PING"_s)>,
+		reply<decltype("PONG"_s)>>;
+
+	using chat = nemok::static_mock<
+		rule<starts_with<decltype("PING"_s)>, reply<decltype("PONG"_s)>>,
+		rule<starts_with<decltype("QUIT"_s)>, close_connection>>;
+
+	auto mock = nemok::start<chat>();
+	mock.when("HELP").reply("no help");
+*/
+
+namespace nemok
+{
+
+// a string known at compile time
+template <char... Cs>
+struct chars
+{
+	static constexpr size_t size = sizeof...(Cs);
+	static constexpr char value[sizeof...(Cs) + 1] = {Cs..., '\0'};
+};
+
+template <char... Cs>
+constexpr char chars<Cs...>::value[sizeof...(Cs) + 1];
+
+namespace lit
+{
+template <typename Char, Char... Cs>
+constexpr chars<Cs...> operator "" _s()
+{
+	return chars<Cs...>();
+}
+}
+
+// triggers and actions known at compile time; every one of them may also be
+// used at run time, e.g. mock.when(fixed::starts_with<...>())
+namespace fixed
+{
+
+template <typename String>
+struct starts_with
+{
+	bool operator ()(buffer_type& input) const
+	{
+		if (input.size() >= String::size && 0 == memcmp(&input[0], String::value, String::size))
+		{
+			input.erase(input.begin(), input.begin() + String::size);
+			return true;
+		}
+
+		return false;
+	}
+};
+
+struct any_line
+{
+	bool operator ()(buffer_type& input) const
+	{
+		auto newline = std::find(input.begin(), input.end(), uint8_t('\n'));
+		if (newline != input.end())
+		{
+			input.erase(input.begin(), ++newline);
+			return true;
+		}
+
+		return false;
+	}
+};
+
+template <typename String>
+struct reply
+{
+	void operator ()(client& cl) const
+	{
+		cl.write_all(String::value, String::size);
+	}
+};
+
+template <useconds_t usec>
+struct freeze
+{
+	void operator ()(client&) const
+	{
+		::usleep(usec);
+	}
+};
+
+struct close_connection
+{
+	void operator ()(client& cl) const
+	{
+		cl.disconnect();
+	}
+};
+
+template <typename Trigger, typename... Actions>
+class rule
+{
+public:
+	bool operator ()(buffer_type& input, client& cl)
+	{
+		if (!_trigger(input))
+		{
+			return false;
+		}
+
+		fire(cl, std::index_sequence_for<Actions...>());
+		return true;
+	}
+
+private:
+	template <size_t... I>
+	void fire(client& cl, std::index_sequence<I...>)
+	{
+		using expand = int[];
+		(void)expand{0, (std::get<I>(_actions)(cl), 0)...};
+	}
+
+	Trigger _trigger;
+	std::tuple<Actions...> _actions;
+};
+
+template <typename T>
+struct is_rule : std::false_type {};
+
+template <typename... Ts>
+struct is_rule<rule<Ts...>> : std::true_type {};
+
+// static_mock<trigger, actions...> is a shorthand for static_mock<rule<trigger, actions...>>
+template <typename First, typename... Rest>
+struct rules_of
+{
+	using type = typename std::conditional<is_rule<First>::value,
+		std::tuple<First, Rest...>,
+		std::tuple<rule<First, Rest...>>>::type;
+};
+
+} // namespace fixed
+
+// a mock with the expectations fixed at compile time, the rules are tried
+// in the order given before any of the run time expectations is
+template <typename... Rules>
+class static_mock : public basic_mock<static_mock<Rules...>>
+{
+public:
+	using base_type = basic_mock<static_mock<Rules...>>;
+
+	static_mock() {}
+
+	static_mock& when(std::string input)
+	{
+		return base_type::when(nemok::starts_with(std::move(input)));
+	}
+
+	static_mock& reply(std::string output)
+	{
+		return base_type::exec([=](auto& c){c.write_all(output.c_str(), output.size());});
+	}
+
+	using base_type::when;
+
+private:
+	friend base_type;
+	using rules_type = typename fixed::rules_of<Rules...>::type;
+	static const size_t rule_count = std::tuple_size<rules_type>::value;
+
+	void match(buffer_type& input, matcher& m, client& cl, typename base_type::session_type&)
+	{
+		// go on until neither the rules nor the run time expectations consume anything
+		rules_type rules;
+		size_t left = 0;
+		do
+		{
+			left = input.size();
+			while (!input.empty() && walk(rules, input, cl, std::integral_constant<size_t, 0>()))
+			{
+			}
+
+			m.match(input, cl);
+		}
+		while (!input.empty() && input.size() != left);
+	}
+
+	template <size_t I>
+	static bool walk(rules_type& rules, buffer_type& input, client& cl, std::integral_constant<size_t, I>)
+	{
+		return std::get<I>(rules)(input, cl) || walk(rules, input, cl, std::integral_constant<size_t, I + 1>());
+	}
+
+	static bool walk(rules_type&, buffer_type&, client&, std::integral_constant<size_t, rule_count>)
+	{
+		return false;
+	}
+};
+
+} // namespace nemok
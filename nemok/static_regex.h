@@ -0,0 +1,802 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "static_mock.h"
+
+/*
+	using namespace nemok::lit;
+
+	mock.when("[a-z]+\n"_re).reply("done\n");
+	mock.when("(GET|HEAD) /[^ ]*"_re).reply("done\n");
+
+	The pattern is a POSIX extended regular expression compiled along with
+	the test, a malformed one fails the build. Same as regexec, the leftmost
+	longest match is looked for anywhere in the input, the input is consumed
+	up to the end of it. Empty matches are never reported.
+*/
+
+namespace nemok
+{
+namespace re
+{
+
+enum error_code
+{
+	no_error,
+	unbalanced_parenthesis,
+	unbalanced_bracket,
+	nothing_to_repeat,
+	bad_repetition,
+	bad_escape,
+	bad_range,
+	bad_class,
+	too_complex
+};
+
+const int infinite = -1;
+const int max_repetitions = 255;
+const size_t max_program_size = 1 << 14;
+
+struct char_set
+{
+	uint64_t bits[4] = {0, 0, 0, 0};
+
+	constexpr void add(unsigned char ch)
+	{
+		bits[ch >> 6] |= uint64_t(1) << (ch & 63);
+	}
+
+	constexpr void add(unsigned char lo, unsigned char hi)
+	{
+		for (int ch = lo; ch <= hi; ++ch)
+		{
+			add(static_cast<unsigned char>(ch));
+		}
+	}
+
+	constexpr void invert()
+	{
+		for (auto& b : bits)
+		{
+			b = ~b;
+		}
+	}
+
+	constexpr bool has(unsigned char ch) const
+	{
+		return 0 != (bits[ch >> 6] & (uint64_t(1) << (ch & 63)));
+	}
+};
+
+enum node_type
+{
+	node_empty,
+	node_char,
+	node_any,
+	node_set,
+	node_bol,
+	node_eol,
+	node_cat,
+	node_alt,
+	node_repeat
+};
+
+struct node
+{
+	node_type type = node_empty;
+	unsigned char ch = 0;
+	char_set set;
+	int left = -1;
+	int right = -1;
+	int min = 0;
+	int max = 0;
+};
+
+template <size_t Capacity>
+struct syntax_tree
+{
+	node nodes[Capacity];
+	int count = 0;
+	int root = -1;
+	error_code error = no_error;
+
+	// the number of instructions needed to match the tree, the final match included
+	constexpr size_t code_size() const
+	{
+		return error == no_error ? code_size(root) + 1 : 1;
+	}
+
+	constexpr size_t code_size(int n) const
+	{
+		const node& nd = nodes[n];
+		switch (nd.type)
+		{
+		case node_empty: return 0;
+		case node_cat: return code_size(nd.left) + code_size(nd.right);
+		case node_alt: return 2 + code_size(nd.left) + code_size(nd.right);
+		case node_repeat:
+			return nd.min * code_size(nd.left) + (nd.max == infinite
+				? 2 + code_size(nd.left)
+				: (nd.max - nd.min) * (1 + code_size(nd.left)));
+		default: return 1;
+		}
+	}
+};
+
+constexpr bool equal(const char* lhs, size_t len, const char* rhs)
+{
+	size_t i = 0;
+	for (; i < len && rhs[i] != '\0'; ++i)
+	{
+		if (lhs[i] != rhs[i])
+		{
+			return false;
+		}
+	}
+
+	return i == len && rhs[i] == '\0';
+}
+
+// a recursive descent parser of POSIX extended regular expressions
+template <size_t Capacity>
+class parser
+{
+public:
+	constexpr parser(const char* pattern, size_t len)
+		: p_(pattern), len_(len)
+	{
+	}
+
+	constexpr syntax_tree<Capacity> parse()
+	{
+		tree_.root = parse_alt();
+		if (!failed() && pos_ != len_)
+		{
+			fail(unbalanced_parenthesis);
+		}
+
+		return tree_;
+	}
+
+private:
+	constexpr bool failed() const
+	{
+		return tree_.error != no_error;
+	}
+
+	constexpr int fail(error_code error)
+	{
+		if (!failed())
+		{
+			tree_.error = error;
+		}
+
+		return 0;
+	}
+
+	constexpr bool next_is(char ch) const
+	{
+		return pos_ < len_ && p_[pos_] == ch;
+	}
+
+	constexpr int add(node n)
+	{
+		if (tree_.count == static_cast<int>(Capacity))
+		{
+			return fail(too_complex);
+		}
+
+		tree_.nodes[tree_.count] = n;
+		return tree_.count++;
+	}
+
+	constexpr int add(node_type type, int left = -1, int right = -1)
+	{
+		node n;
+		n.type = type;
+		n.left = left;
+		n.right = right;
+		return add(n);
+	}
+
+	constexpr int parse_alt()
+	{
+		int left = parse_cat();
+		while (!failed() && next_is('|'))
+		{
+			++pos_;
+			const int right = parse_cat();
+			left = add(node_alt, left, right);
+		}
+
+		return left;
+	}
+
+	constexpr int parse_cat()
+	{
+		int left = -1;
+		while (!failed() && pos_ < len_ && !next_is('|') && !next_is(')'))
+		{
+			const int right = parse_repeat();
+			left = left < 0 ? right : add(node_cat, left, right);
+		}
+
+		return left < 0 ? add(node_empty) : left;
+	}
+
+	constexpr int parse_repeat()
+	{
+		int atom = parse_atom();
+		while (!failed() && pos_ < len_)
+		{
+			node n;
+			n.type = node_repeat;
+			n.left = atom;
+
+			switch (p_[pos_])
+			{
+			case '*': n.min = 0; n.max = infinite; ++pos_; break;
+			case '+': n.min = 1; n.max = infinite; ++pos_; break;
+			case '?': n.min = 0; n.max = 1; ++pos_; break;
+			case '{': parse_bounds(n); break;
+			default: return atom;
+			}
+
+			atom = add(n);
+		}
+
+		return atom;
+	}
+
+	// {n}, {n,} or {n,m}
+	constexpr void parse_bounds(node& n)
+	{
+		++pos_;
+		n.min = parse_number();
+		n.max = n.min;
+
+		if (next_is(','))
+		{
+			++pos_;
+			n.max = next_is('}') ? infinite : parse_number();
+		}
+
+		if (!next_is('}') || n.min < 0 || (n.max != infinite && (n.max < n.min || n.max > max_repetitions)))
+		{
+			fail(bad_repetition);
+			return;
+		}
+
+		++pos_;
+	}
+
+	constexpr int parse_number()
+	{
+		if (pos_ == len_ || p_[pos_] < '0' || p_[pos_] > '9')
+		{
+			return -1;
+		}
+
+		int number = 0;
+		for (; pos_ < len_ && p_[pos_] >= '0' && p_[pos_] <= '9'; ++pos_)
+		{
+			number = number * 10 + (p_[pos_] - '0');
+			if (number > max_repetitions)
+			{
+				return -1;
+			}
+		}
+
+		return number;
+	}
+
+	constexpr int parse_atom()
+	{
+		const char ch = p_[pos_++];
+		switch (ch)
+		{
+		case '(':
+		{
+			const int inner = parse_alt();
+			if (!next_is(')'))
+			{
+				return fail(unbalanced_parenthesis);
+			}
+
+			++pos_;
+			return inner;
+		}
+		case '[': return parse_bracket();
+		case '.': return add(node_any);
+		case '^': return add(node_bol);
+		case '$': return add(node_eol);
+		case '*':
+		case '+':
+		case '?':
+		case '{': return fail(nothing_to_repeat);
+		case '\\':
+			if (pos_ == len_)
+			{
+				return fail(bad_escape);
+			}
+			return add_char(p_[pos_++]);
+		default: return add_char(ch);
+		}
+	}
+
+	constexpr int add_char(char ch)
+	{
+		node n;
+		n.type = node_char;
+		n.ch = static_cast<unsigned char>(ch);
+		return add(n);
+	}
+
+	// the opening bracket has been consumed already
+	constexpr int parse_bracket()
+	{
+		node n;
+		n.type = node_set;
+
+		const bool negate = next_is('^');
+		if (negate)
+		{
+			++pos_;
+		}
+
+		for (bool first = true; ; first = false)
+		{
+			if (pos_ == len_)
+			{
+				return fail(unbalanced_bracket);
+			}
+
+			const unsigned char lo = p_[pos_];
+			if (lo == ']' && !first)
+			{
+				++pos_;
+				break;
+			}
+
+			if (lo == '[' && pos_ + 1 < len_ && p_[pos_ + 1] == ':')
+			{
+				parse_class(n.set);
+				if (failed())
+				{
+					return 0;
+				}
+				continue;
+			}
+
+			++pos_;
+			if (next_is('-') && pos_ + 1 < len_ && p_[pos_ + 1] != ']')
+			{
+				const unsigned char hi = p_[pos_ + 1];
+				if (hi < lo)
+				{
+					return fail(bad_range);
+				}
+
+				n.set.add(lo, hi);
+				pos_ += 2;
+			}
+			else
+			{
+				n.set.add(lo);
+			}
+		}
+
+		if (negate)
+		{
+			n.set.invert();
+		}
+
+		return add(n);
+	}
+
+	// [:name:]
+	constexpr void parse_class(char_set& set)
+	{
+		const size_t name = pos_ + 2;
+		size_t end = name;
+		while (end + 1 < len_ && !(p_[end] == ':' && p_[end + 1] == ']'))
+		{
+			++end;
+		}
+
+		if (end + 1 >= len_)
+		{
+			fail(unbalanced_bracket);
+			return;
+		}
+
+		const char* const str = p_ + name;
+		const size_t len = end - name;
+		if (equal(str, len, "alpha") || equal(str, len, "alnum") || equal(str, len, "upper"))
+		{
+			set.add('A', 'Z');
+		}
+		if (equal(str, len, "alpha") || equal(str, len, "alnum") || equal(str, len, "lower"))
+		{
+			set.add('a', 'z');
+		}
+		if (equal(str, len, "digit") || equal(str, len, "alnum") || equal(str, len, "xdigit"))
+		{
+			set.add('0', '9');
+		}
+
+		if (equal(str, len, "xdigit"))
+		{
+			set.add('a', 'f');
+			set.add('A', 'F');
+		}
+		else if (equal(str, len, "space"))
+		{
+			set.add(' ');
+			set.add('\t', '\r');
+		}
+		else if (equal(str, len, "blank"))
+		{
+			set.add(' ');
+			set.add('\t');
+		}
+		else if (equal(str, len, "punct"))
+		{
+			set.add('!', '/');
+			set.add(':', '@');
+			set.add('[', '`');
+			set.add('{', '~');
+		}
+		else if (!equal(str, len, "alpha") && !equal(str, len, "alnum") && !equal(str, len, "upper")
+			&& !equal(str, len, "lower") && !equal(str, len, "digit"))
+		{
+			fail(bad_class);
+			return;
+		}
+
+		pos_ = end + 2;
+	}
+
+	const char* p_;
+	size_t len_;
+	size_t pos_ = 0;
+	syntax_tree<Capacity> tree_;
+};
+
+enum opcode
+{
+	op_char,
+	op_any,
+	op_set,
+	op_split,
+	op_jmp,
+	op_bol,
+	op_eol,
+	op_match
+};
+
+struct instruction
+{
+	opcode op = op_match;
+	unsigned char ch = 0;
+	char_set set;
+	int x = 0;
+	int y = 0;
+};
+
+template <size_t Size>
+struct program
+{
+	instruction code[Size];
+	size_t size = 0;
+};
+
+// Thompson's construction, the tree is laid out as a program for a Pike VM
+template <size_t Size, size_t Capacity>
+constexpr void emit(program<Size>& prog, const syntax_tree<Capacity>& tree, int n)
+{
+	const node& nd = tree.nodes[n];
+	switch (nd.type)
+	{
+	case node_empty:
+		break;
+	case node_char:
+		prog.code[prog.size].op = op_char;
+		prog.code[prog.size++].ch = nd.ch;
+		break;
+	case node_any:
+		prog.code[prog.size++].op = op_any;
+		break;
+	case node_set:
+		prog.code[prog.size].op = op_set;
+		prog.code[prog.size++].set = nd.set;
+		break;
+	case node_bol:
+		prog.code[prog.size++].op = op_bol;
+		break;
+	case node_eol:
+		prog.code[prog.size++].op = op_eol;
+		break;
+	case node_cat:
+		emit(prog, tree, nd.left);
+		emit(prog, tree, nd.right);
+		break;
+	case node_alt:
+	{
+		const int split = prog.size++;
+		emit(prog, tree, nd.left);
+		const int jmp = prog.size++;
+		emit(prog, tree, nd.right);
+
+		prog.code[split].op = op_split;
+		prog.code[split].x = split + 1;
+		prog.code[split].y = jmp + 1;
+		prog.code[jmp].op = op_jmp;
+		prog.code[jmp].x = prog.size;
+		break;
+	}
+	case node_repeat:
+	{
+		for (int i = 0; i < nd.min; ++i)
+		{
+			emit(prog, tree, nd.left);
+		}
+
+		if (nd.max == infinite)
+		{
+			const int split = prog.size++;
+			emit(prog, tree, nd.left);
+			prog.code[prog.size].op = op_jmp;
+			prog.code[prog.size++].x = split;
+
+			prog.code[split].op = op_split;
+			prog.code[split].x = split + 1;
+			prog.code[split].y = prog.size;
+		}
+		else
+		{
+			// every optional copy may be skipped up to the end of the whole repetition
+			int splits[max_repetitions] = {};
+			for (int i = 0; i < nd.max - nd.min; ++i)
+			{
+				splits[i] = prog.size++;
+				emit(prog, tree, nd.left);
+			}
+
+			for (int i = 0; i < nd.max - nd.min; ++i)
+			{
+				prog.code[splits[i]].op = op_split;
+				prog.code[splits[i]].x = splits[i] + 1;
+				prog.code[splits[i]].y = prog.size;
+			}
+		}
+		break;
+	}
+	}
+}
+
+template <size_t Size, size_t Capacity>
+constexpr program<Size> compile(const syntax_tree<Capacity>& tree)
+{
+	program<Size> prog;
+	if (tree.error == no_error)
+	{
+		emit(prog, tree, tree.root);
+	}
+
+	prog.code[prog.size++].op = op_match;
+	return prog;
+}
+
+template <typename Pattern>
+constexpr syntax_tree<2 * Pattern::size + 2> parse()
+{
+	return parser<2 * Pattern::size + 2>(Pattern::value, Pattern::size).parse();
+}
+
+// what a search works with, some 50 bytes an instruction which is too much
+// for the stack once a program is large; a thread has one for every program
+// size, allocated by its first search
+template <size_t Size>
+struct search_state
+{
+	struct thread
+	{
+		int pc;
+		size_t start;
+	};
+
+	// threads are kept sorted by their start, so the leftmost ones go first
+	struct thread_list
+	{
+		std::vector<thread> threads = std::vector<thread>(Size);
+		size_t count = 0;
+		size_t generation = 0;
+	};
+
+	std::vector<size_t> marks = std::vector<size_t>(Size);
+	std::vector<int> stack = std::vector<int>(2 * Size + 1);
+	thread_list lists[2];
+
+	// goes on from one search to the next, so the marks never need clearing
+	size_t generation = 1;
+};
+
+// looks for the leftmost longest match simulating all the threads in lockstep,
+// every byte of the input is looked at once
+template <size_t Size>
+bool search(const program<Size>& prog, const uint8_t* input, size_t len, size_t& match_begin, size_t& match_end)
+{
+	using thread = typename search_state<Size>::thread;
+	using thread_list = typename search_state<Size>::thread_list;
+
+	static thread_local search_state<Size> state;
+	auto& marks = state.marks;
+	auto& stack = state.stack;
+	size_t& generation = state.generation;
+	const size_t none = std::numeric_limits<size_t>::max();
+	size_t best_start = none;
+	size_t best_end = none;
+
+	auto add = [&](thread_list& list, int pc, size_t start, size_t pos)
+	{
+		size_t top = 0;
+		stack[top++] = pc;
+		while (top > 0)
+		{
+			const int i = stack[--top];
+			if (marks[i] == list.generation)
+			{
+				continue;
+			}
+
+			marks[i] = list.generation;
+			const instruction& in = prog.code[i];
+			switch (in.op)
+			{
+			case op_jmp:
+				stack[top++] = in.x;
+				break;
+			case op_split:
+				stack[top++] = in.y;
+				stack[top++] = in.x;
+				break;
+			case op_bol:
+				if (pos == 0)
+				{
+					stack[top++] = i + 1;
+				}
+				break;
+			case op_eol:
+				if (pos == len)
+				{
+					stack[top++] = i + 1;
+				}
+				break;
+			default:
+				list.threads[list.count++] = thread{i, start};
+			}
+		}
+	};
+
+	thread_list* current = &state.lists[0];
+	thread_list* next = &state.lists[1];
+	current->count = 0;
+	current->generation = generation++;
+
+	for (size_t pos = 0; ; ++pos)
+	{
+		if (best_start == none)
+		{
+			add(*current, 0, pos, pos);
+		}
+
+		if (current->count == 0)
+		{
+			break;
+		}
+
+		next->count = 0;
+		next->generation = generation++;
+
+		for (size_t i = 0; i < current->count; ++i)
+		{
+			const thread t = current->threads[i];
+			if (best_start != none && t.start > best_start)
+			{
+				break;
+			}
+
+			const instruction& in = prog.code[t.pc];
+			bool step = false;
+			switch (in.op)
+			{
+			case op_match:
+				if (best_start == none || t.start < best_start || pos > best_end)
+				{
+					best_start = t.start;
+					best_end = pos;
+				}
+				break;
+			case op_char: step = pos < len && input[pos] == in.ch; break;
+			case op_any: step = pos < len; break;
+			case op_set: step = pos < len && in.set.has(input[pos]); break;
+			default: break;
+			}
+
+			if (step)
+			{
+				add(*next, t.pc + 1, t.start, pos + 1);
+			}
+		}
+
+		if (pos == len)
+		{
+			break;
+		}
+
+		std::swap(current, next);
+	}
+
+	if (best_start == none || best_start == best_end)
+	{
+		return false;
+	}
+
+	match_begin = best_start;
+	match_end = best_end;
+	return true;
+}
+
+} // namespace re
+
+// a regular expression compiled along with the program, see the top of the file
+template <typename Pattern>
+class static_regex
+{
+public:
+	static constexpr re::syntax_tree<2 * Pattern::size + 2> tree = re::parse<Pattern>();
+
+	static_assert(tree.error != re::unbalanced_parenthesis, "regex: unbalanced parenthesis");
+	static_assert(tree.error != re::unbalanced_bracket, "regex: unbalanced bracket");
+	static_assert(tree.error != re::nothing_to_repeat, "regex: nothing to repeat");
+	static_assert(tree.error != re::bad_repetition, "regex: invalid repetition bounds");
+	static_assert(tree.error != re::bad_escape, "regex: trailing backslash");
+	static_assert(tree.error != re::bad_range, "regex: invalid character range");
+	static_assert(tree.error != re::bad_class, "regex: unknown character class");
+	static_assert(tree.error != re::too_complex, "regex: pattern is too complex");
+
+	static constexpr size_t code_size = tree.code_size();
+	static_assert(code_size <= re::max_program_size, "regex: pattern is too complex");
+
+	static bool search(const uint8_t* input, size_t len, size_t& match_begin, size_t& match_end)
+	{
+		static constexpr re::program<code_size> prog = re::compile<code_size>(tree);
+		return re::search(prog, input, len, match_begin, match_end);
+	}
+
+	bool operator ()(buffer_type& input) const
+	{
+		size_t match_begin = 0;
+		size_t match_end = 0;
+		if (!input.empty() && search(&input[0], input.size(), match_begin, match_end))
+		{
+			input.erase(input.begin(), input.begin() + match_end);
+			return true;
+		}
+
+		return false;
+	}
+};
+
+namespace lit
+{
+template <typename Char, Char... Cs>
+constexpr static_regex<chars<Cs...>> operator "" _re()
+{
+	return static_regex<chars<Cs...>>();
+}
+}
+
+} // namespace nemok
@@ -0,0 +1,304 @@
+#include <fstream>
+#include <iterator>
+
+#include "trace.h"
+#include "wire.h"
+
+namespace nemok
+{
+
+namespace trace_log
+{
+
+namespace
+{
+
+const char magic[] = "NEMOKTR1";
+const size_t magic_size = sizeof(magic) - 1;
+
+uint64_t microseconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+void append_varint(std::string& out, uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.append(1, char(value | 0x80));
+		value >>= 7;
+	}
+
+	out.append(1, char(value));
+}
+
+bool read_varint(string_view& in, uint64_t& value)
+{
+	value = 0;
+	for (size_t i = 0; i < in.size() && i < 10; ++i)
+	{
+		const uint8_t byte = in[i];
+		value |= uint64_t(byte & 0x7f) << (7 * i);
+		if (!(byte & 0x80))
+		{
+			in.remove_prefix(i + 1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+writer::writer(const std::string& path)
+{
+	file_ = ::fopen(path.c_str(), "ab");
+	if (!file_)
+	{
+		throw log_error("can't open the trace log");
+	}
+
+	// a log is only started once, the sessions that follow are appended to it
+	if (::ftell(file_) == 0)
+	{
+		::fwrite(magic, 1, magic_size, file_);
+	}
+
+	start_ = std::chrono::steady_clock::now();
+}
+
+writer::~writer()
+{
+	::fclose(file_);
+}
+
+void writer::start_session()
+{
+	std::string rec;
+	append_varint(rec, 0);
+	rec.append(1, char(SESSION));
+	append_varint(rec, std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count());
+	append_varint(rec, 0);
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	start_ = std::chrono::steady_clock::now();
+	::fwrite(rec.data(), 1, rec.size(), file_);
+}
+
+void writer::append(uint64_t connection, record_type type, string_view data)
+{
+	std::string head;
+	append_varint(head, connection);
+	head.append(1, char(type));
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	append_varint(head, microseconds_since(start_));
+	append_varint(head, data.size());
+	::fwrite(head.data(), 1, head.size(), file_);
+	::fwrite(data.data(), 1, data.size(), file_);
+}
+
+void writer::flush()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	::fflush(file_);
+}
+
+std::vector<record> read(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		throw log_error("can't open the trace log");
+	}
+
+	const std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	string_view in(content);
+	if (in.substr(0, magic_size) != string_view(magic, magic_size))
+	{
+		throw log_error("not a trace log");
+	}
+
+	in.remove_prefix(magic_size);
+
+	std::vector<record> records;
+	uint64_t base = 0;
+	uint64_t last = 0;
+	while (!in.empty())
+	{
+		record r;
+		uint64_t type = 0;
+		uint64_t size = 0;
+		if (!read_varint(in, r.connection) || in.empty())
+		{
+			throw log_error("truncated trace log");
+		}
+
+		type = uint8_t(in[0]);
+		in.remove_prefix(1);
+		if (!read_varint(in, r.time) || !read_varint(in, size) || size > in.size() || type > RESPONSE)
+		{
+			throw log_error("truncated trace log");
+		}
+
+		r.type = static_cast<record_type>(type);
+		r.data.assign(in.data(), size);
+		in.remove_prefix(size);
+
+		if (r.type == SESSION)
+		{
+			base = last;
+			continue;
+		}
+
+		r.connection += base;
+		last = std::max(last, r.connection);
+		records.push_back(std::move(r));
+	}
+
+	return records;
+}
+
+std::vector<exchange> exchanges(const std::vector<record>& records)
+{
+	struct state
+	{
+		size_t index;
+		uint64_t request_end = 0;
+		bool responding = false;
+	};
+
+	std::vector<exchange> ret;
+	std::map<uint64_t, state> connections;
+	for (auto& r : records)
+	{
+		auto i = connections.find(r.connection);
+		if (r.type == REQUEST)
+		{
+			// a request after the response starts the next exchange
+			if (i == connections.end() || i->second.responding)
+			{
+				exchange e;
+				e.connection = r.connection;
+				ret.push_back(std::move(e));
+				connections[r.connection] = state{ret.size() - 1};
+				i = connections.find(r.connection);
+			}
+
+			ret[i->second.index].request += r.data;
+			i->second.request_end = r.time;
+		}
+		else if (r.type == RESPONSE && i != connections.end())
+		{
+			exchange& e = ret[i->second.index];
+			if (!i->second.responding)
+			{
+				e.delay = r.time > i->second.request_end ? r.time - i->second.request_end : 0;
+				i->second.responding = true;
+			}
+
+			e.response += r.data;
+		}
+	}
+
+	// the requests nothing has been sent back to are of no use
+	ret.erase(std::remove_if(ret.begin(), ret.end(), [](auto& e){return e.response.empty();}), ret.end());
+	return ret;
+}
+
+} // namespace trace_log
+
+recorder::recorder(port_t upstream, const std::string& path) : upstream_(upstream), log_(path)
+{
+	log_.start_session();
+	log_.flush();
+}
+
+recorder::~recorder()
+{
+	// the connections are still writing to the log
+	stop();
+	wait();
+}
+
+void recorder::serve_client(client& c)
+{
+	const uint64_t id = ++connections_;
+
+	client up;
+	up.connect(upstream_);
+
+	// the responses go back on a thread of their own, the upstream is
+	// free to answer whenever it likes
+	std::thread responses([&]
+	{
+		try
+		{
+			buffer_type buffer(16384);
+			ssize_t bytes = 0;
+			while ((bytes = up.read_some(&buffer[0], buffer.size())) > 0)
+			{
+				log_.append(id, trace_log::RESPONSE, string_view(reinterpret_cast<const char*>(&buffer[0]), bytes));
+				c.write(&buffer[0], bytes);
+			}
+
+			c.shutdown_write();
+		}
+		catch (const exception&)
+		{
+		}
+	});
+
+	try
+	{
+		buffer_type buffer(16384);
+		ssize_t bytes = 0;
+		while ((bytes = c.read_some(&buffer[0], buffer.size())) > 0)
+		{
+			log_.append(id, trace_log::REQUEST, string_view(reinterpret_cast<const char*>(&buffer[0]), bytes));
+			up.write(&buffer[0], bytes);
+		}
+
+	}
+	catch (const exception&)
+	{
+	}
+
+	// the mocks keep their end open until they stop, so the client going away
+	// is what ends the connection to the upstream as well
+	up.shutdown();
+
+	responses.join();
+	log_.flush();
+}
+
+http& when_replayed(mock<http>& m, const std::string& request)
+{
+	wire::request parsed;
+	if (!parsed.parse(request))
+	{
+		return m.when(starts_with(request));
+	}
+
+	return m.when(http_request(parsed.method()).uri(parsed.uri().to_string()));
+}
+
+size_t add_recorded(corpus_builder& b, const std::vector<trace_log::exchange>& exchanges)
+{
+	size_t added = 0;
+	for (auto& e : exchanges)
+	{
+		wire::request parsed;
+		if (parsed.parse(e.request))
+		{
+			b.add(corpus_key(http_method_to_str(parsed.method()), parsed.uri()), e.response);
+			++added;
+		}
+	}
+
+	return added;
+}
+
+} // namespace nemok
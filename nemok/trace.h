@@ -0,0 +1,153 @@
+#pragma once
+#include <cstdio>
+#include <mutex>
+#include "server.h"
+#include "http.h"
+#include "corpus.h"
+
+/*
+	// record: the clients connect to the recorder, which passes the traffic on
+	// to the upstream and appends every piece of it to the log
+	nemok::recorder rec(upstream_port, "checkout.trace");
+	rec.start();
+
+	// replay: the recorded responses are served as expectations, the upstream
+	// think time is reproduced at twice the speed
+	auto mock = nemok::trace<nemok::http>("checkout.trace", 2.0);
+*/
+
+namespace nemok
+{
+
+// the log is a magic followed by records, each one being
+//   varint connection, byte type, varint time, varint size, size bytes of data
+// the time is in microseconds since the session has started, a session record
+// carries the wall clock time instead; the connections are numbered per session
+namespace trace_log
+{
+
+enum record_type : uint8_t
+{
+	SESSION = 0,
+	REQUEST = 1,
+	RESPONSE = 2
+};
+
+struct record
+{
+	uint64_t connection = 0;
+	record_type type = SESSION;
+	uint64_t time = 0;
+	std::string data;
+};
+
+// a request and the response to it, as the connection saw them
+struct exchange
+{
+	uint64_t connection = 0;
+	std::string request;
+	std::string response;
+
+	// from the end of the request to the start of the response, microseconds
+	uint64_t delay = 0;
+};
+
+class log_error : public exception
+{
+public:
+	explicit log_error(const char* message) : exception(message) {}
+};
+
+// appends to the log, the records may come from any thread
+class writer
+{
+public:
+	explicit writer(const std::string& path);
+	~writer();
+
+	writer(const writer&) = delete;
+	writer& operator =(const writer&) = delete;
+
+	// a session record first, then the time is relative to this call
+	void start_session();
+
+	void append(uint64_t connection, record_type type, string_view data);
+	void flush();
+
+private:
+	std::mutex mutex_;
+	FILE* file_ = nullptr;
+	std::chrono::steady_clock::time_point start_;
+};
+
+// all of the records of the log, the connections of every session
+// numbered apart from the ones of the previous sessions
+std::vector<record> read(const std::string& path);
+
+// the records of every connection grouped into request and response pairs,
+// in the order the requests have been made
+std::vector<exchange> exchanges(const std::vector<record>& records);
+
+void append_varint(std::string& out, uint64_t value);
+bool read_varint(string_view& in, uint64_t& value);
+
+} // namespace trace_log
+
+// a proxy to the upstream on the same host, every connection is
+// forwarded as it is and recorded on the way
+class recorder : public server
+{
+public:
+	recorder(port_t upstream, const std::string& path);
+	~recorder();
+
+private:
+	virtual void serve_client(client& c);
+
+	port_t upstream_;
+	trace_log::writer log_;
+	std::atomic<uint64_t> connections_{0};
+};
+
+// how a recorded request is told apart: the http ones by the method and the uri,
+// anything else by the bytes it starts with
+template <typename T>
+T& when_replayed(mock<T>& m, const std::string& request)
+{
+	return m.when(starts_with(request));
+}
+
+http& when_replayed(mock<http>& m, const std::string& request);
+
+// the recorded responses served as expectations; the ones to the same request
+// take turns in the order they were recorded; a positive speed makes the mock
+// wait before every response as long as the upstream did, divided by the speed
+template <typename T>
+void replay(mock<T>& m, const std::vector<trace_log::exchange>& exchanges, double speed = 0)
+{
+	for (auto& e : exchanges)
+	{
+		T& t = when_replayed(m, e.request);
+		if (speed > 0 && e.delay)
+		{
+			t.freeze(static_cast<useconds_t>(e.delay / speed));
+		}
+
+		auto response = std::make_shared<const std::string>(e.response);
+		t.exec([response](client& c){c.write(response->data(), response->size());});
+	}
+}
+
+// the http exchanges keyed by their method and uri, see nemok/corpus.h;
+// the rest aren't requests to look up, the number of the ones added is returned
+size_t add_recorded(corpus_builder& b, const std::vector<trace_log::exchange>& exchanges);
+
+template <typename T>
+mock<T> trace(const std::string& path, double speed = 0)
+{
+	auto m = start<T>();
+	replay(m, trace_log::exchanges(trace_log::read(path)), speed);
+	return m;
+}
+
+} // namespace nemok
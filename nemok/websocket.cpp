@@ -0,0 +1,641 @@
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <sys/socket.h>
+
+#include "websocket.h"
+
+namespace nemok
+{
+
+namespace websocket
+{
+
+namespace
+{
+
+const char accept_guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// a message taking more than this is refused with 1009
+const uint64_t max_message_size = 64 << 20;
+
+const uint16_t close_protocol_error = 1002;
+const uint16_t close_too_big = 1009;
+
+thread_local const message* current = nullptr;
+
+class message_scope
+{
+public:
+	explicit message_scope(const message& m) : prev_(current)
+	{
+		current = &m;
+	}
+
+	~message_scope()
+	{
+		current = prev_;
+	}
+
+private:
+	const message* prev_;
+};
+
+uint32_t rotate_left(uint32_t x, int n)
+{
+	return (x << n) | (x >> (32 - n));
+}
+
+// the handshake is the only user, so it's done the plain way
+std::string sha1(string_view input)
+{
+	uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+	std::string data(input.data(), input.size());
+	const uint64_t bits = uint64_t(input.size()) * 8;
+	data.append(1, char(0x80));
+	while (data.size() % 64 != 56)
+	{
+		data.append(1, '\0');
+	}
+
+	for (int i = 7; i >= 0; --i)
+	{
+		data.append(1, char(bits >> (i * 8)));
+	}
+
+	for (size_t block = 0; block < data.size(); block += 64)
+	{
+		uint32_t w[80];
+		for (int i = 0; i < 16; ++i)
+		{
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(&data[block + i * 4]);
+			w[i] = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+		}
+
+		for (int i = 16; i < 80; ++i)
+		{
+			w[i] = rotate_left(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i = 0; i < 80; ++i)
+		{
+			uint32_t f, k;
+			if (i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			}
+			else if (i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			}
+			else if (i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			const uint32_t t = rotate_left(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = rotate_left(b, 30);
+			b = a;
+			a = t;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	std::string digest;
+	for (uint32_t x : h)
+	{
+		digest.append(1, char(x >> 24)).append(1, char(x >> 16)).append(1, char(x >> 8)).append(1, char(x));
+	}
+
+	return digest;
+}
+
+std::string base64(string_view input)
+{
+	static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string ret;
+	for (size_t i = 0; i < input.size(); i += 3)
+	{
+		const size_t n = std::min<size_t>(3, input.size() - i);
+		uint32_t group = 0;
+		for (size_t j = 0; j < 3; ++j)
+		{
+			group = (group << 8) | (j < n ? uint8_t(input[i + j]) : 0);
+		}
+
+		for (size_t j = 0; j < 4; ++j)
+		{
+			ret.append(1, j <= n ? alphabet[(group >> (18 - j * 6)) & 0x3f] : '=');
+		}
+	}
+
+	return ret;
+}
+
+void append_frame_header(std::string& out, websocket_opcode opcode, size_t length, bool fin, bool masked)
+{
+	out.append(1, char((fin ? 0x80 : 0) | opcode));
+
+	const uint8_t mask_bit = masked ? 0x80 : 0;
+	if (length < 126)
+	{
+		out.append(1, char(mask_bit | length));
+	}
+	else if (length <= 0xffff)
+	{
+		out.append(1, char(mask_bit | 126));
+		out.append(1, char(length >> 8)).append(1, char(length));
+	}
+	else
+	{
+		out.append(1, char(mask_bit | 127));
+		for (int i = 7; i >= 0; --i)
+		{
+			out.append(1, char(uint64_t(length) >> (i * 8)));
+		}
+	}
+}
+
+} // namespace
+
+std::string accept_key(string_view key)
+{
+	std::string s(key.data(), key.size());
+	return base64(sha1(s + accept_guid));
+}
+
+std::string frame(websocket_opcode opcode, string_view payload, bool fin)
+{
+	std::string ret;
+	ret.reserve(payload.size() + 10);
+	append_frame_header(ret, opcode, payload.size(), fin, false);
+	ret.append(payload.data(), payload.size());
+	return ret;
+}
+
+std::string masked_frame(websocket_opcode opcode, string_view payload, uint32_t mask, bool fin)
+{
+	const uint8_t key[4] = {uint8_t(mask >> 24), uint8_t(mask >> 16), uint8_t(mask >> 8), uint8_t(mask)};
+
+	std::string ret;
+	ret.reserve(payload.size() + 14);
+	append_frame_header(ret, opcode, payload.size(), fin, true);
+	ret.append(reinterpret_cast<const char*>(key), sizeof(key));
+
+	const size_t pos = ret.size();
+	ret.resize(pos + payload.size());
+	unmask(reinterpret_cast<uint8_t*>(&ret[pos]), reinterpret_cast<const uint8_t*>(payload.data()), payload.size(), key, 0);
+	return ret;
+}
+
+void unmask(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t mask[4], uint64_t offset)
+{
+	// the mask turned so that it starts with the byte the payload is at
+	uint8_t turned[4];
+	for (size_t i = 0; i < 4; ++i)
+	{
+		turned[i] = mask[(offset + i) % 4];
+	}
+
+	uint32_t mask32;
+	memcpy(&mask32, turned, sizeof(mask32));
+	const uint64_t mask64 = (uint64_t(mask32) << 32) | mask32;
+
+	// the wide chunks are multiples of four, so the mask stays in phase
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i mask128 = _mm_set1_epi32(int(mask32));
+	for (; i + 16 <= size; i += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(chunk, mask128));
+	}
+#endif
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, src + i, sizeof(word));
+		word ^= mask64;
+		memcpy(dst + i, &word, sizeof(word));
+	}
+
+	for (; i < size; ++i)
+	{
+		dst[i] = src[i] ^ turned[i % 4];
+	}
+}
+
+bool parse_frame_header(const uint8_t* data, size_t size, frame_header& header)
+{
+	if (size < 2)
+	{
+		return false;
+	}
+
+	header.fin = data[0] & 0x80;
+	header.reserved = data[0] & 0x70;
+	header.opcode = static_cast<websocket_opcode>(data[0] & 0x0f);
+	header.masked = data[1] & 0x80;
+
+	size_t pos = 2;
+	const uint8_t length = data[1] & 0x7f;
+	const size_t extended = length == 126 ? 2 : length == 127 ? 8 : 0;
+	if (size < pos + extended + (header.masked ? 4 : 0))
+	{
+		return false;
+	}
+
+	header.length = extended ? 0 : length;
+	for (size_t i = 0; i < extended; ++i)
+	{
+		header.length = (header.length << 8) | data[pos++];
+	}
+
+	if (header.masked)
+	{
+		memcpy(header.mask, data + pos, 4);
+		pos += 4;
+	}
+
+	header.size = pos;
+	return true;
+}
+
+const message* current_message()
+{
+	return current;
+}
+
+bool matches_message::operator ()(buffer_type& input)
+{
+	const message* m = current_message();
+	if (!m || m->opcode != opcode_)
+	{
+		return false;
+	}
+
+	if (exact_ && (input.size() != payload_.size() || !std::equal(input.begin(), input.end(), payload_.begin())))
+	{
+		return false;
+	}
+
+	input.clear();
+	return true;
+}
+
+} // namespace websocket
+
+websocket_session::websocket_session(client& cl, std::shared_ptr<websocket_hub> hub, std::string handshake)
+	: client_(cl), fd_(cl.fd()), hub_(std::move(hub))
+{
+	pending_.push(std::make_shared<const std::string>(std::move(handshake)));
+	hub_->add(this);
+
+	bool wait = false;
+	{
+		std::lock_guard<std::mutex> lock(write_mutex_);
+		wait = flush();
+		waiting_ = wait;
+	}
+
+	if (wait)
+	{
+		hub_->wait_for_room(this);
+	}
+}
+
+websocket_session::~websocket_session()
+{
+	hub_->remove(this);
+}
+
+void websocket_session::receive(buffer_type& input, matcher& m)
+{
+	size_t pos = 0;
+	websocket::frame_header header;
+	while (!closed_ && websocket::parse_frame_header(input.data() + pos, input.size() - pos, header))
+	{
+		if (header.length > websocket::max_message_size)
+		{
+			close(websocket::close_too_big);
+			break;
+		}
+
+		if (input.size() - pos - header.size < header.length)
+		{
+			break;
+		}
+
+		const uint8_t* payload = input.data() + pos + header.size;
+		pos += header.size + header.length;
+		if (!on_frame(header, payload, m))
+		{
+			close(websocket::close_protocol_error);
+		}
+	}
+
+	// nothing is read past the close frame
+	if (closed_)
+	{
+		input.clear();
+		return;
+	}
+
+	input.erase(input.begin(), input.begin() + pos);
+}
+
+bool websocket_session::on_frame(const websocket::frame_header& header, const uint8_t* payload, matcher& m)
+{
+	// whatever the client sends is to be masked
+	if (header.reserved || !header.masked)
+	{
+		return false;
+	}
+
+	// the control frames may come in between the frames of a message
+	if (header.opcode >= WS_CLOSE)
+	{
+		if (!header.fin || header.length > 125)
+		{
+			return false;
+		}
+
+		uint8_t control[125];
+		websocket::unmask(control, payload, header.length, header.mask, 0);
+		const string_view body(reinterpret_cast<const char*>(control), header.length);
+		switch (header.opcode)
+		{
+			case WS_PING:
+				send(websocket::frame(WS_PONG, body));
+				return true;
+
+			case WS_PONG:
+				return true;
+
+			case WS_CLOSE:
+				// the status code goes back, the reason doesn't
+				finish(websocket::frame(WS_CLOSE, body.substr(0, 2)));
+				return true;
+
+			default:
+				return false;
+		}
+	}
+
+	if (header.opcode == WS_CONTINUATION)
+	{
+		if (opcode_ == WS_CONTINUATION)
+		{
+			return false;
+		}
+	}
+	else if (header.opcode == WS_TEXT || header.opcode == WS_BINARY)
+	{
+		if (opcode_ != WS_CONTINUATION)
+		{
+			return false;
+		}
+
+		opcode_ = header.opcode;
+	}
+	else
+	{
+		return false;
+	}
+
+	const size_t old_size = message_.size();
+	if (old_size + header.length > websocket::max_message_size)
+	{
+		close(websocket::close_too_big);
+		return true;
+	}
+
+	message_.resize(old_size + header.length);
+	websocket::unmask(message_.data() + old_size, payload, header.length, header.mask, 0);
+	if (!header.fin)
+	{
+		return true;
+	}
+
+	// an empty message has nothing for the triggers to consume, so it matches none
+	const websocket::message message = {opcode_, &message_};
+	{
+		websocket::message_scope scope(message);
+		input_.assign(message_.begin(), message_.end());
+		m.match(input_, client_);
+	}
+
+	message_.clear();
+	opcode_ = WS_CONTINUATION;
+	return true;
+}
+
+void websocket_session::send(std::shared_ptr<const std::string> frame)
+{
+	bool wait = false;
+	{
+		std::lock_guard<std::mutex> lock(write_mutex_);
+		wait = queue(std::move(frame));
+	}
+
+	if (wait)
+	{
+		hub_->wait_for_room(this);
+	}
+}
+
+void websocket_session::send(std::string frame)
+{
+	send(std::make_shared<const std::string>(std::move(frame)));
+}
+
+void websocket_session::close(uint16_t code)
+{
+	const char payload[] = {char(code >> 8), char(code)};
+	finish(websocket::frame(WS_CLOSE, string_view(payload, sizeof(payload))));
+}
+
+void websocket_session::finish(std::string frame)
+{
+	bool wait = false;
+	{
+		std::lock_guard<std::mutex> lock(write_mutex_);
+		if (closed_)
+		{
+			return;
+		}
+
+		closed_ = true;
+		half_close_ = true;
+		pending_.push(std::make_shared<const std::string>(std::move(frame)));
+		if (!waiting_)
+		{
+			wait = waiting_ = flush();
+		}
+	}
+
+	if (wait)
+	{
+		hub_->wait_for_room(this);
+	}
+}
+
+bool websocket_session::queue(std::shared_ptr<const std::string> frame)
+{
+	if (closed_)
+	{
+		return false;
+	}
+
+	pending_.push(std::move(frame));
+	if (pending_.size() > max_pending)
+	{
+		closed_ = true;
+		pending_.clear();
+		::shutdown(fd_, SHUT_RDWR);
+		return false;
+	}
+
+	if (waiting_)
+	{
+		return false;
+	}
+
+	waiting_ = flush();
+	return waiting_;
+}
+
+bool websocket_session::flush()
+{
+	switch (pending_.flush(fd_))
+	{
+		case outbox::blocked:
+			return true;
+
+		case outbox::failed:
+			// the connection is gone, its thread finds out by itself
+			closed_ = true;
+			half_close_ = false;
+			pending_.clear();
+			return false;
+
+		default:
+			break;
+	}
+
+	if (half_close_)
+	{
+		half_close_ = false;
+		client_.shutdown_write();
+	}
+
+	return false;
+}
+
+bool websocket_session::resume()
+{
+	std::lock_guard<std::mutex> lock(write_mutex_);
+	waiting_ = waiting_ && flush();
+	return waiting_;
+}
+
+websocket_hub::~websocket_hub()
+{
+	poller_.stop();
+}
+
+void websocket_hub::add(websocket_session* s)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	sessions_[s->fd_] = s;
+}
+
+void websocket_hub::remove(websocket_session* s)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	sessions_.erase(s->fd_);
+	poller_.forget(s->fd_);
+}
+
+// the frame is made once and every session gets a reference to it, the writes
+// don't block so a slow reader holds back neither the others nor the connections
+// coming and going
+void websocket_hub::broadcast(std::shared_ptr<const std::string> frame)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (auto& entry : sessions_)
+	{
+		websocket_session* s = entry.second;
+		bool wait = false;
+		{
+			std::lock_guard<std::mutex> session_lock(s->write_mutex_);
+			wait = s->queue(frame);
+		}
+
+		if (wait)
+		{
+			watch(s);
+		}
+	}
+}
+
+size_t websocket_hub::size()
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	return sessions_.size();
+}
+
+void websocket_hub::wait_for_room(websocket_session* s)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (sessions_.count(s->fd_))
+	{
+		watch(s);
+	}
+}
+
+// one event at a time, the session is watched again if it's still waiting
+void websocket_hub::watch(websocket_session* s)
+{
+	if (!poller_.watch(s->fd_, EPOLLOUT | EPOLLONESHOT))
+	{
+		throw system_error("can't watch the websocket connections");
+	}
+}
+
+// the sessions are looked up under the lock, so the one an event is reported
+// for can't be gone while it's written to
+void websocket_hub::handle(const epoll_event* events, int count)
+{
+	std::lock_guard<std::mutex> lock(mutex_);
+	for (int i = 0; i < count; ++i)
+	{
+		auto it = sessions_.find(events[i].data.fd);
+		if (it != sessions_.end() && it->second->resume())
+		{
+			poller_.watch(it->first, EPOLLOUT | EPOLLONESHOT);
+		}
+	}
+}
+
+} // namespace nemok
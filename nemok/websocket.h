@@ -0,0 +1,213 @@
+#pragma once
+#include <mutex>
+#include <unordered_map>
+#include "server.h"
+#include "fanout.h"
+
+/*
+	auto mock = nemok::start<nemok::http>();
+	mock.when(nemok::http::GET("/chat")).accept_websocket();
+	mock.when(nemok::websocket::text("ping")).send_text("pong");
+	mock.when(nemok::websocket::binary()).echo();
+	mock.when(nemok::websocket::text()).broadcast();
+
+	once the handshake is done the connection carries websocket frames, every
+	message is matched against the expectations as a whole, whatever number of
+	frames it's been sent in; pings are answered and close frames echoed on their own
+*/
+
+namespace nemok
+{
+
+enum websocket_opcode
+{
+	WS_CONTINUATION = 0x0,
+	WS_TEXT = 0x1,
+	WS_BINARY = 0x2,
+	WS_CLOSE = 0x8,
+	WS_PING = 0x9,
+	WS_PONG = 0xa
+};
+
+namespace websocket
+{
+
+// the Sec-WebSocket-Accept value for the key the client has sent
+std::string accept_key(string_view key);
+
+// a single unmasked frame, the way a server sends it
+std::string frame(websocket_opcode opcode, string_view payload, bool fin = true);
+
+// a single masked frame, the way a client sends it
+std::string masked_frame(websocket_opcode opcode, string_view payload, uint32_t mask, bool fin = true);
+
+// xors the payload with the mask, offset being the position of the first byte
+// within the payload; 16 or 8 bytes are done at a time, dst may be the same as src
+void unmask(uint8_t* dst, const uint8_t* src, size_t size, const uint8_t mask[4], uint64_t offset);
+
+struct frame_header
+{
+	bool fin = false;
+	websocket_opcode opcode = WS_CONTINUATION;
+	bool masked = false;
+
+	// any of the extension bits, none of which we know
+	bool reserved = false;
+	uint8_t mask[4] = {};
+	uint64_t length = 0;
+
+	// the size of the header itself
+	size_t size = 0;
+};
+
+// false until the whole of the header is there
+bool parse_frame_header(const uint8_t* data, size_t size, frame_header& header);
+
+// the message being matched, null unless the expectations are walked for one;
+// the input the triggers are given is a copy of the payload, this one stays intact
+// for the actions
+struct message
+{
+	websocket_opcode opcode;
+	const buffer_type* payload;
+};
+
+const message* current_message();
+
+// matches a whole message of the given type, with the given payload if any
+class matches_message
+{
+public:
+	explicit matches_message(websocket_opcode opcode) : opcode_(opcode) {}
+	matches_message(websocket_opcode opcode, std::string payload) : opcode_(opcode), payload_(std::move(payload)), exact_(true) {}
+
+	bool operator ()(buffer_type& input);
+
+private:
+	websocket_opcode opcode_;
+	std::string payload_;
+	bool exact_ = false;
+};
+
+inline matches_message text()
+{
+	return matches_message(WS_TEXT);
+}
+
+inline matches_message text(std::string payload)
+{
+	return matches_message(WS_TEXT, std::move(payload));
+}
+
+inline matches_message binary()
+{
+	return matches_message(WS_BINARY);
+}
+
+inline matches_message binary(std::string payload)
+{
+	return matches_message(WS_BINARY, std::move(payload));
+}
+
+} // namespace websocket
+
+class websocket_hub;
+
+// an upgraded connection; the frames going to it, whichever thread sends them,
+// are queued as references to shared buffers and written without blocking,
+// what the socket has no room for is written by the hub once it has
+class websocket_session
+{
+public:
+	// a session with as many frames waiting is too slow, it's disconnected
+	static const size_t max_pending = 4096;
+
+	// the handshake goes before any frame, broadcast ones included
+	websocket_session(client& cl, std::shared_ptr<websocket_hub> hub, std::string handshake);
+	~websocket_session();
+
+	websocket_session(const websocket_session&) = delete;
+	websocket_session& operator =(const websocket_session&) = delete;
+
+	// consumes the complete frames the input starts with
+	void receive(buffer_type& input, matcher& m);
+
+	// dropped once the connection is closing
+	void send(std::shared_ptr<const std::string> frame);
+	void send(std::string frame);
+
+private:
+	friend class websocket_hub;
+
+	bool on_frame(const websocket::frame_header& header, const uint8_t* payload, matcher& m);
+	void close(uint16_t code);
+
+	// the last frame, it goes after what's waiting and the connection is
+	// half-closed once it's been written
+	void finish(std::string frame);
+
+	// true if the session is to be watched until its socket has room;
+	// called with the lock held
+	bool queue(std::shared_ptr<const std::string> frame);
+
+	// true if there's still something waiting, called with the lock held
+	bool flush();
+
+	// the socket has room, true if it's to be watched again
+	bool resume();
+
+	client& client_;
+	const int fd_;
+	std::shared_ptr<websocket_hub> hub_;
+
+	std::mutex write_mutex_;
+	outbox pending_;
+
+	// watched by the hub
+	bool waiting_ = false;
+
+	// the close frame is queued, the connection is half-closed once it's written
+	bool half_close_ = false;
+
+	// the message being received
+	buffer_type message_;
+	websocket_opcode opcode_ = WS_CONTINUATION;
+
+	// what the triggers are given
+	buffer_type input_;
+
+	std::atomic<bool> closed_{false};
+};
+
+// the open sessions of a mock, a broadcast goes to every one of them; the
+// sessions the socket of which is full are watched by the poller of the hub
+class websocket_hub
+{
+public:
+	websocket_hub() {}
+	~websocket_hub();
+
+	websocket_hub(const websocket_hub&) = delete;
+	websocket_hub& operator =(const websocket_hub&) = delete;
+
+	void add(websocket_session* s);
+	void remove(websocket_session* s);
+
+	// the frame is queued to every session, none of them is waited for
+	void broadcast(std::shared_ptr<const std::string> frame);
+	size_t size();
+
+	// the rest of what's waiting is written once the socket has room
+	void wait_for_room(websocket_session* s);
+
+private:
+	// called with the lock held
+	void watch(websocket_session* s);
+	void handle(const epoll_event* events, int count);
+
+	std::mutex mutex_;
+	std::unordered_map<int, websocket_session*> sessions_;
+	poller poller_{[this](const epoll_event* events, int count){handle(events, count);}};
+};
+
+} // namespace nemok
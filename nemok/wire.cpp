@@ -0,0 +1,565 @@
+#include "wire.h"
+
+namespace nemok
+{
+
+namespace wire
+{
+
+namespace
+{
+
+char lower(char ch)
+{
+	return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+}
+
+int hex_digit(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+	{
+		return ch - '0';
+	}
+
+	ch = lower(ch);
+	if (ch >= 'a' && ch <= 'f')
+	{
+		return ch - 'a' + 10;
+	}
+
+	return -1;
+}
+
+// the last one of the codings applied must be chunked
+bool ends_with_chunked(string_view encoding)
+{
+	const size_t comma = encoding.rfind(',');
+	return iequals(trim(comma == string_view::npos ? encoding : encoding.substr(comma + 1)), "chunked");
+}
+
+const size_t max_encoding_size = 256;
+
+} // namespace
+
+void request_parser::name_matcher::feed(string_view piece)
+{
+	for (char ch : piece)
+	{
+		if (matched_ < name_.size() && lower(ch) == name_[matched_])
+		{
+			++matched_;
+		}
+		else
+		{
+			// can't be this header anymore, make sure it never matches
+			matched_ = name_.size() + 1;
+			break;
+		}
+	}
+}
+
+void request_parser::reset()
+{
+	state_ = state::method;
+	token_size_ = 0;
+	uri_size_ = 0;
+	name_size_ = 0;
+	content_length_name_.reset();
+	transfer_encoding_name_.reset();
+	length_digits_ = false;
+	length_done_ = false;
+	has_length_ = false;
+	content_length_ = 0;
+	has_encoding_ = false;
+	encoding_.clear();
+	chunked_ = false;
+	content_left_ = 0;
+	chunk_digits_ = false;
+}
+
+size_t request_parser::feed(string_view input)
+{
+	const size_t npos = string_view::npos;
+	size_t pos = 0;
+	while (pos < input.size() && state_ != state::done && state_ != state::error)
+	{
+		const string_view rest = input.substr(pos);
+
+		// the single byte states are the line feeds following carriage returns
+		auto expect = [&](char ch, state next)
+		{
+			if (rest[0] == ch)
+			{
+				++pos;
+				state_ = next;
+				return true;
+			}
+
+			state_ = state::error;
+			return false;
+		};
+
+		switch (state_)
+		{
+			case state::method:
+			{
+				const size_t sp = scan::find_first_of(rest, " ");
+				if (!append_token(rest.substr(0, sp)))
+				{
+					state_ = state::error;
+					break;
+				}
+
+				if (sp == npos)
+				{
+					pos = input.size();
+					break;
+				}
+
+				const http_method method = http_method_from_str(string_view(token_, token_size_));
+				if (method == HTTP_BAD_METHOD)
+				{
+					state_ = state::error;
+					break;
+				}
+
+				events_.on_method(method);
+				token_size_ = 0;
+				state_ = state::uri;
+				pos += sp + 1;
+				break;
+			}
+
+			case state::uri:
+			{
+				const size_t end = scan::find_first_of(rest, " \r");
+				const string_view piece = rest.substr(0, end);
+				if (!piece.empty())
+				{
+					uri_size_ += piece.size();
+					events_.on_uri(piece);
+				}
+
+				if (end == npos)
+				{
+					pos = input.size();
+					break;
+				}
+
+				// there is no such thing as a request without the version
+				if (rest[end] != ' ' || uri_size_ == 0)
+				{
+					state_ = state::error;
+					break;
+				}
+
+				state_ = state::version;
+				pos += end + 1;
+				break;
+			}
+
+			case state::version:
+			{
+				const size_t cr = scan::find_first_of(rest, "\r");
+				if (!append_token(rest.substr(0, cr)))
+				{
+					state_ = state::error;
+					break;
+				}
+
+				if (cr == npos)
+				{
+					pos = input.size();
+					break;
+				}
+
+				const http_version version = http_version_from_str(string_view(token_, token_size_));
+				if (version == HTTP_BAD_VERSION)
+				{
+					state_ = state::error;
+					break;
+				}
+
+				events_.on_version(version);
+				token_size_ = 0;
+				state_ = state::line_lf;
+				pos += cr + 1;
+				break;
+			}
+
+			case state::line_lf:
+				expect('\n', state::header_start);
+				break;
+
+			case state::header_start:
+			{
+				if (rest[0] == '\r')
+				{
+					state_ = state::head_lf;
+					++pos;
+				}
+				else
+				{
+					name_size_ = 0;
+					content_length_name_.reset();
+					transfer_encoding_name_.reset();
+					state_ = state::header_name;
+				}
+				break;
+			}
+
+			case state::header_name:
+			{
+				const size_t end = scan::find_first_of(rest, ":\r");
+				const string_view piece = rest.substr(0, end);
+				if (!piece.empty())
+				{
+					name_size_ += piece.size();
+					content_length_name_.feed(piece);
+					transfer_encoding_name_.feed(piece);
+					events_.on_header_name(piece);
+				}
+
+				if (end == npos)
+				{
+					pos = input.size();
+					break;
+				}
+
+				if (rest[end] != ':' || name_size_ == 0)
+				{
+					state_ = state::error;
+					break;
+				}
+
+				if (content_length_name_.matches())
+				{
+					// more than one Content-Length is ambiguous
+					if (has_length_)
+					{
+						state_ = state::error;
+						break;
+					}
+
+					has_length_ = true;
+				}
+
+				if (transfer_encoding_name_.matches())
+				{
+					// several Transfer-Encoding headers make a single list
+					if (has_encoding_)
+					{
+						encoding_.append(1, ',');
+					}
+
+					has_encoding_ = true;
+				}
+
+				state_ = state::header_value_start;
+				pos += end + 1;
+				break;
+			}
+
+			case state::header_value_start:
+			{
+				if (rest[0] == ' ' || rest[0] == '\t')
+				{
+					++pos;
+				}
+				else
+				{
+					state_ = state::header_value;
+				}
+				break;
+			}
+
+			case state::header_value:
+			{
+				const size_t cr = scan::find_first_of(rest, "\r");
+				const string_view piece = rest.substr(0, cr);
+				if (!piece.empty())
+				{
+					if (content_length_name_.matches() && !parse_content_length(piece))
+					{
+						state_ = state::error;
+						break;
+					}
+
+					if (transfer_encoding_name_.matches())
+					{
+						if (encoding_.size() + piece.size() > max_encoding_size)
+						{
+							state_ = state::error;
+							break;
+						}
+
+						encoding_.append(piece.data(), piece.size());
+					}
+
+					events_.on_header_value(piece);
+				}
+
+				if (cr == npos)
+				{
+					pos = input.size();
+					break;
+				}
+
+				state_ = state::header_lf;
+				pos += cr + 1;
+				break;
+			}
+
+			case state::header_lf:
+				if (expect('\n', state::header_start) && !end_header())
+				{
+					state_ = state::error;
+				}
+				break;
+
+			case state::head_lf:
+				if (expect('\n', state::content) && !end_head())
+				{
+					state_ = state::error;
+				}
+				break;
+
+			case state::content:
+			{
+				const string_view piece = rest.substr(0, content_left_);
+				events_.on_content(piece);
+				content_left_ -= piece.size();
+				pos += piece.size();
+				if (content_left_ == 0)
+				{
+					finish_message();
+				}
+				break;
+			}
+
+			case state::chunk_size:
+			{
+				const char ch = rest[0];
+				if (hex_digit(ch) >= 0)
+				{
+					if (!parse_chunk_size(ch))
+					{
+						state_ = state::error;
+						break;
+					}
+
+					++pos;
+				}
+				else if (chunk_digits_ && (ch == ';' || ch == ' ' || ch == '\t'))
+				{
+					state_ = state::chunk_ext;
+					++pos;
+				}
+				else if (chunk_digits_)
+				{
+					expect('\r', state::chunk_size_lf);
+				}
+				else
+				{
+					state_ = state::error;
+				}
+				break;
+			}
+
+			case state::chunk_ext:
+			{
+				// the extensions mean nothing to us
+				const size_t cr = scan::find_first_of(rest, "\r");
+				if (cr == npos)
+				{
+					pos = input.size();
+					break;
+				}
+
+				state_ = state::chunk_size_lf;
+				pos += cr + 1;
+				break;
+			}
+
+			case state::chunk_size_lf:
+				expect('\n', content_left_ ? state::chunk_data : state::trailer_start);
+				break;
+
+			case state::chunk_data:
+			{
+				const string_view piece = rest.substr(0, content_left_);
+				events_.on_content(piece);
+				content_left_ -= piece.size();
+				pos += piece.size();
+				if (content_left_ == 0)
+				{
+					state_ = state::chunk_data_cr;
+				}
+				break;
+			}
+
+			case state::chunk_data_cr:
+				expect('\r', state::chunk_data_lf);
+				break;
+
+			case state::chunk_data_lf:
+				chunk_digits_ = false;
+				expect('\n', state::chunk_size);
+				break;
+
+			case state::trailer_start:
+			{
+				if (rest[0] == '\r')
+				{
+					state_ = state::trailer_end_lf;
+					++pos;
+				}
+				else
+				{
+					state_ = state::trailer_line;
+				}
+				break;
+			}
+
+			case state::trailer_line:
+			{
+				// the trailer fields are skipped over
+				const size_t cr = scan::find_first_of(rest, "\r");
+				if (cr == npos)
+				{
+					pos = input.size();
+					break;
+				}
+
+				state_ = state::trailer_lf;
+				pos += cr + 1;
+				break;
+			}
+
+			case state::trailer_lf:
+				expect('\n', state::trailer_start);
+				break;
+
+			case state::trailer_end_lf:
+				if (expect('\n', state::done))
+				{
+					finish_message();
+				}
+				break;
+
+			case state::done:
+			case state::error:
+				break;
+		}
+	}
+
+	return pos;
+}
+
+bool request_parser::append_token(string_view s)
+{
+	if (token_size_ + s.size() > sizeof(token_))
+	{
+		return false;
+	}
+
+	std::copy(s.begin(), s.end(), token_ + token_size_);
+	token_size_ += s.size();
+	return true;
+}
+
+// decimal digits, possibly followed by blanks
+bool request_parser::parse_content_length(string_view s)
+{
+	for (char ch : s)
+	{
+		if (ch == ' ' || ch == '\t')
+		{
+			length_done_ = length_digits_;
+			continue;
+		}
+
+		if (ch < '0' || ch > '9' || length_done_)
+		{
+			return false;
+		}
+
+		const size_t digit = ch - '0';
+		if (content_length_ > (std::numeric_limits<size_t>::max() - digit) / 10)
+		{
+			return false;
+		}
+
+		content_length_ = content_length_ * 10 + digit;
+		length_digits_ = true;
+	}
+
+	return true;
+}
+
+bool request_parser::parse_chunk_size(char ch)
+{
+	if (content_left_ > (std::numeric_limits<size_t>::max() >> 4))
+	{
+		return false;
+	}
+
+	content_left_ = (content_left_ << 4) | hex_digit(ch);
+	chunk_digits_ = true;
+	return true;
+}
+
+bool request_parser::end_header()
+{
+	// Content-Length: with no digits at all
+	if (content_length_name_.matches() && !length_digits_)
+	{
+		return false;
+	}
+
+	events_.on_header_end();
+	return true;
+}
+
+bool request_parser::end_head()
+{
+	if (has_encoding_)
+	{
+		// either the length is known or the content is chunked, never both
+		if (has_length_ || !ends_with_chunked(encoding_))
+		{
+			return false;
+		}
+
+		chunked_ = true;
+	}
+
+	events_.on_headers_end();
+	if (chunked_)
+	{
+		content_left_ = 0;
+		chunk_digits_ = false;
+		state_ = state::chunk_size;
+	}
+	else if (content_length_)
+	{
+		content_left_ = content_length_;
+		state_ = state::content;
+	}
+	else
+	{
+		finish_message();
+	}
+
+	return true;
+}
+
+void request_parser::finish_message()
+{
+	state_ = state::done;
+	events_.on_message_end();
+}
+
+} // namespace wire
+
+} // namespace nemok
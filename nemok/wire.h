@@ -0,0 +1,628 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cctype>
+#include "http.h"
+#include "headers.h"
+#include "scan.h"
+#include "digest.h"
+
+namespace nemok
+{
+
+// the parsers below never copy the input, everything they return
+// is a view into the buffer the message has been parsed from
+namespace wire
+{
+
+// the parser keeps the headers as views into the input, the first sixteen
+// of them take no allocation
+using headers = basic_headers<string_view, 16>;
+
+// the first line of a request is enough to tell where it should be routed,
+// there is no need to wait for the headers and the content to arrive
+class request_line
+{
+public:
+	bool parse(string_view input)
+	{
+		const size_t line_end = scan::find_line_end(input);
+		if (line_end == string_view::npos)
+		{
+			return false;
+		}
+
+		const string_view line = input.substr(0, line_end);
+		const size_t method_end = scan::find_first_of(line, " ");
+		if (method_end == 0 || method_end == string_view::npos)
+		{
+			return false;
+		}
+
+		const size_t uri_end = scan::find_first_of(line.substr(method_end + 1), " ");
+		method_ = line.substr(0, method_end);
+		uri_ = line.substr(method_end + 1, uri_end);
+		version_ = uri_end == string_view::npos ? string_view() : line.substr(method_end + uri_end + 2);
+		size_ = line_end + 2;
+
+		return !uri_.empty();
+	}
+
+	string_view method() const
+	{
+		return method_;
+	}
+
+	string_view uri() const
+	{
+		return uri_;
+	}
+
+	string_view version() const
+	{
+		return version_;
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+private:
+	string_view method_;
+	string_view uri_;
+	string_view version_;
+	size_t size_ = 0;
+};
+
+// the key a request is routed by, same as the one of http_request::route
+inline bool route_key(const buffer_type& input, std::string& key)
+{
+	request_line line;
+	if (!input.empty() && line.parse(string_view(reinterpret_cast<const char*>(&input[0]), input.size())))
+	{
+		key.assign(line.method().data(), line.method().size());
+		key.append(1, ' ');
+		key.append(line.uri().data(), line.uri().size());
+		return true;
+	}
+
+	return false;
+}
+
+// a run of views making up a single piece of data, e.g. the chunks of the content
+class pieces
+{
+public:
+	using const_iterator = std::vector<string_view>::const_iterator;
+
+	void add(string_view piece)
+	{
+		pieces_.push_back(piece);
+		size_ += piece.size();
+	}
+
+	void clear()
+	{
+		pieces_.clear();
+		size_ = 0;
+	}
+
+	// the number of bytes in all of the pieces
+	size_t size() const
+	{
+		return size_;
+	}
+
+	bool empty() const
+	{
+		return size_ == 0;
+	}
+
+	size_t count() const
+	{
+		return pieces_.size();
+	}
+
+	string_view operator [](size_t i) const
+	{
+		return pieces_[i];
+	}
+
+	const_iterator begin() const
+	{
+		return pieces_.begin();
+	}
+
+	const_iterator end() const
+	{
+		return pieces_.end();
+	}
+
+	std::string str() const
+	{
+		std::string ret;
+		ret.reserve(size_);
+		for (auto p : pieces_)
+		{
+			ret.append(p.data(), p.size());
+		}
+
+		return ret;
+	}
+
+	bool equals(string_view s) const
+	{
+		if (s.size() != size_)
+		{
+			return false;
+		}
+
+		for (auto p : pieces_)
+		{
+			if (s.substr(0, p.size()) != p)
+			{
+				return false;
+			}
+
+			s.remove_prefix(p.size());
+		}
+
+		return true;
+	}
+
+private:
+	std::vector<string_view> pieces_;
+	size_t size_ = 0;
+};
+
+inline bool operator ==(const pieces& lhs, string_view rhs)
+{
+	return lhs.equals(rhs);
+}
+
+inline bool operator ==(string_view lhs, const pieces& rhs)
+{
+	return rhs.equals(lhs);
+}
+
+inline bool operator !=(const pieces& lhs, string_view rhs)
+{
+	return !lhs.equals(rhs);
+}
+
+inline bool operator !=(string_view lhs, const pieces& rhs)
+{
+	return !rhs.equals(lhs);
+}
+
+inline std::ostream& operator <<(std::ostream& stream, const pieces& p)
+{
+	for (auto piece : p)
+	{
+		stream << piece;
+	}
+
+	return stream;
+}
+
+// the parts of a request in the order the parser comes across them; the uri,
+// the header names and values and the content may come in several pieces
+// when the request arrives in several reads
+class request_events
+{
+public:
+	virtual ~request_events() {}
+
+	virtual void on_method(http_method) {}
+	virtual void on_uri(string_view) {}
+	virtual void on_version(http_version) {}
+	virtual void on_header_name(string_view) {}
+	virtual void on_header_value(string_view) {}
+	virtual void on_header_end() {}
+	virtual void on_headers_end() {}
+	virtual void on_content(string_view) {}
+	virtual void on_message_end() {}
+};
+
+// push parser keeping its state between the reads, every byte is looked at
+// once however the request is split; it stops right after the end of the
+// message, so the bytes of a pipelined request are left alone; the content
+// is either Content-Length bytes or chunked, in which case only the chunk
+// data makes it to on_content
+class request_parser
+{
+public:
+	explicit request_parser(request_events& events) : events_(events) {}
+
+	// the number of bytes consumed
+	size_t feed(string_view input);
+	void reset();
+
+	bool done() const
+	{
+		return state_ == state::done;
+	}
+
+	bool failed() const
+	{
+		return state_ == state::error;
+	}
+
+	// known by the time the headers have ended
+	bool chunked() const
+	{
+		return chunked_;
+	}
+
+	size_t content_length() const
+	{
+		return content_length_;
+	}
+
+private:
+	enum class state
+	{
+		method,
+		uri,
+		version,
+		line_lf,
+		header_start,
+		header_name,
+		header_value_start,
+		header_value,
+		header_lf,
+		head_lf,
+		content,
+		chunk_size,
+		chunk_ext,
+		chunk_size_lf,
+		chunk_data,
+		chunk_data_cr,
+		chunk_data_lf,
+		trailer_start,
+		trailer_line,
+		trailer_lf,
+		trailer_end_lf,
+		done,
+		error
+	};
+
+	// follows a header name coming in pieces, case insensitive
+	class name_matcher
+	{
+	public:
+		explicit name_matcher(string_view name) : name_(name) {}
+
+		void reset()
+		{
+			matched_ = 0;
+		}
+
+		void feed(string_view piece);
+
+		bool matches() const
+		{
+			return matched_ == name_.size();
+		}
+
+	private:
+		string_view name_;
+		size_t matched_ = 0;
+	};
+
+	bool append_token(string_view s);
+	bool parse_content_length(string_view s);
+	bool parse_chunk_size(char ch);
+	bool end_header();
+	bool end_head();
+	void finish_message();
+
+	request_events& events_;
+	state state_ = state::method;
+
+	// the method and the version are short, their pieces are gathered here
+	char token_[16];
+	size_t token_size_ = 0;
+
+	size_t uri_size_ = 0;
+	size_t name_size_ = 0;
+
+	name_matcher content_length_name_{"content-length"};
+	name_matcher transfer_encoding_name_{"transfer-encoding"};
+
+	bool length_digits_ = false;
+	bool length_done_ = false;
+	bool has_length_ = false;
+	size_t content_length_ = 0;
+
+	// Transfer-Encoding is rare and short, gathered for a closer look
+	bool has_encoding_ = false;
+	std::string encoding_;
+	bool chunked_ = false;
+
+	// the bytes left of the content or of the current chunk
+	size_t content_left_ = 0;
+	bool chunk_digits_ = false;
+};
+
+class request : private request_events
+{
+public:
+	request() : parser_(*this) {}
+	request(const request&) = delete;
+	request& operator =(const request&) = delete;
+
+	// false until the whole of the request has been received,
+	// the input is to outlive the parsed request
+	bool parse(string_view input)
+	{
+		reset();
+		return feed(input);
+	}
+
+	// the input is everything received so far, starting with the bytes given
+	// the last time; only the bytes that have not been fed yet are parsed
+	bool feed(string_view input)
+	{
+		base_ = input.data();
+		if (!parser_.done() && !parser_.failed())
+		{
+			size_ += parser_.feed(input.substr(size_));
+		}
+
+		if (parser_.done())
+		{
+			materialize();
+		}
+
+		return parser_.done();
+	}
+
+	void reset()
+	{
+		parser_.reset();
+		streaming_ = false;
+		drop_from_ = 0;
+		method_ = HTTP_BAD_METHOD;
+		version_ = HTTP_BAD_VERSION;
+		uri_ = span();
+		content_spans_.clear();
+		content_.clear();
+		header_spans_.clear();
+		new_header_ = true;
+		headers_.clear();
+		size_ = 0;
+	}
+
+	bool failed() const
+	{
+		return parser_.failed();
+	}
+
+	// HTTP/1.1 connections persist unless the client says close,
+	// HTTP/1.0 ones are closed unless it says keep-alive
+	bool keep_alive() const
+	{
+		const string_view connection = headers_.get("Connection");
+		return version_ == HTTP_10 ? has_token(connection, "keep-alive") : !has_token(connection, "close");
+	}
+
+	http_method method() const
+	{
+		return method_;
+	}
+
+	http_version version() const
+	{
+		return version_;
+	}
+
+	const pieces& content() const
+	{
+		return content_;
+	}
+
+	string_view uri() const
+	{
+		return view(uri_);
+	}
+
+	size_t size() const
+	{
+		return size_;
+	}
+
+	const wire::headers::value_type& get_header(size_t i) const
+	{
+		return headers_[i];
+	}
+
+	size_t count_headers() const
+	{
+		return headers_.count();
+	}
+
+	const wire::headers& headers() const
+	{
+		return headers_;
+	}
+
+	// the content of a request whose head alone has been parsed, received some
+	// other way, e.g. in the DATA frames of an http2 stream; it's to outlive the
+	// request, Content-Length goes along with it
+	void attach_content(string_view content)
+	{
+		content_.clear();
+		if (!content.empty())
+		{
+			content_.add(content);
+			// the length the head came with, if any, gives way to the real one
+			attached_length_ = std::to_string(content.size());
+			headers_.set("Content-Length", attached_length_);
+		}
+	}
+
+	// the content longer than the threshold, or chunked, goes through a digest
+	// of the given algorithms instead of being kept; it applies to the requests
+	// whose headers haven't ended yet
+	void stream_content_over(size_t threshold, unsigned algorithms)
+	{
+		stream_threshold_ = threshold;
+		stream_algorithms_ = algorithms;
+	}
+
+	// the digest of the content streamed, null unless it is
+	const content_digest* streamed() const
+	{
+		return streaming_ ? &digest_ : nullptr;
+	}
+
+	// the bytes of the content streamed since the last call, the caller drops
+	// them from the input and the request gets shorter by that many;
+	// they start at pos, past the head, and the input is not to move
+	size_t drop_streamed(size_t& pos)
+	{
+		if (!streaming_ || !drop_from_ || size_ <= drop_from_)
+		{
+			return 0;
+		}
+
+		pos = drop_from_;
+		const size_t count = size_ - drop_from_;
+		size_ = drop_from_;
+		return count;
+	}
+
+private:
+	// the pieces are kept as offsets for the input may move between the reads
+	struct span
+	{
+		size_t pos = 0;
+		size_t len = 0;
+	};
+
+	void extend(span& s, string_view piece)
+	{
+		if (s.len == 0)
+		{
+			s.pos = piece.data() - base_;
+		}
+
+		s.len += piece.size();
+	}
+
+	string_view view(span s) const
+	{
+		return string_view(base_ + s.pos, s.len);
+	}
+
+	void materialize()
+	{
+		headers_.clear();
+		for (auto& h : header_spans_)
+		{
+			headers_.add(trim(view(h.first)), trim(view(h.second)));
+		}
+
+		content_.clear();
+		for (auto& c : content_spans_)
+		{
+			content_.add(view(c));
+		}
+	}
+
+	void on_method(http_method m) override
+	{
+		method_ = m;
+	}
+
+	void on_uri(string_view piece) override
+	{
+		extend(uri_, piece);
+	}
+
+	void on_version(http_version v) override
+	{
+		version_ = v;
+	}
+
+	void on_header_name(string_view piece) override
+	{
+		if (new_header_)
+		{
+			header_spans_.emplace_back();
+			new_header_ = false;
+		}
+
+		extend(header_spans_.back().first, piece);
+	}
+
+	void on_header_value(string_view piece) override
+	{
+		extend(header_spans_.back().second, piece);
+	}
+
+	void on_header_end() override
+	{
+		new_header_ = true;
+	}
+
+	void on_headers_end() override
+	{
+		streaming_ = stream_algorithms_ && (parser_.chunked() || parser_.content_length() > stream_threshold_);
+		if (streaming_)
+		{
+			digest_ = content_digest(stream_algorithms_);
+		}
+	}
+
+	void on_content(string_view piece) override
+	{
+		if (streaming_)
+		{
+			// whatever follows, chunk framing included, goes once it's been fed
+			if (!drop_from_)
+			{
+				drop_from_ = piece.data() - base_;
+			}
+
+			digest_.update(piece);
+			return;
+		}
+
+		// the pieces of a chunk split by the reads are still contiguous
+		const size_t pos = piece.data() - base_;
+		if (content_spans_.empty() || content_spans_.back().pos + content_spans_.back().len != pos)
+		{
+			content_spans_.emplace_back();
+		}
+
+		extend(content_spans_.back(), piece);
+	}
+
+	request_parser parser_;
+	const char* base_ = nullptr;
+	http_method method_ = HTTP_BAD_METHOD;
+	http_version version_ = HTTP_BAD_VERSION;
+	span uri_;
+	std::vector<span> content_spans_;
+	pieces content_;
+	std::vector<std::pair<span, span>> header_spans_;
+	bool new_header_ = true;
+	wire::headers headers_;
+	size_t size_ = 0;
+	std::string attached_length_;
+
+	size_t stream_threshold_ = 0;
+	unsigned stream_algorithms_ = 0;
+	bool streaming_ = false;
+	size_t drop_from_ = 0;
+	content_digest digest_;
+};
+
+} // namespace wire
+
+} // namespace nemok
@@ -0,0 +1,51 @@
+#include <gtest/gtest.h>
+#include "nemok/body.h"
+
+struct body_test : public ::testing::Test
+{
+	// the whole body at once and then in pieces of every size
+	void expect_same_in_pieces(const nemok::body_generator& generate, size_t size)
+	{
+		std::string whole(size, '\0');
+		generate(&whole[0], size, 0);
+
+		for (size_t step = 1; step <= size; ++step)
+		{
+			std::string pieces(size, '\0');
+			for (size_t offset = 0; offset < size; offset += step)
+			{
+				generate(&pieces[offset], std::min(step, size - offset), offset);
+			}
+
+			ASSERT_EQ(whole, pieces) << "step " << step;
+		}
+	}
+};
+
+TEST_F(body_test, repeats_the_pattern)
+{
+	std::string body(12, '\0');
+	nemok::body::repeat("abcde")(&body[0], body.size(), 3);
+
+	EXPECT_EQ("deabcdeabcde", body);
+	expect_same_in_pieces(nemok::body::repeat("abcde"), 50);
+}
+
+TEST_F(body_test, makes_the_same_random_bytes_for_the_same_seed)
+{
+	std::string a(64, '\0');
+	std::string b(64, '\0');
+	std::string c(64, '\0');
+	nemok::body::random(1)(&a[0], a.size(), 0);
+	nemok::body::random(1)(&b[0], b.size(), 0);
+	nemok::body::random(2)(&c[0], c.size(), 0);
+
+	EXPECT_EQ(a, b);
+	EXPECT_NE(a, c);
+	expect_same_in_pieces(nemok::body::random(7), 50);
+}
+
+TEST_F(body_test, refuses_empty_pattern)
+{
+	EXPECT_THROW(nemok::body::repeat(""), nemok::exception);
+}
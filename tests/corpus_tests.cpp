@@ -0,0 +1,108 @@
+#include <gtest/gtest.h>
+#include <fstream>
+#include "nemok/nemok.h"
+
+using namespace nemok;
+
+// every test has a file of its own, removed once the test is over
+struct corpus_test : public ::testing::Test
+{
+	corpus_test()
+	{
+		char name[] = "/tmp/nemok_corpus_XXXXXX";
+		::close(::mkstemp(name));
+		path = name;
+	}
+
+	~corpus_test()
+	{
+		::unlink(path.c_str());
+	}
+
+	std::string path;
+};
+
+TEST_F(corpus_test, finds_every_response)
+{
+	corpus_builder b;
+	for (int i = 0; i < 5000; ++i)
+	{
+		b.add(corpus_key("GET", "/items/" + std::to_string(i)), "item " + std::to_string(i));
+	}
+
+	b.add(corpus_key("GET", "/items/7"), "shadowed");
+	b.add("DELETE /", std::string("\0binary\0", 8));
+	b.write(path);
+
+	corpus c(path);
+	EXPECT_EQ(5001u, c.size());
+
+	string_view response;
+	for (int i = 0; i < 5000; ++i)
+	{
+		ASSERT_TRUE(c.find("GET /items/" + std::to_string(i), response));
+		ASSERT_EQ("item " + std::to_string(i), response);
+		ASSERT_EQ(0u, reinterpret_cast<uintptr_t>(response.data()) % corpus_alignment);
+	}
+
+	ASSERT_TRUE(c.find("DELETE /", response));
+	EXPECT_EQ(std::string("\0binary\0", 8), response);
+	EXPECT_FALSE(c.find("GET /items/5000", response));
+	EXPECT_FALSE(c.find("POST /items/1", response));
+}
+
+TEST_F(corpus_test, maps_empty_corpus)
+{
+	corpus_builder().write(path);
+
+	corpus c(path);
+	string_view response;
+	EXPECT_EQ(0u, c.size());
+	EXPECT_FALSE(c.find("GET /", response));
+}
+
+TEST_F(corpus_test, refuses_what_is_not_a_corpus)
+{
+	std::ofstream(path) << "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+	EXPECT_THROW(corpus c(path), corpus_error);
+	EXPECT_THROW(corpus c("/nonexistent/nemok.corpus"), corpus_error);
+}
+
+TEST_F(corpus_test, serves_responses_from_the_mapping)
+{
+	corpus_builder b;
+	b.add("GET /users/1", "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nalice");
+	b.add("GET /users/1?full=1", "HTTP/1.1 200 OK\r\nContent-Length: 9\r\n\r\nalice 100");
+	b.write(path);
+
+	auto mock = start<http>();
+	mock.when(http::request()).serve_corpus(path);
+
+	auto c = mock.connect();
+	http::send(c, "GET /users/1 HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nalice", http::receive(c));
+	http::send(c, "GET /users/1?full=1 HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 9\r\n\r\nalice 100", http::receive(c));
+	http::send(c, "GET /users/2 HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+}
+
+TEST_F(corpus_test, compiles_recorded_exchanges)
+{
+	std::vector<trace_log::exchange> exchanges(3);
+	exchanges[0].request = "GET /a HTTP/1.1\r\n\r\n";
+	exchanges[0].response = "first";
+	exchanges[1].request = "not http";
+	exchanges[1].response = "ignored";
+	exchanges[2].request = "GET /a HTTP/1.1\r\n\r\n";
+	exchanges[2].response = "second";
+
+	corpus_builder b;
+	EXPECT_EQ(2u, add_recorded(b, exchanges));
+	b.write(path);
+
+	corpus c(path);
+	string_view response;
+	ASSERT_TRUE(c.find("GET /a", response));
+	EXPECT_EQ("first", response);
+}
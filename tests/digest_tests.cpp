@@ -0,0 +1,144 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+
+using namespace nemok;
+
+struct digest_test : public ::testing::Test
+{
+	std::string hex(digest_algorithm a, string_view data)
+	{
+		content_digest d(DIGEST_CRC32C | DIGEST_XXH64 | DIGEST_SHA256);
+		d.update(data);
+		return d.hex(a);
+	}
+
+	std::string sample()
+	{
+		std::string ret;
+		for (int i = 0; i < 3; ++i)
+		{
+			for (int byte = 0; byte < 256; ++byte)
+			{
+				ret.append(1, char(byte));
+			}
+		}
+
+		return ret + "xyz";
+	}
+};
+
+TEST_F(digest_test, computes_known_digests)
+{
+	EXPECT_EQ("00000000", hex(DIGEST_CRC32C, ""));
+	EXPECT_EQ("e3069283", hex(DIGEST_CRC32C, "123456789"));
+	EXPECT_EQ("665d3f04", hex(DIGEST_CRC32C, sample()));
+
+	EXPECT_EQ("ef46db3751d8e999", hex(DIGEST_XXH64, ""));
+	EXPECT_EQ("44bc2cf5ad770999", hex(DIGEST_XXH64, "abc"));
+	EXPECT_EQ("e921a1b45bd779f8", hex(DIGEST_XXH64, sample()));
+
+	EXPECT_EQ("e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855", hex(DIGEST_SHA256, ""));
+	EXPECT_EQ("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", hex(DIGEST_SHA256, "abc"));
+	EXPECT_EQ("c88b6dc887c181168f0090f9b194fa95a4941342d49ba8bec914fd7ce64881a7", hex(DIGEST_SHA256, sample()));
+}
+
+TEST_F(digest_test, does_not_depend_on_how_content_is_split)
+{
+	const std::string data = sample();
+	const unsigned all = DIGEST_CRC32C | DIGEST_XXH64 | DIGEST_SHA256;
+	for (size_t step : {1, 3, 7, 31, 32, 33, 64, 65, 500})
+	{
+		content_digest d(all);
+		for (size_t pos = 0; pos < data.size(); pos += step)
+		{
+			d.update(string_view(data).substr(pos, step));
+		}
+
+		EXPECT_EQ(data.size(), d.length());
+		EXPECT_EQ("665d3f04", d.hex(DIGEST_CRC32C)) << step;
+		EXPECT_EQ("e921a1b45bd779f8", d.hex(DIGEST_XXH64)) << step;
+		EXPECT_EQ("c88b6dc887c181168f0090f9b194fa95a4941342d49ba8bec914fd7ce64881a7", d.hex(DIGEST_SHA256)) << step;
+	}
+
+	EXPECT_EQ("", content_digest(DIGEST_CRC32C).hex(DIGEST_SHA256));
+}
+
+TEST_F(digest_test, matches_short_content_by_digest)
+{
+	auto mock = start<http>();
+	mock.when(http::PUT("/blobs/1").with_content_length(3).with_content_digest(DIGEST_SHA256,
+		"BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD")).reply(http::response(201));
+	mock.when(http::PUT("/blobs/1")).reply(http::response(400)).order(200);
+
+	// the fallback is only tried once the digest has turned the request down
+	auto c = mock.connect();
+	http::send(c, http::PUT("/blobs/1").content("abd"));
+	EXPECT_EQ("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+	http::send(c, http::PUT("/blobs/1").content("abc"));
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+}
+
+TEST_F(digest_test, streams_long_content)
+{
+	const uint64_t size = 8 << 20;
+	const body_generator generate = body::random(7);
+
+	content_digest expected(DIGEST_CRC32C | DIGEST_XXH64);
+	std::vector<char> piece(65536);
+	for (uint64_t offset = 0; offset < size; offset += piece.size())
+	{
+		generate(&piece[0], piece.size(), offset);
+		expected.update(string_view(&piece[0], piece.size()));
+	}
+
+	auto mock = start<http>();
+	mock.when(http::PUT("/blobs/1")
+		.with_content_length(size)
+		.with_content_digest(DIGEST_CRC32C, expected.hex(DIGEST_CRC32C))
+		.with_content_digest(DIGEST_XXH64, expected.hex(DIGEST_XXH64))).reply(http::response(201));
+	mock.when(http::PUT("/blobs/1")).reply(http::response(400)).order(200);
+
+	// the last byte differs
+	auto c = mock.connect();
+	http::send(c, "PUT /blobs/1 HTTP/1.1\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n");
+	write_generated(c, generate, size - 1);
+	write_client(c, "!");
+	EXPECT_EQ("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+
+	http::send(c, "PUT /blobs/1 HTTP/1.1\r\nContent-Length: " + std::to_string(size) + "\r\n\r\n");
+	write_generated(c, generate, size);
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+}
+
+TEST_F(digest_test, streams_chunked_content)
+{
+	const std::string data = sample();
+	content_digest expected(DIGEST_XXH64);
+	expected.update(data);
+
+	auto mock = start<http>();
+	mock.when(http::POST("/upload").with_content_length(data.size()).with_content_digest(DIGEST_XXH64, expected.hex(DIGEST_XXH64)))
+		.reply(http::response(201));
+	mock.when(http::GET("/next")).reply(http::response(200));
+
+	// the request that follows right away is left alone
+	std::string chunked = "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+	for (size_t pos = 0; pos < data.size(); pos += 100)
+	{
+		const std::string chunk = data.substr(pos, 100);
+		char size[16];
+		snprintf(size, sizeof(size), "%zx", chunk.size());
+		chunked += size + std::string(";ext=1\r\n") + chunk + "\r\n";
+	}
+
+	chunked += "0\r\n\r\nGET /next HTTP/1.1\r\n\r\n";
+
+	auto c = mock.connect();
+	for (size_t pos = 0; pos < chunked.size(); pos += 37)
+	{
+		write_client(c, chunked.substr(pos, 37));
+	}
+
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+}
@@ -0,0 +1,104 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+#include "http_test_fixture.h"
+
+using namespace nemok;
+
+struct encoding_test : public http_test_fixture
+{
+};
+
+TEST_F(encoding_test, compresses_and_decompresses)
+{
+	std::string data;
+	for (int i = 0; i < 1000; ++i)
+	{
+		data += "line " + std::to_string(i % 17) + " of the text\n";
+	}
+
+	for (content_coding c : {CODING_IDENTITY, CODING_GZIP, CODING_DEFLATE})
+	{
+		EXPECT_EQ(data, encoding::decompress(c, encoding::compress(c, data))) << encoding::name(c);
+		EXPECT_EQ("", encoding::decompress(c, encoding::compress(c, ""))) << encoding::name(c);
+	}
+
+	const std::string gzipped = encoding::compress(CODING_GZIP, data);
+	EXPECT_LT(gzipped.size(), data.size() / 10);
+	EXPECT_EQ("\x1f\x8b", gzipped.substr(0, 2));
+	EXPECT_EQ(0x78, uint8_t(encoding::compress(CODING_DEFLATE, data)[0]));
+	EXPECT_THROW(encoding::decompress(CODING_GZIP, data), encoding_error);
+}
+
+TEST_F(encoding_test, negotiates_coding)
+{
+	EXPECT_EQ(CODING_IDENTITY, encoding::negotiate(""));
+	EXPECT_EQ(CODING_GZIP, encoding::negotiate("gzip, deflate, br"));
+	EXPECT_EQ(CODING_GZIP, encoding::negotiate("deflate, gzip"));
+	EXPECT_EQ(CODING_DEFLATE, encoding::negotiate("deflate"));
+	EXPECT_EQ(CODING_DEFLATE, encoding::negotiate("gzip;q=0.5, deflate;q=0.8"));
+	EXPECT_EQ(CODING_GZIP, encoding::negotiate("X-GZIP"));
+	EXPECT_EQ(CODING_GZIP, encoding::negotiate("*"));
+	EXPECT_EQ(CODING_DEFLATE, encoding::negotiate("gzip;q=0, *;q=0.1"));
+	EXPECT_EQ(CODING_IDENTITY, encoding::negotiate("br"));
+	EXPECT_EQ(CODING_IDENTITY, encoding::negotiate("gzip;q=0"));
+	EXPECT_EQ(CODING_IDENTITY, encoding::negotiate("gzip;q=2"));
+	EXPECT_EQ(CODING_IDENTITY, encoding::negotiate("identity;q=0"));
+}
+
+TEST_F(encoding_test, replies_with_negotiated_variant)
+{
+	const std::string content(20000, 'a');
+
+	auto mock = start<http>();
+	mock.when(http::GET("/page")).reply(http::response(200).content(content).precompress());
+
+	auto c = mock.connect();
+	http::send(c, "GET /page HTTP/1.1\r\nAccept-Encoding: gzip, deflate\r\n\r\n");
+	std::string response = http::receive(c);
+	EXPECT_EQ("gzip", header(response, "Content-Encoding"));
+	EXPECT_EQ("Accept-Encoding", header(response, "Vary"));
+	EXPECT_EQ(std::to_string(body(response).size()), header(response, "Content-Length"));
+	EXPECT_EQ(content, encoding::decompress(CODING_GZIP, body(response)));
+
+	http::send(c, "GET /page HTTP/1.1\r\nAccept-Encoding: deflate\r\n\r\n");
+	response = http::receive(c);
+	EXPECT_EQ("deflate", header(response, "Content-Encoding"));
+	EXPECT_EQ(content, encoding::decompress(CODING_DEFLATE, body(response)));
+
+	http::send(c, "GET /page HTTP/1.1\r\n\r\n");
+	response = http::receive(c);
+	EXPECT_EQ("", header(response, "Content-Encoding"));
+	EXPECT_EQ("Accept-Encoding", header(response, "Vary"));
+	EXPECT_EQ(content, body(response));
+}
+
+TEST_F(encoding_test, revalidates_every_variant_by_its_own_etag)
+{
+	const std::string content(20000, 'a');
+	cache_policy policy;
+	policy.etag = "\"v1\"";
+
+	auto mock = start<http>();
+	mock.when(http::GET("/page")).reply_cacheable(http::response(200).content(content).precompress(), policy);
+
+	auto c = mock.connect();
+	http::send(c, "GET /page HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n");
+	std::string response = http::receive(c);
+	EXPECT_EQ("gzip", header(response, "Content-Encoding"));
+	EXPECT_EQ("Accept-Encoding", header(response, "Vary"));
+	EXPECT_EQ("\"v1-gzip\"", header(response, "ETag"));
+	EXPECT_EQ(content, encoding::decompress(CODING_GZIP, body(response)));
+
+	http::send(c, "GET /page HTTP/1.1\r\nAccept-Encoding: gzip\r\nIf-None-Match: \"v1-gzip\"\r\n\r\n");
+	response = http::receive(c);
+	EXPECT_EQ("HTTP/1.1 304 Not Modified\r\n", response.substr(0, 27));
+	EXPECT_EQ("\"v1-gzip\"", header(response, "ETag"));
+	EXPECT_EQ("Accept-Encoding", header(response, "Vary"));
+
+	// the validator of the gzip variant doesn't do for the identity one
+	http::send(c, "GET /page HTTP/1.1\r\nIf-None-Match: \"v1-gzip\"\r\n\r\n");
+	response = http::receive(c);
+	EXPECT_EQ("\"v1\"", header(response, "ETag"));
+	EXPECT_EQ("", header(response, "Content-Encoding"));
+	EXPECT_EQ(content, body(response));
+}
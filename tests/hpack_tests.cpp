@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+#include "nemok/hpack.h"
+
+using namespace nemok;
+
+struct hpack_test : public ::testing::Test
+{
+	static std::string unhex(const std::string& hex)
+	{
+		std::string ret;
+		for (size_t i = 0; i + 1 < hex.size(); i += 2)
+		{
+			ret.append(1, char(std::stoi(hex.substr(i, 2), nullptr, 16)));
+		}
+
+		return ret;
+	}
+
+	hpack::header_list decode(const std::string& hex)
+	{
+		const std::string block = unhex(hex);
+		hpack::header_list headers;
+		EXPECT_TRUE(decoder.decode(block, headers));
+		return headers;
+	}
+
+	hpack::decoder decoder;
+};
+
+// RFC 7541, C.4 requests with huffman coding, the table is shared by all three
+TEST_F(hpack_test, decodes_requests_sharing_the_table)
+{
+	const hpack::header_list first = {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}, {":authority", "www.example.com"}};
+	EXPECT_EQ(first, decode("828684418cf1e3c2e5f23a6ba0ab90f4ff"));
+
+	hpack::header_list second = first;
+	second.emplace_back("cache-control", "no-cache");
+	EXPECT_EQ(second, decode("828684be5886a8eb10649cbf"));
+
+	const hpack::header_list third = {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+		{":authority", "www.example.com"}, {"custom-key", "custom-value"}};
+	EXPECT_EQ(third, decode("828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"));
+}
+
+TEST_F(hpack_test, decodes_huffman_coded_symbols_of_every_length)
+{
+	const hpack::header_list headers = {{":method", "POST"}, {":path", "/users/42?x=%20&y=\xc3\xbf"},
+		{"x-bin", "~!@#$%^&*()_+{}|:\"<>?"}};
+	EXPECT_EQ(headers, decode("83449362d416c430d0bfcf302a207c7a83fff8fffff14084f2b466ab9dffeff1ffaffaffcabffe7c7cff5fdc5feffff7ffbff2e7f3fff3feffcf"));
+}
+
+TEST_F(hpack_test, encodes_what_it_decodes)
+{
+	const hpack::header_list headers = {{":status", "200"}, {"content-type", "text/plain"}, {"x-long", std::string(300, 'x')}};
+	std::string block;
+	hpack::encode(headers, block);
+
+	hpack::header_list decoded;
+	ASSERT_TRUE(decoder.decode(block, decoded));
+	EXPECT_EQ(headers, decoded);
+}
+
+TEST_F(hpack_test, encodes_integers_with_prefix)
+{
+	// RFC 7541, C.1
+	std::string out;
+	hpack::encode_integer(10, 5, 0, out);
+	EXPECT_EQ(unhex("0a"), out);
+
+	out.clear();
+	hpack::encode_integer(1337, 5, 0, out);
+	EXPECT_EQ(unhex("1f9a0a"), out);
+
+	string_view in(out);
+	size_t value = 0;
+	ASSERT_TRUE(hpack::decode_integer(in, 5, value));
+	EXPECT_EQ(1337u, value);
+	EXPECT_TRUE(in.empty());
+
+	const std::string truncated = unhex("1f9a");
+	in = truncated;
+	EXPECT_FALSE(hpack::decode_integer(in, 5, value));
+}
+
+TEST_F(hpack_test, refuses_bad_huffman_padding)
+{
+	std::string out;
+	EXPECT_TRUE(hpack::huffman_decode(unhex("f1e3c2e5f23a6ba0ab90f4ff"), out));
+	EXPECT_EQ("www.example.com", out);
+
+	// the padding is to be made of ones and be shorter than a byte
+	out.clear();
+	EXPECT_FALSE(hpack::huffman_decode(unhex("f1e3c2e5f23a6ba0ab90f4fe"), out));
+	out.clear();
+	EXPECT_FALSE(hpack::huffman_decode(unhex("f1e3c2e5f23a6ba0ab90f4ffff"), out));
+}
+
+TEST_F(hpack_test, refuses_out_of_range_index)
+{
+	hpack::header_list headers;
+	EXPECT_FALSE(decoder.decode(unhex("ff00"), headers));
+}
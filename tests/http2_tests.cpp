@@ -0,0 +1,288 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+#include "nemok/hpack.h"
+
+using namespace nemok;
+
+struct http2_mock_test : public ::testing::Test
+{
+	using resp = http::response;
+
+	struct frame
+	{
+		int type;
+		int flags;
+		uint32_t stream;
+		std::string payload;
+	};
+
+	struct response
+	{
+		hpack::header_list headers;
+		std::string content;
+	};
+
+	static std::string setting(uint16_t id, uint32_t value)
+	{
+		const char s[] = {char(id >> 8), char(id), char(value >> 24), char(value >> 16), char(value >> 8), char(value)};
+		return std::string(s, sizeof(s));
+	}
+
+	void open(client& c, std::string settings = "")
+	{
+		const std::string preface(http2_preface, http2_preface_size);
+		write_client(c, preface + http2_frame(HTTP2_SETTINGS, 0, 0, settings));
+	}
+
+	void get(client& c, uint32_t stream, std::string path)
+	{
+		std::string block;
+		hpack::encode({{":method", "GET"}, {":scheme", "http"}, {":path", path}, {":authority", "localhost"}}, block);
+		write_client(c, http2_frame(HTTP2_HEADERS, HTTP2_END_HEADERS | HTTP2_END_STREAM, stream, block));
+	}
+
+	frame read_frame(client& c)
+	{
+		const std::string header = read_all(c, http2_frame_header_size);
+		const uint8_t* h = reinterpret_cast<const uint8_t*>(header.data());
+
+		frame f;
+		const size_t length = (size_t(h[0]) << 16) | (size_t(h[1]) << 8) | h[2];
+		f.type = h[3];
+		f.flags = h[4];
+		f.stream = (uint32_t(h[5] & 0x7f) << 24) | (uint32_t(h[6]) << 16) | (uint32_t(h[7]) << 8) | h[8];
+		f.payload = length ? read_all(c, length) : "";
+		return f;
+	}
+
+	// the responses in the order they are complete
+	std::vector<std::pair<uint32_t, response>> read_responses(client& c, size_t count)
+	{
+		std::map<uint32_t, response> pending;
+		std::vector<std::pair<uint32_t, response>> done;
+		while (done.size() < count)
+		{
+			const frame f = read_frame(c);
+			if (f.type == HTTP2_HEADERS)
+			{
+				EXPECT_TRUE(f.flags & HTTP2_END_HEADERS);
+				EXPECT_TRUE(decoder.decode(f.payload, pending[f.stream].headers));
+			}
+			else if (f.type == HTTP2_DATA)
+			{
+				EXPECT_LE(f.payload.size(), 16384u);
+				pending[f.stream].content += f.payload;
+			}
+			else
+			{
+				continue;
+			}
+
+			if (f.flags & HTTP2_END_STREAM)
+			{
+				done.emplace_back(f.stream, pending[f.stream]);
+				pending.erase(f.stream);
+			}
+		}
+
+		return done;
+	}
+
+	hpack::decoder decoder;
+};
+
+TEST_F(http2_mock_test, replies_to_a_request_according_to_specified_expectation)
+{
+	auto mock = start<http2>();
+	mock.when(http::GET("/")).reply(resp(200).content("hello"));
+
+	auto c = mock.connect();
+	open(c);
+	get(c, 1, "/");
+
+	auto responses = read_responses(c, 1);
+	ASSERT_EQ(1u, responses.size());
+	EXPECT_EQ(1u, responses[0].first);
+	const hpack::header_list headers = {{":status", "200"}, {"content-length", "5"}};
+	EXPECT_EQ(headers, responses[0].second.headers);
+	EXPECT_EQ("hello", responses[0].second.content);
+}
+
+TEST_F(http2_mock_test, acknowledges_settings_and_ping)
+{
+	auto mock = start<http2>();
+	auto c = mock.connect();
+	open(c);
+	write_client(c, http2_frame(HTTP2_PING, 0, 0, "12345678"));
+
+	bool settings_ack = false;
+	bool ping_ack = false;
+	while (!settings_ack || !ping_ack)
+	{
+		const frame f = read_frame(c);
+		settings_ack = settings_ack || (f.type == HTTP2_SETTINGS && (f.flags & HTTP2_ACK));
+		if (f.type == HTTP2_PING)
+		{
+			EXPECT_EQ(HTTP2_ACK, f.flags);
+			EXPECT_EQ("12345678", f.payload);
+			ping_ack = true;
+		}
+	}
+}
+
+TEST_F(http2_mock_test, serves_delayed_streams_without_blocking_the_others)
+{
+	auto mock = start<http2>();
+	mock.when(http::GET("/slow")).delay(std::chrono::milliseconds(200)).reply(resp(200).content("slow"));
+	mock.when(http::GET("/fast")).reply(resp(200).content("fast"));
+	mock.when(http::GET("/users/{id}")).reply(resp(404));
+
+	auto c = mock.connect();
+	open(c);
+	get(c, 1, "/slow");
+	get(c, 3, "/fast");
+	get(c, 5, "/users/42");
+
+	// the fast ones go first, in whatever order
+	auto responses = read_responses(c, 3);
+	ASSERT_EQ(3u, responses.size());
+	EXPECT_EQ(1u, responses[2].first);
+	EXPECT_EQ("slow", responses[2].second.content);
+
+	const hpack::header_list not_found = {{":status", "404"}, {"content-length", "0"}};
+	auto& users = responses[0].first == 5 ? responses[0] : responses[1];
+	EXPECT_EQ(5u, users.first);
+	EXPECT_EQ(not_found, users.second.headers);
+}
+
+TEST_F(http2_mock_test, matches_request_headers_and_content)
+{
+	auto mock = start<http2>();
+	mock.when(http::POST("/echo").header("x-token", "secret").content("ping")).reply(resp(201));
+
+	auto c = mock.connect();
+	open(c);
+
+	std::string block;
+	hpack::encode({{":method", "POST"}, {":scheme", "http"}, {":path", "/echo"}, {"x-token", "secret"}}, block);
+	write_client(c, http2_frame(HTTP2_HEADERS, HTTP2_END_HEADERS, 1, block));
+	write_client(c, http2_frame(HTTP2_DATA, 0, 1, "pi"));
+	write_client(c, http2_frame(HTTP2_DATA, HTTP2_END_STREAM, 1, "ng"));
+
+	auto responses = read_responses(c, 1);
+	ASSERT_EQ(1u, responses.size());
+	EXPECT_EQ((hpack::field{":status", "201"}), responses[0].second.headers.at(0));
+}
+
+TEST_F(http2_mock_test, matches_content_length_of_data_frames)
+{
+	auto mock = start<http2>();
+	mock.when(http::PUT("/blob").header("Content-Length", "6").content("abcdef")).reply(resp(201));
+	mock.when(http::PUT("/blob")).reply(resp(400));
+
+	auto c = mock.connect();
+	open(c);
+
+	std::string block;
+	hpack::encode({{":method", "PUT"}, {":scheme", "http"}, {":path", "/blob"}, {"content-length", "999"}}, block);
+	write_client(c, http2_frame(HTTP2_HEADERS, HTTP2_END_HEADERS, 1, block));
+	write_client(c, http2_frame(HTTP2_DATA, 0, 1, "abc"));
+	write_client(c, http2_frame(HTTP2_DATA, HTTP2_END_STREAM, 1, "def"));
+
+	auto responses = read_responses(c, 1);
+	ASSERT_EQ(1u, responses.size());
+	EXPECT_EQ((hpack::field{":status", "201"}), responses[0].second.headers.at(0));
+}
+
+TEST_F(http2_mock_test, respects_flow_control_windows)
+{
+	const size_t size = 100000;
+	auto mock = start<http2>();
+	mock.when(http::GET("/blob")).reply(resp(200), body::repeat("0123456789"), size);
+
+	auto c = mock.connect();
+	open(c, setting(HTTP2_INITIAL_WINDOW_SIZE, 1000));
+	get(c, 1, "/blob");
+
+	// nothing more than the window allows until it's been updated
+	size_t received = 0;
+	while (received < 1000)
+	{
+		const frame f = read_frame(c);
+		if (f.type == HTTP2_DATA)
+		{
+			received += f.payload.size();
+		}
+	}
+
+	EXPECT_EQ(1000u, received);
+
+	std::string increment;
+	const char inc[] = {0, 0x10, 0, 0};
+	increment.assign(inc, sizeof(inc));
+	write_client(c, http2_frame(HTTP2_WINDOW_UPDATE, 0, 0, increment) + http2_frame(HTTP2_WINDOW_UPDATE, 0, 1, increment));
+
+	while (received < size)
+	{
+		const frame f = read_frame(c);
+		if (f.type == HTTP2_DATA)
+		{
+			EXPECT_LE(f.payload.size(), 16384u);
+			received += f.payload.size();
+		}
+	}
+
+	EXPECT_EQ(size, received);
+}
+
+TEST_F(http2_mock_test, goes_away_on_bad_preface)
+{
+	auto mock = start<http2>();
+	auto c = mock.connect();
+	write_client(c, "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+
+	const frame f = read_frame(c);
+	EXPECT_EQ(HTTP2_GOAWAY, f.type);
+}
+
+TEST_F(http2_mock_test, refuses_streams_over_the_limit)
+{
+	auto mock = start<http2>();
+	auto c = mock.connect();
+	open(c);
+
+	// the requests never end, so every stream stays open
+	std::string block;
+	hpack::encode({{":method", "POST"}, {":scheme", "http"}, {":path", "/"}}, block);
+	std::string frames;
+	for (uint32_t stream = 1; stream <= 2049; stream += 2)
+	{
+		frames += http2_frame(HTTP2_HEADERS, HTTP2_END_HEADERS, stream, block);
+	}
+
+	write_client(c, frames);
+
+	frame f = read_frame(c);
+	while (f.type != HTTP2_RST_STREAM)
+	{
+		f = read_frame(c);
+	}
+
+	EXPECT_EQ(2049u, f.stream);
+	EXPECT_EQ(std::string("\0\0\0\x07", 4), f.payload);
+}
+
+TEST_F(http2_mock_test, sends_queued_responses_after_the_peer_is_done)
+{
+	auto mock = start<http2>();
+	mock.when(http::GET("/slow")).delay(std::chrono::milliseconds(100)).reply(resp(200).content("slow"));
+
+	auto c = mock.connect();
+	open(c);
+	get(c, 1, "/slow");
+	c.shutdown_write();
+
+	auto responses = read_responses(c, 1);
+	ASSERT_EQ(1u, responses.size());
+	EXPECT_EQ("slow", responses[0].second.content);
+}
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+#include "nemok/wire.h"
+
+struct http_parser_test : public ::testing::Test
+{
+	nemok::wire::request request;
+	nemok::wire::request_line line;
+	std::string input;
+
+	// the parsed line refers to the input, keep it alive
+	bool parse_line(std::string str)
+	{
+		input = std::move(str);
+		return line.parse(input);
+	}
+};
+
+TEST_F(http_parser_test, parses_a_request_without_headers)
+{
+	EXPECT_TRUE(request.parse("GET /hello HTTP/1.1\r\n\r\n"));
+
+	EXPECT_EQ(nemok::HTTP_GET, request.method());
+	EXPECT_EQ("/hello", request.uri());
+	EXPECT_EQ(nemok::HTTP_11, request.version());
+	EXPECT_EQ(23u, request.size());
+}
+
+TEST_F(http_parser_test, parses_request_headers_and_content)
+{
+	EXPECT_TRUE(request.parse("POST / HTTP/1.1\r\nContent-Length: 5\r\nHost: localhost\r\n\r\nhello"));
+
+	EXPECT_EQ(nemok::HTTP_POST, request.method());
+	EXPECT_EQ("hello", request.content());
+	ASSERT_EQ(2u, request.count_headers());
+	EXPECT_EQ("Host", request.get_header(1).first);
+	EXPECT_EQ("localhost", request.get_header(1).second);
+}
+
+TEST_F(http_parser_test, waits_for_the_whole_content_to_arrive)
+{
+	EXPECT_FALSE(request.parse("POST / HTTP/1.1\r\nContent-Length: 5\r\n\r\nhel"));
+}
+
+TEST_F(http_parser_test, parses_request_line_before_the_headers_arrive)
+{
+	EXPECT_TRUE(parse_line("GET /users/42 HTTP/1.1\r\nHost: loc"));
+
+	EXPECT_EQ("GET", line.method());
+	EXPECT_EQ("/users/42", line.uri());
+	EXPECT_EQ(24u, line.size());
+}
+
+TEST_F(http_parser_test, fails_to_parse_incomplete_request_line)
+{
+	EXPECT_FALSE(parse_line("GET /users/42 HT"));
+	EXPECT_FALSE(parse_line("GET\r\n"));
+}
+
+TEST_F(http_parser_test, refers_to_the_input_instead_of_copying_it)
+{
+	input = "POST /file HTTP/1.1\r\nContent-Length: 4\r\nX-Tag:  a b \r\n\r\ndata";
+	ASSERT_TRUE(request.parse(input));
+
+	EXPECT_EQ(input.data() + 5, request.uri().data());
+	EXPECT_EQ(input.data() + input.size() - 4, request.content()[0].data());
+	EXPECT_EQ("a b", request.headers().get("X-Tag"));
+}
+
+TEST_F(http_parser_test, looks_headers_up_ignoring_the_case)
+{
+	input = "GET / HTTP/1.1\r\ncontent-type: text/plain\r\nX-TAG: a\r\n\r\n";
+	ASSERT_TRUE(request.parse(input));
+
+	EXPECT_EQ("text/plain", request.headers().get("Content-Type"));
+	EXPECT_EQ("a", request.headers().get("x-tag"));
+	EXPECT_FALSE(request.headers().has("X-Tags"));
+}
+
+TEST_F(http_parser_test, keeps_headers_beyond_the_inline_capacity)
+{
+	input = "GET / HTTP/1.1\r\n";
+	for (int i = 0; i < 40; ++i)
+	{
+		input += "X-" + std::to_string(i) + ": " + std::to_string(i * i) + "\r\n";
+	}
+	input += "\r\n";
+	ASSERT_TRUE(request.parse(input));
+
+	ASSERT_EQ(40u, request.count_headers());
+	EXPECT_EQ("X-0", request.get_header(0).first);
+	EXPECT_EQ("1521", request.headers().get("x-39"));
+
+	nemok::wire::headers copy = request.headers();
+	EXPECT_EQ("225", copy.get("X-15"));
+	EXPECT_EQ("256", copy.get("X-16"));
+}
+
+TEST_F(http_parser_test, rejects_malformed_content_length)
+{
+	EXPECT_FALSE(request.parse("POST / HTTP/1.1\r\nContent-Length: 5x\r\n\r\nhello"));
+	EXPECT_FALSE(request.parse("POST / HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n"));
+}
+
+struct recorder : nemok::wire::request_events
+{
+	std::string uri;
+	std::string headers;
+	std::string content;
+	int messages = 0;
+	bool value = false;
+
+	void on_uri(nemok::string_view s) override { uri.append(s.data(), s.size()); }
+	void on_header_name(nemok::string_view s) override { headers.append(s.data(), s.size()); }
+	void on_header_value(nemok::string_view s) override { headers.append(value ? "" : "=").append(s.data(), s.size()); value = true; }
+	void on_header_end() override { headers.append(";"); value = false; }
+	void on_content(nemok::string_view s) override { content.append(s.data(), s.size()); }
+	void on_message_end() override { ++messages; }
+};
+
+TEST_F(http_parser_test, emits_the_same_events_however_the_request_is_split)
+{
+	const std::string input = "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Length: 10\r\n\r\n0123456789";
+	for (size_t step = 1; step <= input.size(); ++step)
+	{
+		recorder events;
+		nemok::wire::request_parser parser(events);
+		size_t consumed = 0;
+		for (size_t pos = 0; pos < input.size(); pos += step)
+		{
+			consumed += parser.feed(nemok::string_view(input).substr(pos, step));
+		}
+
+		ASSERT_TRUE(parser.done()) << "step " << step;
+		EXPECT_EQ(input.size(), consumed);
+		EXPECT_EQ("/upload", events.uri);
+		EXPECT_EQ("Host=localhost;Content-Length=10;", events.headers);
+		EXPECT_EQ("0123456789", events.content);
+		EXPECT_EQ(1, events.messages);
+	}
+}
+
+TEST_F(http_parser_test, stops_at_the_end_of_the_message)
+{
+	recorder events;
+	nemok::wire::request_parser parser(events);
+	const std::string first = "GET /a HTTP/1.1\r\n\r\n";
+
+	EXPECT_EQ(first.size(), parser.feed(first + "GET /b HTTP/1.1\r\n\r\n"));
+	EXPECT_TRUE(parser.done());
+	EXPECT_EQ("/a", events.uri);
+}
+
+TEST_F(http_parser_test, resumes_where_the_previous_read_stopped)
+{
+	std::string input = "POST /upload HTTP/1.1\r\nContent-Length: 4\r\n";
+	EXPECT_FALSE(request.feed(input));
+
+	input += "X-Tag: a\r\n\r\nda";
+	EXPECT_FALSE(request.feed(input));
+
+	input += "ta";
+	ASSERT_TRUE(request.feed(input));
+	EXPECT_EQ("/upload", request.uri());
+	EXPECT_EQ("data", request.content());
+	EXPECT_EQ("a", request.headers().get("X-Tag"));
+	EXPECT_EQ(input.size(), request.size());
+}
+
+TEST_F(http_parser_test, fails_on_malformed_requests)
+{
+	EXPECT_FALSE(request.parse("GET /\r\n\r\n"));
+	EXPECT_TRUE(request.failed());
+
+	EXPECT_FALSE(request.parse("GET / HTTP/1.1\r\nno colon\r\n\r\n"));
+	EXPECT_TRUE(request.failed());
+
+	EXPECT_FALSE(request.parse("POST / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 1\r\n\r\nx"));
+	EXPECT_TRUE(request.failed());
+}
+
+TEST_F(http_parser_test, decodes_chunked_content)
+{
+	const std::string input = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+		"5;name=value\r\nhello\r\n7\r\n, world\r\n0\r\nX-Checksum: 1\r\n\r\n";
+
+	for (size_t step = 1; step <= input.size(); ++step)
+	{
+		recorder events;
+		nemok::wire::request_parser parser(events);
+		size_t consumed = 0;
+		for (size_t pos = 0; pos < input.size(); pos += step)
+		{
+			consumed += parser.feed(nemok::string_view(input).substr(pos, step));
+		}
+
+		ASSERT_TRUE(parser.done()) << "step " << step;
+		EXPECT_EQ(input.size(), consumed);
+		EXPECT_EQ("hello, world", events.content);
+	}
+
+	ASSERT_TRUE(request.parse(input));
+	EXPECT_EQ("hello, world", request.content());
+	EXPECT_EQ(2u, request.content().count());
+	EXPECT_EQ(input.size(), request.size());
+}
+
+TEST_F(http_parser_test, rejects_chunked_content_with_length)
+{
+	EXPECT_FALSE(request.parse("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n0\r\n\r\n"));
+	EXPECT_TRUE(request.failed());
+
+	EXPECT_FALSE(request.parse("POST / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n"));
+	EXPECT_TRUE(request.failed());
+
+	EXPECT_FALSE(request.parse("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nxyz\r\n"));
+	EXPECT_TRUE(request.failed());
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <string>
+
+// what the http tests look at in a response as it's been received
+struct http_test_fixture : public ::testing::Test
+{
+	// the value of the first header with the name, empty if there's none
+	std::string header(const std::string& response, const std::string& name)
+	{
+		const size_t pos = response.find("\r\n" + name + ": ");
+		if (pos == std::string::npos)
+		{
+			return "";
+		}
+
+		const size_t start = pos + name.size() + 4;
+		return response.substr(start, response.find("\r\n", start) - start);
+	}
+
+	std::string body(const std::string& response)
+	{
+		return response.substr(response.find("\r\n\r\n") + 4);
+	}
+};
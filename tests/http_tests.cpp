@@ -1,8 +1,11 @@
 #include <gtest/gtest.h>
 #include <chrono>
+#include <fstream>
+#include <sys/stat.h>
 #include "nemok/nemok.h"
+#include "http_test_fixture.h"
 
-struct http_mock_test : public ::testing::Test
+struct http_mock_test : public http_test_fixture
 {
 	using req = nemok::http::request;
 	using resp = nemok::http::response;
@@ -17,7 +20,7 @@ TEST_F(http_mock_test, replies_to_a_request_according_to_specified_expectation)
 	auto client = mock.connect();
 	http::send(client, "GET / HTTP/1.1\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, matches_any_get_request)
@@ -28,7 +31,7 @@ TEST_F(http_mock_test, matches_any_get_request)
 	auto client = mock.connect();
 	http::send(client, "GET /hello/world HTTP/1.1\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, matches_any_unexpected_request)
@@ -39,7 +42,7 @@ TEST_F(http_mock_test, matches_any_unexpected_request)
 	auto client = mock.connect();
 	http::send(client, "HEAD / HTTP/1.1\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 500 Internal Server Error\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, handles_multiple_requests)
@@ -52,8 +55,8 @@ TEST_F(http_mock_test, handles_multiple_requests)
 	http::send(client, "GET /foo HTTP/1.1\r\n\r\n");
 	http::send(client, "GET /bar HTTP/1.1\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
-	EXPECT_EQ("HTTP/1.1 404 Not Found\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, matches_a_request_with_known_content)
@@ -65,7 +68,7 @@ TEST_F(http_mock_test, matches_a_request_with_known_content)
 	auto client = mock.connect();
 	http::send(client, "GET / HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, fails_to_match_content)
@@ -77,7 +80,7 @@ TEST_F(http_mock_test, fails_to_match_content)
 	auto client = mock.connect();
 	http::send(client, "GET / HTTP/1.1\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 404 Not Found\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, matches_multiple_requests_having_payload)
@@ -89,8 +92,8 @@ TEST_F(http_mock_test, matches_multiple_requests_having_payload)
 	http::send(client, "POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world");
 	http::send(client, "POST / HTTP/1.1\r\nContent-Length: 11\r\n\r\nhello world");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, matches_request_with_known_header)
@@ -101,7 +104,18 @@ TEST_F(http_mock_test, matches_request_with_known_header)
 	auto client = mock.connect();
 	http::send(client, "GET / HTTP/1.1\r\nUser-Agent: curl\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, matches_header_names_ignoring_the_case)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET().header("User-Agent", "curl")).reply(200);
+
+	auto client = mock.connect();
+	http::send(client, "GET / HTTP/1.1\r\nuser-agent: curl\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, fails_to_match_the_expected_http_header)
@@ -117,7 +131,7 @@ TEST_F(http_mock_test, fails_to_match_the_expected_http_header)
 	// send 'wget' - the expectation should fail
 	http::send(client, "GET / HTTP/1.1\r\nUser-Agent: wget\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 404 Not Found\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, matches_multiple_headers)
@@ -134,7 +148,7 @@ TEST_F(http_mock_test, matches_multiple_headers)
 	auto client = mock.connect();
 	http::send(client, "GET / HTTP/1.1\r\nUser-Agent: curl\r\nAccept-Encoding: gzip\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
 }
 
 TEST_F(http_mock_test, when_matching_http_headers_skips_over_unexpected_ones)
@@ -145,6 +159,472 @@ TEST_F(http_mock_test, when_matching_http_headers_skips_over_unexpected_ones)
 	auto client = mock.connect();
 	http::send(client, "GET / HTTP/1.1\r\nUser-Agent: curl\r\nAccept-Encoding: gzip\r\n\r\n");
 
-	EXPECT_EQ("HTTP/1.1 200 OK\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, routes_requests_among_thousands_of_expectations)
+{
+	auto mock = nemok::start<http>();
+	for (int i = 0; i < 5000; ++i)
+	{
+		mock.when(http::GET("/users/" + std::to_string(i))).reply(200);
+	}
+	mock.when(http::GET("/admin").header("User-Agent", "curl")).reply(201);
+	mock.when_unexpected().reply(404);
+
+	auto client = mock.connect();
+	http::send(client, "GET /users/4999 HTTP/1.1\r\n\r\n");
+	http::send(client, "GET /admin HTTP/1.1\r\nUser-Agent: curl\r\n\r\n");
+	http::send(client, "GET /admin HTTP/1.1\r\nUser-Agent: wget\r\n\r\n");
+	http::send(client, "GET /users/5000 HTTP/1.1\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, routes_requests_by_uri_pattern)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/users/{id}/orders/*")).reply([](const http::params& p)
+	{
+		return resp(p[0].second == "42" ? 200 : 404);
+	});
+	mock.when_unexpected().reply(500);
+
+	auto client = mock.connect();
+	http::send(client, "GET /users/42/orders/1 HTTP/1.1\r\n\r\n");
+	http::send(client, "GET /users/7/orders/2/items HTTP/1.1\r\n\r\n");
+	http::send(client, "GET /users/42 HTTP/1.1\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+
+TEST_F(http_mock_test, fails_to_match_a_header_missing_from_the_request)
+{
+	auto mock = nemok::start<http>();
+	for (int i = 0; i < 100; ++i)
+	{
+		mock.when(http::GET().header("X-Request-Id", std::to_string(i))).reply(200);
+	}
+	mock.when_unexpected().reply(404);
+
+	auto client = mock.connect();
+	http::send(client, "GET / HTTP/1.1\r\n\r\n");
+	http::send(client, "GET / HTTP/1.1\r\nX-Request-Id: 99\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, matches_a_request_trickling_in)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::POST("/upload").content("0123456789")).reply(201);
+	mock.when_unexpected().reply(500);
+
+	auto client = mock.connect();
+	http::send(client, "POST /upl");
+	http::send(client, "oad HTTP/1.1\r\nContent-Len");
+	http::send(client, "gth: 10\r\n\r\n0123");
+	http::send(client, "456789GET / HTTP/1.1\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, matches_every_known_method)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::PUT("/file")).reply(201);
+	mock.when(http::DELETE("/file")).reply(204);
+	mock.when(http::PATCH("/file")).reply(200);
+	mock.when(http::OPTIONS("/file")).reply(200);
+
+	auto client = mock.connect();
+	http::send(client, "PUT /file HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+
+	http::send(client, "DELETE /file HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 204 No Content\r\n\r\n", http::receive(client));
+
+	http::send(client, "PATCH /file HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+
+	http::send(client, "OPTIONS /file HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, replies_to_pipelined_requests_in_order)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/a")).reply(200);
+	mock.when(http::GET("/b")).reply(201);
+	mock.when(http::GET("/c")).reply(202);
+
+	auto client = mock.connect();
+	http::send(client, "GET /c HTTP/1.1\r\n\r\nGET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 202 Accepted\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, closes_the_connection_when_asked_to)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET()).reply(200);
+
+	auto client = mock.connect();
+	http::send(client, "GET /a HTTP/1.1\r\nConnection: close\r\n\r\nGET /b HTTP/1.1\r\n\r\n");
+
+	char ch;
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ(0, client.read_some(&ch, 1));
+}
+
+TEST_F(http_mock_test, closes_http_10_connection_unless_kept_alive)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET()).reply(200);
+
+	char ch;
+	auto client = mock.connect();
+	http::send(client, "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+
+	http::send(client, "GET / HTTP/1.0\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+	EXPECT_EQ(0, client.read_some(&ch, 1));
+}
+
+TEST_F(http_mock_test, matches_chunked_content)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::POST("/upload").content("hello, world")).reply(201);
+	mock.when_unexpected().reply(500);
+
+	auto client = mock.connect();
+	http::send(client, "POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhel");
+	http::send(client, "lo\r\n7\r\n, world\r\n0\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, streams_chunked_response)
+{
+	auto mock = nemok::start<http>();
+	int left = 3;
+	mock.when(http::GET("/stream")).reply(resp(200), [left]() mutable
+	{
+		return left-- > 0 ? std::string(10 + left, 'x') : std::string();
+	});
+
+	auto client = mock.connect();
+	http::send(client, "GET /stream HTTP/1.1\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+		"c\r\nxxxxxxxxxxxx\r\nb\r\nxxxxxxxxxxx\r\na\r\nxxxxxxxxxx\r\n0\r\n\r\n",
+		http::receive(client));
+}
+
+TEST_F(http_mock_test, replies_with_headers_and_content)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/hello")).reply(resp(200).header("Content-Type", "text/plain").content("hello"));
+
+	auto client = mock.connect();
+	http::send(client, "GET /hello HTTP/1.1\r\n\r\n");
+
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 5\r\n\r\nhello", http::receive(client));
+}
+
+TEST_F(http_mock_test, patches_the_date_in)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET()).reply(resp(404).date());
+
+	auto client = mock.connect();
+	http::send(client, "GET / HTTP/1.1\r\n\r\n");
+
+	const std::string response = http::receive(client);
+	const std::string date = nemok::http_date_now();
+	ASSERT_EQ(nemok::http_date_size, date.size());
+	EXPECT_EQ(',', date[3]);
+	EXPECT_EQ("GMT", date.substr(date.size() - 3));
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nDate: ", response.substr(0, 30));
+	EXPECT_EQ("\r\nContent-Length: 0\r\n\r\n", response.substr(30 + nemok::http_date_size));
+}
+
+TEST_F(http_mock_test, knows_reason_phrases_at_compile_time)
+{
+	static_assert(nemok::http_reason(404)[0] == 'N', "404 Not Found");
+	EXPECT_STREQ("I'm a teapot", nemok::http_reason(418));
+	EXPECT_STREQ("", nemok::http_reason(999));
+}
+
+TEST_F(http_mock_test, replies_with_generated_content)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/blob")).reply(resp(200), nemok::body::random(42), 100000);
+
+	auto client = mock.connect();
+	http::send(client, "GET /blob HTTP/1.1\r\n\r\n");
+
+	const std::string response = http::receive(client);
+	const std::string head = "HTTP/1.1 200 OK\r\nContent-Length: 100000\r\n\r\n";
+	ASSERT_EQ(head.size() + 100000, response.size());
+	EXPECT_EQ(head, response.substr(0, head.size()));
+
+	std::string expected(100000, '\0');
+	nemok::body::random(42)(&expected[0], expected.size(), 0);
+	EXPECT_EQ(expected, response.substr(head.size()));
+}
+
+TEST_F(http_mock_test, sends_single_content_length_with_generated_content)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/blob")).reply(resp(200).header("Content-Length", "7"), nemok::body::repeat("ab"), 10);
+
+	auto client = mock.connect();
+	http::send(client, "GET /blob HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nababababab", http::receive(client));
+}
+
+TEST_F(http_mock_test, sends_no_generated_content_without_body)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/blob")).reply(resp(204), nemok::body::repeat("ab"), 10);
+
+	auto client = mock.connect();
+	http::send(client, "GET /blob HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 204 No Content\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, serializes_request)
+{
+	EXPECT_EQ("GET / HTTP/1.1\r\n\r\n", req().str());
+	EXPECT_EQ("POST /items HTTP/1.1\r\nHost: localhost\r\nContent-Length: 2\r\n\r\n{}",
+		http::POST("/items").header("Host", "localhost").content("{}").str());
+	EXPECT_EQ("PUT /items/1 HTTP/1.0\r\nContent-Length: 0\r\n\r\n", req(nemok::HTTP_10).method(nemok::HTTP_PUT).uri("/items/1").str());
+	EXPECT_EQ("POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n", http::POST("/").header("Transfer-Encoding", "chunked").str());
+}
+
+TEST_F(http_mock_test, serializes_request_into_buffer)
+{
+	const req r = http::POST("/items").content("hello");
+	const std::string expected = "POST /items HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+	EXPECT_EQ(expected.size(), r.serialized_size());
+
+	char small[8] = {};
+	EXPECT_EQ(expected.size(), r.serialize(small, sizeof(small)));
+	EXPECT_EQ(std::string(sizeof(small), '\0'), std::string(small, sizeof(small)));
+
+	char buffer[64];
+	ASSERT_EQ(expected.size(), r.serialize(buffer, sizeof(buffer)));
+	EXPECT_EQ(expected, std::string(buffer, expected.size()));
+
+	// the string keeps its memory from one request to the next
+	std::string out;
+	r.serialize(out);
+	const char* data = out.data();
+	http::GET("/").serialize(out);
+	EXPECT_EQ("GET / HTTP/1.1\r\n\r\n", out);
+	r.serialize(out);
+	EXPECT_EQ(expected, out);
+	EXPECT_EQ(data, out.data());
+}
+
+TEST_F(http_mock_test, sends_serialized_request)
+{
+	auto mock = nemok::start<http>();
+	mock.when(http::POST("/items").content("{}")).reply(resp(201));
+
+	auto client = mock.connect();
+	http::send(client, http::POST("/items").content("{}"));
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+// the fixtures go to a directory of their own, removed once the test is over
+struct http_file_test : public http_mock_test
+{
+	http_file_test()
+	{
+		char dir[] = "/tmp/nemok_files_XXXXXX";
+		root = ::mkdtemp(dir);
+		::mkdir((root + "/sub").c_str(), 0700);
+	}
+
+	~http_file_test()
+	{
+		for (auto& f : files)
+		{
+			::unlink(f.c_str());
+		}
+
+		::rmdir((root + "/sub").c_str());
+		::rmdir(root.c_str());
+	}
+
+	std::string make_file(std::string name, std::string content)
+	{
+		const std::string path = root + "/" + name;
+		std::ofstream(path, std::ios::binary) << content;
+		files.push_back(path);
+		return path;
+	}
+
+	std::string root;
+	std::vector<std::string> files;
+};
+
+TEST_F(http_file_test, replies_with_file)
+{
+	std::string content(300000, '\0');
+	nemok::body::random(7)(&content[0], content.size(), 0);
+	const std::string path = make_file("blob.bin", content);
+
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/blob")).reply_file(path);
+
+	auto client = mock.connect();
+	http::send(client, "GET /blob HTTP/1.1\r\n\r\n");
+
+	const std::string response = http::receive(client);
+	EXPECT_EQ("HTTP/1.1 200 OK\r\n", response.substr(0, 17));
+	EXPECT_EQ("application/octet-stream", header(response, "Content-Type"));
+	EXPECT_EQ("bytes", header(response, "Accept-Ranges"));
+	EXPECT_EQ("300000", header(response, "Content-Length"));
+	EXPECT_EQ(content, body(response));
+}
+
+TEST_F(http_file_test, replies_with_ranges)
+{
+	const std::string path = make_file("digits.txt", "0123456789");
+
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/digits")).reply_file(path);
+
+	auto client = mock.connect();
+	http::send(client, "GET /digits HTTP/1.1\r\nRange: bytes=2-5\r\n\r\n");
+	std::string response = http::receive(client);
+	EXPECT_EQ("HTTP/1.1 206 Partial Content\r\n", response.substr(0, 30));
+	EXPECT_EQ("bytes 2-5/10", header(response, "Content-Range"));
+	EXPECT_EQ("2345", body(response));
+
+	http::send(client, "GET /digits HTTP/1.1\r\nRange: bytes=-3\r\n\r\n");
+	EXPECT_EQ("789", body(http::receive(client)));
+
+	http::send(client, "GET /digits HTTP/1.1\r\nRange: bytes=7-\r\n\r\n");
+	EXPECT_EQ("789", body(http::receive(client)));
+
+	http::send(client, "GET /digits HTTP/1.1\r\nRange: bytes=10-\r\n\r\n");
+	response = http::receive(client);
+	EXPECT_EQ("HTTP/1.1 416 Range Not Satisfiable\r\n", response.substr(0, 36));
+	EXPECT_EQ("bytes */10", header(response, "Content-Range"));
+
+	// more than a single range gets the whole of the file
+	http::send(client, "GET /digits HTTP/1.1\r\nRange: bytes=0-1,4-5\r\n\r\n");
+	EXPECT_EQ("0123456789", body(http::receive(client)));
+}
+
+TEST_F(http_file_test, replies_not_modified_to_known_etag)
+{
+	const std::string path = make_file("page.html", "<html></html>");
+
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/page")).reply_file(path);
+
+	auto client = mock.connect();
+	http::send(client, "GET /page HTTP/1.1\r\n\r\n");
+	const std::string response = http::receive(client);
+	const std::string etag = header(response, "ETag");
+	EXPECT_EQ("text/html", header(response, "Content-Type"));
+	ASSERT_FALSE(etag.empty());
+
+	http::send(client, "GET /page HTTP/1.1\r\nIf-None-Match: \"other\", W/" + etag + "\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 304 Not Modified\r\nETag: " + etag + "\r\n\r\n", http::receive(client));
+
+	http::send(client, "GET /page HTTP/1.1\r\nIf-None-Match: \"other\"\r\n\r\n");
+	EXPECT_EQ("<html></html>", body(http::receive(client)));
 }
 
+TEST_F(http_file_test, serves_directory)
+{
+	make_file("sub/a.json", "{}");
+
+	auto mock = nemok::start<http>();
+	mock.when(http::GET("/static/*")).serve_directory(root);
+
+	auto client = mock.connect();
+	http::send(client, "GET /static/sub/a.json?v=1 HTTP/1.1\r\n\r\n");
+	const std::string response = http::receive(client);
+	EXPECT_EQ("application/json", header(response, "Content-Type"));
+	EXPECT_EQ("{}", body(response));
+
+	http::send(client, "GET /static/sub/missing HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+
+	http::send(client, "GET /static/sub/../../etc/passwd HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+
+	http::send(client, "GET /static/sub HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n", http::receive(client));
+}
+
+TEST_F(http_mock_test, revalidates_cached_response)
+{
+	nemok::cache_policy policy;
+	policy.last_modified = 784111777;
+	policy.max_age = 60;
+
+	auto mock = nemok::start<http>();
+	auto& origin = mock.when(http::GET("/page")).reply_cacheable(resp(200).content("hello"), policy);
+
+	auto client = mock.connect();
+	http::send(client, "GET /page HTTP/1.1\r\n\r\n");
+	std::string response = http::receive(client);
+	const std::string etag = header(response, "ETag");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\n", response.substr(0, 17));
+	EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", header(response, "Last-Modified"));
+	EXPECT_EQ("max-age=60", header(response, "Cache-Control"));
+	EXPECT_FALSE(header(response, "Date").empty());
+	EXPECT_EQ(18u, etag.size());
+	EXPECT_EQ("hello", body(response));
+
+	http::send(client, "GET /page HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n");
+	response = http::receive(client);
+	EXPECT_EQ("HTTP/1.1 304 Not Modified\r\n", response.substr(0, 27));
+	EXPECT_EQ(etag, header(response, "ETag"));
+	EXPECT_EQ("max-age=60", header(response, "Cache-Control"));
+	EXPECT_EQ("", body(response));
+
+	http::send(client, "GET /page HTTP/1.1\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 304 Not Modified\r\n", http::receive(client).substr(0, 27));
+
+	// If-None-Match wins over a date that would do
+	http::send(client, "GET /page HTTP/1.1\r\nIf-None-Match: \"stale\"\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n\r\n");
+	EXPECT_EQ("hello", body(http::receive(client)));
+
+	http::send(client, "GET /page HTTP/1.1\r\nIf-Modified-Since: Sun, 06 Nov 1994 08:49:36 GMT\r\n\r\n");
+	EXPECT_EQ("hello", body(http::receive(client)));
+
+	EXPECT_EQ(3u, origin.full_responses());
+	EXPECT_EQ(2u, origin.revalidated_responses());
+}
+
+TEST_F(http_mock_test, formats_and_parses_http_dates)
+{
+	EXPECT_EQ("Sun, 06 Nov 1994 08:49:37 GMT", nemok::http_date(784111777));
+
+	time_t t = 0;
+	ASSERT_TRUE(nemok::parse_http_date(" Sun, 06 Nov 1994 08:49:37 GMT", t));
+	EXPECT_EQ(784111777, t);
+	EXPECT_FALSE(nemok::parse_http_date("Sunday, 06-Nov-94 08:49:37 GMT", t));
+	EXPECT_FALSE(nemok::parse_http_date("Sun, 06 Nox 1994 08:49:37 GMT", t));
+	EXPECT_FALSE(nemok::parse_http_date("", t));
+}
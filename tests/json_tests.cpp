@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+
+using namespace nemok;
+
+struct json_test : public ::testing::Test
+{
+	std::string select(string_view doc, string_view path)
+	{
+		string_view value;
+		return json::select(doc, path, value) ? value.to_string() : "<none>";
+	}
+};
+
+TEST_F(json_test, selects_members_and_elements)
+{
+	const std::string doc = R"( {"user": {"id": 42, "name": "alice", "tags": ["a", {"k": [1, 2]}, null]},
+		"a.b": true, "empty": {}, "list": []} )";
+
+	EXPECT_EQ(doc.substr(1, doc.size() - 2), select(doc, "$"));
+	EXPECT_EQ("42", select(doc, "$.user.id"));
+	EXPECT_EQ("\"alice\"", select(doc, "$.user.name"));
+	EXPECT_EQ("\"a\"", select(doc, "$.user.tags[0]"));
+	EXPECT_EQ("[1, 2]", select(doc, "$.user.tags[1].k"));
+	EXPECT_EQ("2", select(doc, "$['user']['tags'][1][\"k\"][1]"));
+	EXPECT_EQ("null", select(doc, "$.user.tags[2]"));
+	EXPECT_EQ("true", select(doc, "$['a.b']"));
+	EXPECT_EQ("{}", select(doc, "$.empty"));
+
+	EXPECT_EQ("<none>", select(doc, "$.user.tags[3]"));
+	EXPECT_EQ("<none>", select(doc, "$.user.missing"));
+	EXPECT_EQ("<none>", select(doc, "$.empty.x"));
+	EXPECT_EQ("<none>", select(doc, "$.list[0]"));
+	EXPECT_EQ("<none>", select(doc, "$.user.id.x"));
+	EXPECT_EQ("<none>", select(doc, "$.user[0]"));
+	EXPECT_EQ("<none>", select(doc, "$.user.tags[x]"));
+}
+
+TEST_F(json_test, skips_strings_with_brackets_and_escapes)
+{
+	const std::string doc = R"({"a": "}{][\"\\", "b": {"c": "]\"}", "d": [["}"]]}, "e": 1})";
+	EXPECT_EQ(R"("}{][\"\\")", select(doc, "$.a"));
+	EXPECT_EQ(R"([["}"]])", select(doc, "$.b.d"));
+	EXPECT_EQ("1", select(doc, "$.e"));
+}
+
+TEST_F(json_test, matches_escaped_names_and_values)
+{
+	const std::string doc = R"({"name": "café \"x\"\n", "emoji": "😀"})";
+	string_view value;
+	ASSERT_TRUE(json::select(doc, "$.name", value));
+	EXPECT_TRUE(json::equals(value, "caf\xc3\xa9 \"x\"\n"));
+	ASSERT_TRUE(json::select(doc, "$.emoji", value));
+	EXPECT_TRUE(json::equals(value, "\xf0\x9f\x98\x80"));
+
+	EXPECT_TRUE(json::equals("42", "42"));
+	EXPECT_TRUE(json::equals("\"42\"", "42"));
+	EXPECT_FALSE(json::equals("42", "42.0"));
+	EXPECT_FALSE(json::equals("\"42\"", "\"42\""));
+}
+
+TEST_F(json_test, gives_up_on_broken_document)
+{
+	EXPECT_EQ("<none>", select(R"({"a": "never closed)", "$.b"));
+	EXPECT_EQ("<none>", select(R"({"a": {"x": 1}, "b")", "$.b"));
+	EXPECT_EQ("<none>", select(R"({"a": [1, 2)", "$.a"));
+	EXPECT_EQ("<none>", select("", "$"));
+
+	// nothing after the selected value is looked at
+	EXPECT_EQ("1", select(R"({"a": 1, "b": )", "$.a"));
+}
+
+TEST_F(json_test, matches_request_body)
+{
+	auto mock = start<http>();
+	mock.when(http::POST("/orders").with_json("$.user.id", "42").with_json("$.items[1].sku", "B-2")).reply(http::response(201));
+	mock.when(http::POST("/orders")).reply(http::response(400)).order(200);
+
+	// the fields looked for come after a megabyte of the ones that aren't
+	std::string body = R"({"padding": [)";
+	for (int i = 0; i < 20000; ++i)
+	{
+		body += R"({"text": "lorem ipsum {[\"dolor\"]} sit amet", "n": )" + std::to_string(i) + "},";
+	}
+
+	body += R"(null], "user": {"id": 42}, "items": [{"sku": "A-1"}, {"sku": "B-2"}]})";
+	ASSERT_GT(body.size(), 1000000u);
+
+	// the fallback is only tried once the expectation has turned the request down
+	auto c = mock.connect();
+	http::send(c, http::POST("/orders").content(R"({"user": {"id": 43}, "items": [{"sku": "A-1"}, {"sku": "B-2"}]})"));
+	EXPECT_EQ("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+	http::send(c, http::POST("/orders").content(R"({"user": {"id": 42}, "items": [{"sku": "B-2"}, {"sku": "A-1"}]})"));
+	EXPECT_EQ("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+	http::send(c, http::POST("/orders").content(body));
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include "nemok/scan.h"
+
+using namespace nemok;
+
+struct scan_test : public ::testing::Test
+{
+	const size_t npos = string_view::npos;
+
+	// long enough to go through the wide registers and then the tail
+	std::string make_input(size_t size, size_t pos, char ch)
+	{
+		std::string input(size, 'a');
+		if (pos < size)
+		{
+			input[pos] = ch;
+		}
+
+		return input;
+	}
+};
+
+TEST_F(scan_test, finds_delimiters_at_every_position)
+{
+	for (size_t size = 0; size < 100; ++size)
+	{
+		for (size_t pos = 0; pos <= size; ++pos)
+		{
+			for (char ch : std::string("\r\n: "))
+			{
+				const std::string input = make_input(size, pos, ch);
+				EXPECT_EQ(input.find_first_of("\r\n: "), scan::find_first_of(input, "\r\n: "))
+					<< "size " << size << ", pos " << pos << ", implementation " << scan::implementation();
+			}
+		}
+	}
+}
+
+TEST_F(scan_test, finds_the_first_of_several_delimiters)
+{
+	EXPECT_EQ(4u, scan::find_first_of("Host: localhost", " :"));
+	EXPECT_EQ(5u, scan::find_first_of("Host: localhost", " "));
+	EXPECT_EQ(npos, scan::find_first_of("Host: localhost", "\r"));
+}
+
+TEST_F(scan_test, finds_the_end_of_line)
+{
+	EXPECT_EQ(3u, scan::find_line_end("abc\r\ndef"));
+	EXPECT_EQ(4u, scan::find_line_end("a\rb\n\r\n"));
+	EXPECT_EQ(npos, scan::find_line_end("abc\r"));
+}
+
+TEST_F(scan_test, finds_the_end_of_head_past_the_lone_line_breaks)
+{
+	std::string input = std::string(40, 'x') + "\r\n" + std::string(40, 'y') + "\r\n\r" + "\r\n\r\n";
+	EXPECT_EQ(input.size() - 4, scan::find_head_end(input));
+	EXPECT_EQ(npos, scan::find_head_end("GET / HTTP/1.1\r\n\r"));
+}
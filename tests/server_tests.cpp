@@ -78,3 +78,80 @@ TEST_F(server_test, talks_to_server_after_restart)
 
 	EXPECT_EQ("hola mundo!", nemok::read_all(client, 11));
 }
+
+TEST_F(server_test, sends_file_through_non_blocking_socket)
+{
+	const std::string content(1 << 20, 'f');
+	FILE* file = tmpfile();
+	fwrite(content.data(), 1, content.size(), file);
+	fflush(file);
+
+	auto mock = nemok::start<one_shot_echo<1 << 20>>();
+	auto client = mock.connect();
+	fcntl(client.fd(), F_SETFL, fcntl(client.fd(), F_GETFL) | O_NONBLOCK);
+
+	client.send_file(fileno(file), 0, content.size());
+	EXPECT_EQ(content, nemok::read_all(client, content.size()));
+	fclose(file);
+}
+
+TEST_F(server_test, refuses_to_send_past_the_end_of_file)
+{
+	FILE* file = tmpfile();
+	fputs("hello", file);
+	fflush(file);
+
+	start();
+	EXPECT_THROW(client.send_file(fileno(file), 0, 11), nemok::file_too_short);
+	fclose(file);
+}
+
+TEST(route_table_test, prefers_exact_routes_to_patterns)
+{
+	nemok::route_table<int> table;
+	table["/users/{id}"] = 1;
+	table["/users/me"] = 2;
+
+	nemok::route_params params;
+	int found = 0;
+	table.visit("/users/me", params, [&](int v, auto&){found = v; return true;});
+
+	EXPECT_EQ(2, found);
+	EXPECT_TRUE(params.empty());
+}
+
+TEST(route_table_test, captures_route_parameters)
+{
+	nemok::route_table<int> table;
+	table["/users/{id}/orders/*"] = 1;
+
+	nemok::route_params captured;
+	nemok::route_params params;
+	table.visit("/users/42/orders/7/items", params, [&](int, auto& p){captured = p; return true;});
+
+	ASSERT_EQ(2u, captured.size());
+	EXPECT_EQ(std::make_pair(std::string("id"), std::string("42")), captured[0]);
+	EXPECT_EQ(std::make_pair(std::string("*"), std::string("7/items")), captured[1]);
+}
+
+TEST(route_table_test, falls_back_to_less_specific_route)
+{
+	nemok::route_table<int> table;
+	table["/users/me/*"] = 1;
+	table["/users/{id}/orders"] = 2;
+
+	nemok::route_params params;
+	std::vector<int> visited;
+	EXPECT_FALSE(table.visit("/users/me/orders", params, [&](int v, auto&){visited.push_back(v); return false;}));
+
+	EXPECT_EQ(std::vector<int>({1, 2}), visited);
+	EXPECT_FALSE(table.visit("/users/me", params, [&](int, auto&){return true;}));
+}
+
+TEST(route_table_test, matches_a_single_pattern)
+{
+	EXPECT_TRUE(nemok::match_route("/users/{id}", "/users/42"));
+	EXPECT_TRUE(nemok::match_route("/files/*", "/files/a/b/c"));
+	EXPECT_FALSE(nemok::match_route("/users/{id}", "/users/42/orders"));
+	EXPECT_FALSE(nemok::match_route("/users/{id}/orders", "/users/42"));
+}
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+
+using namespace nemok;
+
+struct sse_test : public ::testing::Test
+{
+	const std::string head = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+		"Cache-Control: no-cache\r\nTransfer-Encoding: chunked\r\n\r\n";
+
+	// the response never ends, only its head is read
+	std::string subscribe(client& c)
+	{
+		http::send(c, "GET /events HTTP/1.1\r\nAccept: text/event-stream\r\n\r\n");
+		return read_all(c, head.size());
+	}
+
+	// the way an event goes out, in a chunk of its own
+	std::string chunk(const std::string& event)
+	{
+		char size[24];
+		snprintf(size, sizeof(size), "%zx\r\n", event.size());
+		return size + event + "\r\n";
+	}
+
+	// the subscribers go away on their own time, the hub notices shortly
+	bool wait_for_subscribers(http& h, size_t count)
+	{
+		for (int i = 0; i < 5000 && h.event_subscribers() != count; ++i)
+		{
+			::usleep(1000);
+		}
+
+		return h.event_subscribers() == count;
+	}
+};
+
+TEST_F(sse_test, formats_events)
+{
+	EXPECT_EQ("data: hello\n\n", sse::event("hello"));
+	EXPECT_EQ("event: update\nid: 7\ndata: {}\n\n", sse::event("{}", "update", "7"));
+	EXPECT_EQ("data: one\ndata: two\ndata: three\ndata: \n\n", sse::event("one\ntwo\r\nthree\r"));
+	EXPECT_EQ("data: \n\n", sse::event(""));
+}
+
+TEST_F(sse_test, fans_out_to_every_subscriber)
+{
+	auto mock = start<http>();
+	auto& feed = mock.when(http::GET("/events")).subscribe_events();
+
+	std::vector<client> clients;
+	for (int i = 0; i < 500; ++i)
+	{
+		clients.push_back(mock.connect());
+		EXPECT_EQ(head, subscribe(clients.back()));
+	}
+
+	EXPECT_EQ(500u, feed.event_subscribers());
+
+	const std::string first = chunk(sse::event("first", "note", "1"));
+	const std::string second = chunk(sse::event(std::string(100000, 'x')));
+	feed.broadcast_event("first", "note", "1");
+	feed.broadcast_event(std::string(100000, 'x'));
+	for (auto& c : clients)
+	{
+		EXPECT_EQ(first, read_all(c, first.size()));
+		EXPECT_EQ(second, read_all(c, second.size()));
+	}
+
+	for (size_t i = 0; i < clients.size(); i += 2)
+	{
+		clients[i].disconnect();
+	}
+
+	EXPECT_TRUE(wait_for_subscribers(feed, 250));
+
+	feed.broadcast_event("third");
+	for (size_t i = 1; i < clients.size(); i += 2)
+	{
+		EXPECT_EQ("d\r\ndata: third\n\n\r\n", read_all(clients[i], 18));
+	}
+}
+
+TEST_F(sse_test, publishes_event_on_request)
+{
+	auto mock = start<http>();
+	auto& feed = mock.when(http::GET("/events")).subscribe_events();
+	mock.when(http::POST("/notify")).publish_event("reload", "refresh").reply(204);
+
+	auto subscriber = mock.connect();
+	subscribe(subscriber);
+
+	auto publisher = mock.connect();
+	http::send(publisher, "POST /notify HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 204 No Content\r\n\r\n", http::receive(publisher));
+	http::send(publisher, "POST /notify HTTP/1.1\r\n\r\n");
+	http::receive(publisher);
+
+	const std::string event = chunk("event: refresh\ndata: reload\n\n");
+	EXPECT_EQ(event + event, read_all(subscriber, event.size() * 2));
+	EXPECT_EQ(1u, feed.event_subscribers());
+}
+
+TEST_F(sse_test, keeps_up_with_slow_subscriber)
+{
+	auto mock = start<http>();
+	auto& feed = mock.when(http::GET("/events")).subscribe_events();
+
+	auto slow = mock.connect();
+	auto fast = mock.connect();
+	subscribe(slow);
+	subscribe(fast);
+
+	// far more than the socket buffers hold, what's left waits in the hub
+	const std::string event = chunk(sse::event(std::string(65536, 'e')));
+	for (int i = 0; i < 64; ++i)
+	{
+		feed.broadcast_event(std::string(65536, 'e'));
+		EXPECT_EQ(event, read_all(fast, event.size()));
+	}
+
+	for (int i = 0; i < 64; ++i)
+	{
+		EXPECT_EQ(event, read_all(slow, event.size()));
+	}
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+
+using namespace nemok::lit;
+using namespace nemok::fixed;
+
+using ping = decltype("PING"_s);
+using pong = decltype("PONG"_s);
+
+struct static_mock_test : public ::testing::Test
+{
+};
+
+TEST_F(static_mock_test, replies_according_to_a_compile_time_rule)
+{
+	auto mock = nemok::start<nemok::static_mock<starts_with<ping>, reply<pong>>>();
+
+	auto client = mock.connect();
+	client.write("PINGPING", 8);
+
+	EXPECT_EQ("PONGPONG", nemok::read_all(client, 8));
+}
+
+TEST_F(static_mock_test, tries_rules_in_the_given_order)
+{
+	using mock_type = nemok::static_mock<
+		rule<starts_with<decltype("A"_s)>, reply<decltype("+"_s)>>,
+		rule<any_line, reply<decltype("line\n"_s)>>>;
+
+	auto mock = nemok::start<mock_type>();
+
+	auto client = mock.connect();
+	client.write("AAhello\n", 8);
+
+	EXPECT_EQ("++line\n", nemok::read_all(client, 7));
+}
+
+TEST_F(static_mock_test, falls_back_to_runtime_expectations)
+{
+	auto mock = nemok::start<nemok::static_mock<starts_with<ping>, reply<pong>>>();
+	mock.when("HELLO").reply("HOLA");
+
+	auto client = mock.connect();
+	client.write("HELLOPING", 9);
+
+	EXPECT_EQ("HOLAPONG", nemok::read_all(client, 8));
+}
+
+TEST_F(static_mock_test, uses_compile_time_triggers_and_actions_at_runtime)
+{
+	auto mock = nemok::start<nemok::telnet>();
+	mock.when(starts_with<ping>()).exec(reply<pong>());
+
+	auto client = mock.connect();
+	client.write("PING", 4);
+
+	EXPECT_EQ("PONG", nemok::read_all(client, 4));
+}
+
+TEST_F(static_mock_test, closes_connection)
+{
+	auto mock = nemok::start<nemok::static_mock<starts_with<decltype("QUIT"_s)>, close_connection>>();
+
+	auto client = mock.connect();
+	client.write("QUIT", 4);
+
+	EXPECT_THROW(nemok::read_all(client, 1), nemok::network_error);
+}
@@ -0,0 +1,72 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+
+using namespace nemok::lit;
+
+struct static_regex_test : public ::testing::Test
+{
+	template <typename Regex>
+	std::string search(Regex, const std::string& input)
+	{
+		size_t begin = 0;
+		size_t end = 0;
+		if (Regex::search(reinterpret_cast<const uint8_t*>(input.c_str()), input.size(), begin, end))
+		{
+			return input.substr(begin, end - begin);
+		}
+
+		return "<none>";
+	}
+};
+
+TEST_F(static_regex_test, finds_the_leftmost_longest_match)
+{
+	EXPECT_EQ("hello", search("[a-z]+"_re, "42 hello world"));
+	EXPECT_EQ("abcd", search("a|ab|abc|abcd"_re, "xabcd"));
+	EXPECT_EQ("<none>", search("[a-z]+"_re, "42"));
+}
+
+TEST_F(static_regex_test, matches_alternatives_and_groups)
+{
+	EXPECT_EQ("HEAD /index", search("(GET|HEAD) /[^ ]*"_re, "HEAD /index HTTP/1.1"));
+	EXPECT_EQ("abab", search("(ab)+"_re, "xxababa"));
+	EXPECT_EQ("ac", search("ab?c"_re, "ac"));
+}
+
+TEST_F(static_regex_test, matches_bounded_repetitions)
+{
+	EXPECT_EQ("aaa", search("a{2,3}"_re, "aaaa"));
+	EXPECT_EQ("aa", search("a{2}"_re, "aaaa"));
+	EXPECT_EQ("aaaa", search("a{2,}"_re, "aaaa"));
+	EXPECT_EQ("<none>", search("a{2}"_re, "ab"));
+}
+
+TEST_F(static_regex_test, matches_character_classes)
+{
+	EXPECT_EQ("x1F", search("x[[:xdigit:]]+"_re, "0x1FZ"));
+	EXPECT_EQ("a-b", search("a[-.]b"_re, "a-b"));
+	EXPECT_EQ("]", search("[]]"_re, "a]"));
+	EXPECT_EQ("a.b", search("a\\.b"_re, "axb a.b"));
+}
+
+TEST_F(static_regex_test, matches_anchors)
+{
+	EXPECT_EQ("<none>", search("^b"_re, "ab"));
+	EXPECT_EQ("ab", search("^ab$"_re, "ab"));
+	EXPECT_EQ("b", search("b$"_re, "abb"));
+}
+
+TEST_F(static_regex_test, never_reports_empty_match)
+{
+	EXPECT_EQ("<none>", search("x*"_re, "abc"));
+}
+
+TEST_F(static_regex_test, consumes_input_up_to_the_end_of_match)
+{
+	auto re = "[0-9]+;"_re;
+	nemok::buffer_type input{'a', '1', '2', ';', 'b'};
+
+	EXPECT_TRUE(re(input));
+	EXPECT_EQ(nemok::buffer_type{'b'}, input);
+	EXPECT_FALSE(re(input));
+}
@@ -13,6 +13,13 @@ struct telnet_mock_test : public ::testing::Test
 		auto after = std::chrono::steady_clock::now();
 		return std::chrono::duration_cast<std::chrono::microseconds>(after - before);
 	}
+
+	// one byte goes out, one byte comes back
+	std::string exchange(nemok::client& client, const std::string& input)
+	{
+		client.write(input.data(), input.size());
+		return nemok::read_all(client, 1);
+	}
 };
 
 TEST_F(telnet_mock_test, replies_to_a_request_according_to_specified_expectation)
@@ -187,3 +194,87 @@ TEST_F(telnet_mock_test, matches_regex)
 	EXPECT_EQ("done\ndone\n", nemok::read_all(client, 10));
 }
 
+TEST_F(telnet_mock_test, finds_a_match_among_thousands_of_expectations)
+{
+	auto mock = nemok::start<telnet>();
+	for (int i = 0; i < 5000; ++i)
+	{
+		mock.when("key" + std::to_string(i) + ";").reply(std::to_string(i % 10));
+	}
+
+	auto client = mock.connect();
+	client.write("key4999;key0;key1234;", 21);
+
+	EXPECT_EQ("904", nemok::read_all(client, 3));
+}
+
+TEST_F(telnet_mock_test, drops_fired_out_expectations_along_with_never_firing_ones)
+{
+	auto mock = nemok::start<telnet>();
+	mock.when("a").reply("1").once();
+	mock.when("b").reply("!").times(0);
+	mock.when("c").reply("3").once();
+	mock.when("d").reply("4").order(200);
+	mock.when("b").reply("b").order(200);
+
+	auto client = mock.connect();
+	EXPECT_EQ("1", exchange(client, "a"));
+	EXPECT_EQ("3", exchange(client, "c"));
+	EXPECT_EQ("4", exchange(client, "d"));
+	EXPECT_EQ("b", exchange(client, "b"));
+	EXPECT_EQ("4", exchange(client, "d"));
+}
+
+TEST_F(telnet_mock_test, keeps_order_groups_apart_while_dropping_fired_out_expectations)
+{
+	auto mock = nemok::start<telnet>();
+	mock.when("x").reply("1").once().order(1);
+	mock.when("x").reply("2").once().order(1);
+	mock.when("x").reply("3").once().order(1);
+	mock.when("x").reply("4").order(1);
+	mock.when("y").reply("a").once().order(2);
+	mock.when("y").reply("b").order(2);
+
+	auto client = mock.connect();
+	EXPECT_EQ("1", exchange(client, "x"));
+	EXPECT_EQ("a", exchange(client, "y"));
+	EXPECT_EQ("2", exchange(client, "x"));
+	EXPECT_EQ("b", exchange(client, "y"));
+	EXPECT_EQ("3", exchange(client, "x"));
+	EXPECT_EQ("b", exchange(client, "y"));
+	EXPECT_EQ("4", exchange(client, "x"));
+	EXPECT_EQ("b", exchange(client, "y"));
+}
+
+TEST_F(telnet_mock_test, goes_on_round_robin_after_dropping_fired_out_expectations)
+{
+	auto mock = nemok::start<telnet>();
+	mock.when("x").reply("1").once();
+	mock.when("x").reply("2").once();
+	mock.when("x").reply("3").once();
+	mock.when("x").reply("4");
+	mock.when("x").reply("5");
+
+	auto client = mock.connect();
+	std::string replies;
+	for (int i = 0; i < 7; ++i)
+	{
+		replies += exchange(client, "x");
+	}
+
+	EXPECT_EQ("1234545", replies);
+}
+
+TEST_F(telnet_mock_test, replies_with_generated_body)
+{
+	auto mock = nemok::start<telnet>();
+	mock.when("GET").reply(nemok::body::repeat("0123456789"), 200005);
+
+	auto client = mock.connect();
+	client.write("GET", 3);
+
+	const std::string body = nemok::read_all(client, 200005);
+	EXPECT_EQ("0123456789", body.substr(0, 10));
+	EXPECT_EQ("01234", body.substr(200000));
+	EXPECT_EQ(std::string::npos, body.find("00"));
+}
@@ -0,0 +1,178 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <fstream>
+#include "nemok/nemok.h"
+
+using namespace nemok;
+
+// every test has a log of its own, removed once the test is over
+struct trace_test : public ::testing::Test
+{
+	trace_test()
+	{
+		char name[] = "/tmp/nemok_trace_XXXXXX";
+		const int fd = ::mkstemp(name);
+		::close(fd);
+		::unlink(name);
+		path = name;
+	}
+
+	~trace_test()
+	{
+		::unlink(path.c_str());
+	}
+
+	trace_log::record make_record(uint64_t connection, trace_log::record_type type, uint64_t time, std::string data)
+	{
+		trace_log::record r;
+		r.connection = connection;
+		r.type = type;
+		r.time = time;
+		r.data = std::move(data);
+		return r;
+	}
+
+	std::string path;
+};
+
+TEST_F(trace_test, reads_back_varints)
+{
+	std::string out;
+	const uint64_t values[] = {0, 1, 127, 128, 300, 1ull << 35, ~0ull};
+	for (uint64_t v : values)
+	{
+		trace_log::append_varint(out, v);
+	}
+
+	string_view in(out);
+	for (uint64_t v : values)
+	{
+		uint64_t value = 0;
+		ASSERT_TRUE(trace_log::read_varint(in, value));
+		EXPECT_EQ(v, value);
+	}
+
+	EXPECT_TRUE(in.empty());
+
+	uint64_t value = 0;
+	string_view truncated("\x80\x80", 2);
+	EXPECT_FALSE(trace_log::read_varint(truncated, value));
+}
+
+TEST_F(trace_test, reads_back_sessions)
+{
+	{
+		trace_log::writer w(path);
+		w.start_session();
+		w.append(1, trace_log::REQUEST, "ping");
+		w.append(1, trace_log::RESPONSE, "pong");
+	}
+
+	{
+		trace_log::writer w(path);
+		w.start_session();
+		w.append(1, trace_log::REQUEST, std::string("\0\xff", 2));
+	}
+
+	const auto records = trace_log::read(path);
+	ASSERT_EQ(3u, records.size());
+	EXPECT_EQ("ping", records[0].data);
+	EXPECT_EQ(trace_log::REQUEST, records[0].type);
+	EXPECT_EQ("pong", records[1].data);
+	EXPECT_EQ(trace_log::RESPONSE, records[1].type);
+	EXPECT_EQ(records[0].connection, records[1].connection);
+	EXPECT_EQ(std::string("\0\xff", 2), records[2].data);
+	EXPECT_NE(records[0].connection, records[2].connection);
+}
+
+TEST_F(trace_test, refuses_what_is_not_a_log)
+{
+	std::ofstream(path) << "GET / HTTP/1.1\r\n\r\n";
+	EXPECT_THROW(trace_log::read(path), trace_log::log_error);
+}
+
+TEST_F(trace_test, groups_records_into_exchanges)
+{
+	using namespace trace_log;
+	const std::vector<record> records =
+	{
+		make_record(1, REQUEST, 10, "GET /a "),
+		make_record(2, REQUEST, 15, "GET /b\r\n\r\n"),
+		make_record(1, REQUEST, 20, "HTTP/1.1\r\n\r\n"),
+		make_record(1, RESPONSE, 70, "A1"),
+		make_record(1, RESPONSE, 80, "A2"),
+		make_record(2, REQUEST, 90, "unanswered"),
+		make_record(1, REQUEST, 100, "GET /c\r\n\r\n"),
+		make_record(1, RESPONSE, 105, "C"),
+	};
+
+	const auto ex = exchanges(records);
+	ASSERT_EQ(2u, ex.size());
+	EXPECT_EQ("GET /a HTTP/1.1\r\n\r\n", ex[0].request);
+	EXPECT_EQ("A1A2", ex[0].response);
+	EXPECT_EQ(50u, ex[0].delay);
+	EXPECT_EQ("GET /c\r\n\r\n", ex[1].request);
+	EXPECT_EQ("C", ex[1].response);
+	EXPECT_EQ(5u, ex[1].delay);
+}
+
+TEST_F(trace_test, replays_recorded_traffic)
+{
+	{
+		http upstream;
+		upstream.when(http::GET("/hello")).reply(http::response(200).content("world"));
+		upstream.when(http::POST("/items")).reply(http::response(201));
+		upstream.when(http::POST("/items")).reply(http::response(409));
+		upstream.start();
+
+		recorder rec(upstream.port(), path);
+		rec.start();
+
+		auto c = connect_client(rec);
+		http::send(c, "GET /hello HTTP/1.1\r\n\r\n");
+		EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nworld", http::receive(c));
+		http::send(c, "POST /items HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}");
+		EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+		http::send(c, "POST /items HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}");
+		EXPECT_EQ("HTTP/1.1 409 Conflict\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+		c.disconnect();
+
+		rec.stop();
+		rec.wait();
+		upstream.stop();
+		upstream.wait();
+	}
+
+	// the upstream is gone, the log alone answers
+	auto mock = trace<http>(path);
+	auto c = mock.connect();
+	http::send(c, "POST /items HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}");
+	EXPECT_EQ("HTTP/1.1 201 Created\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+	http::send(c, "GET /hello HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nworld", http::receive(c));
+	http::send(c, "POST /items HTTP/1.1\r\nContent-Length: 2\r\n\r\n{}");
+	EXPECT_EQ("HTTP/1.1 409 Conflict\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+}
+
+TEST_F(trace_test, reproduces_upstream_think_time)
+{
+	{
+		trace_log::writer w(path);
+		w.start_session();
+		w.append(1, trace_log::REQUEST, "GET /slow HTTP/1.1\r\n\r\n");
+		::usleep(100000);
+		w.append(1, trace_log::RESPONSE, "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n");
+	}
+
+	const auto elapsed = [](mock<http> m)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		auto c = m.connect();
+		http::send(c, "GET /slow HTTP/1.1\r\n\r\n");
+		http::receive(c);
+		return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	};
+
+	EXPECT_GE(elapsed(trace<http>(path, 1.0)), 90);
+	EXPECT_LT(elapsed(trace<http>(path)), 50);
+}
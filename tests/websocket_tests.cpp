@@ -0,0 +1,236 @@
+#include <gtest/gtest.h>
+#include "nemok/nemok.h"
+
+using namespace nemok;
+
+struct websocket_test : public ::testing::Test
+{
+	struct frame
+	{
+		bool fin;
+		int opcode;
+		std::string payload;
+	};
+
+	std::string handshake(client& c)
+	{
+		http::send(c, "GET /chat HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+			"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+		return http::receive(c);
+	}
+
+	void send(client& c, websocket_opcode opcode, std::string payload, bool fin = true)
+	{
+		write_client(c, websocket::masked_frame(opcode, payload, 0x37fa213d, fin));
+	}
+
+	frame read_frame(client& c)
+	{
+		const std::string head = read_all(c, 2);
+		frame f;
+		f.fin = head[0] & 0x80;
+		f.opcode = head[0] & 0x0f;
+
+		uint64_t length = head[1] & 0x7f;
+		const size_t extended = length == 126 ? 2 : length == 127 ? 8 : 0;
+		if (extended)
+		{
+			const std::string bytes = read_all(c, extended);
+			length = 0;
+			for (char ch : bytes)
+			{
+				length = (length << 8) | uint8_t(ch);
+			}
+		}
+
+		f.payload = length ? read_all(c, length) : "";
+		return f;
+	}
+};
+
+TEST_F(websocket_test, makes_accept_key)
+{
+	// RFC 6455, 1.3
+	EXPECT_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", websocket::accept_key("dGhlIHNhbXBsZSBub25jZQ=="));
+}
+
+TEST_F(websocket_test, unmasks_at_any_size_and_offset)
+{
+	const uint8_t mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+	std::vector<uint8_t> src(100);
+	for (size_t i = 0; i < src.size(); ++i)
+	{
+		src[i] = uint8_t(i * 7);
+	}
+
+	for (size_t offset = 0; offset < 4; ++offset)
+	{
+		for (size_t size = 0; size <= src.size(); ++size)
+		{
+			std::vector<uint8_t> dst(size);
+			websocket::unmask(dst.data(), src.data(), size, mask, offset);
+			for (size_t i = 0; i < size; ++i)
+			{
+				ASSERT_EQ(src[i] ^ mask[(offset + i) % 4], dst[i]) << "size " << size << " offset " << offset;
+			}
+		}
+	}
+}
+
+TEST_F(websocket_test, upgrades_and_replies_to_messages)
+{
+	auto mock = start<http>();
+	mock.when(http::GET("/chat")).accept_websocket().send_text("welcome");
+	mock.when(websocket::text("ping")).send_text("pong");
+	mock.when(websocket::binary()).echo();
+
+	auto c = mock.connect();
+	EXPECT_EQ("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n\r\n", handshake(c));
+	EXPECT_EQ("welcome", read_frame(c).payload);
+
+	send(c, WS_TEXT, "ping");
+	const frame pong = read_frame(c);
+	EXPECT_TRUE(pong.fin);
+	EXPECT_EQ(WS_TEXT, pong.opcode);
+	EXPECT_EQ("pong", pong.payload);
+
+	const std::string blob(70000, 'x');
+	send(c, WS_BINARY, blob);
+	const frame echo = read_frame(c);
+	EXPECT_EQ(WS_BINARY, echo.opcode);
+	EXPECT_EQ(blob, echo.payload);
+}
+
+TEST_F(websocket_test, matches_fragmented_message_as_a_whole)
+{
+	auto mock = start<http>();
+	mock.when(http::GET("/chat")).accept_websocket();
+	mock.when(websocket::text("hello world")).send_text("matched");
+
+	auto c = mock.connect();
+	handshake(c);
+	send(c, WS_TEXT, "hello", false);
+	send(c, WS_PING, "are you there");
+	send(c, WS_CONTINUATION, " world");
+
+	const frame pong = read_frame(c);
+	EXPECT_EQ(WS_PONG, pong.opcode);
+	EXPECT_EQ("are you there", pong.payload);
+	EXPECT_EQ("matched", read_frame(c).payload);
+}
+
+TEST_F(websocket_test, broadcasts_to_every_connection)
+{
+	auto mock = start<http>();
+	mock.when(http::GET("/chat")).accept_websocket();
+	mock.when(websocket::text()).broadcast();
+
+	auto a = mock.connect();
+	auto b = mock.connect();
+	handshake(a);
+	handshake(b);
+
+	send(a, WS_TEXT, "hi all");
+	EXPECT_EQ("hi all", read_frame(a).payload);
+	EXPECT_EQ("hi all", read_frame(b).payload);
+}
+
+TEST_F(websocket_test, broadcasts_past_slow_reader)
+{
+	const std::string big(65536, 'b');
+	auto mock = start<http>();
+	mock.when(http::GET("/chat")).accept_websocket();
+	mock.when(websocket::text("go")).broadcast_text(big);
+
+	auto slow = mock.connect();
+	auto fast = mock.connect();
+	handshake(slow);
+	handshake(fast);
+
+	// far more than the socket buffers hold, what's left waits in the hub
+	for (int i = 0; i < 64; ++i)
+	{
+		send(fast, WS_TEXT, "go");
+		EXPECT_EQ(big, read_frame(fast).payload);
+	}
+
+	// connections come and go meanwhile
+	auto late = mock.connect();
+	EXPECT_EQ("HTTP/1.1 101 Switching Protocols\r\n", handshake(late).substr(0, 34));
+
+	for (int i = 0; i < 64; ++i)
+	{
+		EXPECT_EQ(big, read_frame(slow).payload);
+	}
+}
+
+TEST_F(websocket_test, echoes_close_frame)
+{
+	auto mock = start<http>();
+	mock.when(http::GET("/chat")).accept_websocket();
+
+	auto c = mock.connect();
+	handshake(c);
+	send(c, WS_CLOSE, std::string("\x03\xe8", 2) + "bye");
+
+	const frame close = read_frame(c);
+	EXPECT_EQ(WS_CLOSE, close.opcode);
+	EXPECT_EQ(std::string("\x03\xe8", 2), close.payload);
+}
+
+TEST_F(websocket_test, closes_slow_reader_without_holding_back_the_others)
+{
+	const std::string big(65536, 'b');
+	auto mock = start<http>();
+	mock.when(http::GET("/chat")).accept_websocket();
+	mock.when(websocket::text("go")).broadcast_text(big);
+
+	auto slow = mock.connect();
+	auto fast = mock.connect();
+	handshake(slow);
+	handshake(fast);
+
+	for (int i = 0; i < 64; ++i)
+	{
+		send(fast, WS_TEXT, "go");
+		EXPECT_EQ(big, read_frame(fast).payload);
+	}
+
+	// a connection joining the hub waits for the broadcast going on to be done
+	auto late = mock.connect();
+	handshake(late);
+
+	// the close frame waits behind what the slow one hasn't read yet
+	send(slow, WS_CLOSE, std::string("\x03\xe8", 2));
+	for (int i = 0; i < 8; ++i)
+	{
+		send(fast, WS_TEXT, "go");
+		EXPECT_EQ(big, read_frame(fast).payload);
+	}
+
+	// the broadcasts which got to the mock before the close go first
+	int count = 0;
+	frame close = read_frame(slow);
+	for (; close.opcode == WS_TEXT && count < 72; ++count, close = read_frame(slow))
+	{
+		EXPECT_EQ(big, close.payload);
+	}
+
+	EXPECT_LE(64, count);
+	EXPECT_EQ(WS_CLOSE, close.opcode);
+	EXPECT_EQ(std::string("\x03\xe8", 2), close.payload);
+
+	char ch;
+	EXPECT_EQ(0, slow.read_some(&ch, 1));
+}
+
+TEST_F(websocket_test, refuses_plain_request)
+{
+	auto mock = start<http>();
+	mock.when(http::GET("/chat")).accept_websocket();
+
+	auto c = mock.connect();
+	http::send(c, "GET /chat HTTP/1.1\r\n\r\n");
+	EXPECT_EQ("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n", http::receive(c));
+}
@@ -0,0 +1,34 @@
+#include <iostream>
+#include "nemok/nemok.h"
+
+// compiles the http exchanges of trace logs into a corpus file:
+//   nemok_corpus api.corpus checkout.trace search.trace
+// the first response recorded for a method and an uri is the one kept
+int main(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		std::cerr << "usage: " << argv[0] << " <corpus> <trace>..." << std::endl;
+		return 2;
+	}
+
+	try
+	{
+		nemok::corpus_builder b;
+		for (int i = 2; i < argc; ++i)
+		{
+			const size_t added = nemok::add_recorded(b, nemok::trace_log::exchanges(nemok::trace_log::read(argv[i])));
+			std::cout << argv[i] << ": " << added << " responses" << std::endl;
+		}
+
+		b.write(argv[1]);
+		std::cout << argv[1] << ": " << nemok::corpus(argv[1]).size() << " keys" << std::endl;
+	}
+	catch (const nemok::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}